@@ -1,25 +1,42 @@
 #pragma once
 #include "lexer.h"
+#include <Diagnosis.h>
 #include <llvm-18/llvm/IR/DerivedTypes.h>
 #include <llvm-18/llvm/IR/IRBuilder.h>
 #include <llvm-18/llvm/IR/LLVMContext.h>
 #include <llvm-18/llvm/IR/Type.h>
 #include <llvm-18/llvm/IR/Value.h>
 #include <llvm-18/llvm/Support/Endian.h>
+#include <functional>
 #include <memory>
 #include <string>
 #include <strings.h>
+#include <types.h>
 #include <utility>
 #include <vector>
 
+// A variable resolved by sema. Owned by the function that declares it; slot
+// is its index in that function's locals.
+struct Symbol {
+  std::string name;
+  BType type;
+  unsigned slot = 0;
+  bool readOnly = false; // range-loop induction variables
+  bool soa = false;      // @soa array of structs, stored one array per field
+  bool addressTaken = false; // &name appears somewhere in the function
+};
+
 struct VWT {
-  llvm::Value *val;
-  llvm::Type *type;
-  llvm::Type *elementType;
+  llvm::Value *val = nullptr;
+  llvm::Type *type = nullptr;
+  llvm::Type *elementType = nullptr;
+  bool isValue = false; // val is the SSA value itself, not its address
 };
 
 struct StructIndex {
   llvm::StructType *TheStruct;
+  // Field name to LLVM element index; differs from declaration order when
+  // the struct is @reorder.
   std::vector<std::pair<std::string, size_t>> index;
   StructIndex(llvm::StructType *thestruct,
               std::vector<std::pair<std::string, size_t>> idx)
@@ -30,42 +47,66 @@ struct CodegenContext {
   std::unique_ptr<llvm::LLVMContext> TheContext;
   std::unique_ptr<llvm::IRBuilder<>> Builder;
   std::unique_ptr<llvm::Module> Module;
-  std::vector<std::unordered_map<std::string, VWT>> NamedValuesStack;
+  // Storage of the function being generated, indexed by Symbol::slot. Sema
+  // has already resolved scoping, so a lookup is a single vector index.
+  std::vector<VWT> Locals;
   std::unordered_map<std::string, std::unique_ptr<StructIndex>> StructIndexList;
+  // One global per distinct string literal.
+  std::unordered_map<std::string, llvm::GlobalVariable *> StringPool;
 
   llvm::BasicBlock *BreakBB = nullptr;
   llvm::BasicBlock *ContinueBB = nullptr;
 
-  // Scopes
-  void pushScope() { NamedValuesStack.push_back({}); }
-  void popScope() { NamedValuesStack.pop_back(); }
-
-  void addVariable(const std::string &name, llvm::Value *value,
-                   llvm::Type *Type, llvm::Type *elemenType) {
-    NamedValuesStack.back()[name] = VWT{value, Type, elemenType};
+  // --fast-math: every function behaves as if marked @fastmath.
+  bool FastMath = false;
+  // Slice indexing is checked unless the function is @unchecked.
+  bool BoundsChecks = true;
+  // --bounds-check: array, vector and pointer indexing is checked too.
+  bool CheckArrays = false;
+  // Where failed checks in the current function branch; made on first use.
+  llvm::BasicBlock *TrapBB = nullptr;
+  // (array or slice, induction variable) pairs whose accesses an enclosing
+  // range loop has already checked for its whole range.
+  std::vector<std::pair<const Symbol *, const Symbol *>> CheckedRanges;
+
+  // Allocas of the lets declared in each enclosing block, innermost last.
+  // Their lifetimes end when control leaves the block.
+  std::vector<std::vector<llvm::AllocaInst *>> LiveScopes;
+  // Size of LiveScopes at the innermost loop; break/continue end the
+  // lifetimes of everything above it.
+  size_t LoopScopeDepth = 0;
+
+  // Allocas always go in the entry block, so a let inside a loop reuses the
+  // same stack slot every iteration and mem2reg/SROA can promote it.
+  llvm::AllocaInst *createEntryAlloca(llvm::Type *type,
+                                      const std::string &name);
+  // Starts the lifetime of a block-scoped local at the current point.
+  void startLifetime(llvm::AllocaInst *alloca);
+  // Emits lifetime.end for every scope at index depth and above.
+  void endLifetimes(size_t depth);
+
+  void pushLifetimeScope() { LiveScopes.emplace_back(); }
+  void popLifetimeScope() {
+    if (!Builder->GetInsertBlock()->getTerminator())
+      endLifetimes(LiveScopes.size() - 1);
+    LiveScopes.pop_back();
   }
 
-  llvm::Value *lookup(const std::string &name) {
-    for (auto it = NamedValuesStack.rbegin(); it != NamedValuesStack.rend();
-         ++it)
-      if (it->count(name))
-        return (*it)[name].val;
-    return nullptr;
+  void addVariable(const Symbol *sym, llvm::Value *value, llvm::Type *Type,
+                   llvm::Type *elemenType) {
+    Locals[sym->slot] = VWT{value, Type, elemenType};
   }
 
-  llvm::Type *lookupType(const std::string &name) {
-    for (auto it = NamedValuesStack.rbegin(); it != NamedValuesStack.rend();
-         ++it)
-      if (it->count(name))
-        return (*it)[name].type;
-    return nullptr;
+  // Binds a read-only local directly to an SSA value, with no alloca.
+  void addValue(const Symbol *sym, llvm::Value *value) {
+    Locals[sym->slot] = VWT{value, value->getType(), nullptr, true};
   }
-  llvm::Type *lookupElementType(const std::string &name) {
-    for (auto it = NamedValuesStack.rbegin(); it != NamedValuesStack.rend();
-         ++it)
-      if (it->count(name))
-        return (*it)[name].elementType;
-    return nullptr;
+
+  // Null if sym is unresolved or its declaration has not been generated yet.
+  const VWT *lookup(const Symbol *sym) const {
+    if (!sym || sym->slot >= Locals.size() || !Locals[sym->slot].val)
+      return nullptr;
+    return &Locals[sym->slot];
   }
 
   CodegenContext(const std::string &name)
@@ -74,112 +115,163 @@ struct CodegenContext {
         Module(std::make_unique<llvm::Module>(name, *TheContext)) {}
 };
 
-llvm::Type *GetPointeeType(Token typeToken, CodegenContext &cc);
-llvm::Type *GetTypeVoid(Token type, CodegenContext &cc);
-llvm::Type *GetTypeNonVoid(Token type, CodegenContext &cc);
+llvm::Type *lowerType(const BType &type, CodegenContext &cc);
+
+struct ast;
+struct FoldContext;
+struct SemaContext;
+
+using ChildVisitor = std::function<void(std::unique_ptr<ast> &)>;
 
 struct ast {
+  SourceLoc loc{"<input>", 0, 0};
+  BType exprType; // set by sema; Unknown for statements
+
   virtual ~ast() = default;
   virtual std::string repr() = 0;
   virtual llvm::Value *codegen(CodegenContext &cc) = 0;
+
+  // Module-level declarations, run over every top-level node before any
+  // analyze/codegen so functions and structs can be used before their
+  // definition. Only FunctionNode and StructCreateNode declare anything.
+  virtual void declare(SemaContext &sc) {}
+  virtual void declare(CodegenContext &cc) {}
+
+  // Name and type resolution (src/sema.cpp). The default analyzes children.
+  virtual void analyze(SemaContext &sc);
+
+  // Calls fn on every non-null child slot, so passes can rewrite in place.
+  virtual void forEachChild(const ChildVisitor &fn) {}
+
+  // Constant folding (src/fold.cpp). Returns a replacement for this node, or
+  // nullptr to keep it.
+  virtual std::unique_ptr<ast> fold(FoldContext &fc);
 };
 
 struct CharNode : ast {
   char val;
 
-  CharNode(char value) : val(value) {}
+  CharNode(char value) : val(value) { exprType = BType::Char; }
   std::string repr() override;
   llvm::Value *codegen(CodegenContext &cc) override;
 };
 
 struct IntegerNode : ast {
-  int val;
-  IntegerNode(const int v) : val(v) {}
+  int64_t val;
+  IntegerNode(const int64_t v) : val(v) { exprType = BType::Integer; }
   std::string repr() override;
   llvm::Value *codegen(CodegenContext &cc) override;
 };
 
 struct FloatNode : ast {
   float val;
-  FloatNode(float v) : val(v) {}
+  FloatNode(float v) : val(v) { exprType = BType::Float; }
   std::string repr() override;
   llvm::Value *codegen(CodegenContext &cc) override;
 };
 
 struct BooleanNode : ast {
   bool val;
-  BooleanNode(bool v) : val(v) {}
+  BooleanNode(bool v) : val(v) { exprType = BType::Boolean; }
   std::string repr() override;
   llvm::Value *codegen(CodegenContext &cc) override;
 };
 
-// struct StringNode : ast {
-//   std::string val;
-//   StringNode(const std::string &v) : val(v) {}
-//   std::string repr() override;
-//   llvm::Value *codegen(CodegenContext &cc) override;
-// };
+// A string literal. Lowered to a pointer to a shared, null-terminated
+// read-only global; it is never copied unless it initializes a Char array.
+struct StringNode : ast {
+  std::string val;
+  StringNode(const std::string &v) : val(v) {
+    exprType = BType::pointerTo(BType::Char);
+  }
+  std::string repr() override;
+  llvm::Value *codegen(CodegenContext &cc) override;
+};
 
 struct VariableDeclareNode : ast {
   std::string name;
-  Token Type;
-  std::unique_ptr<ast> val;          // can be single value or ArrayLiteralNode
-  std::optional<unsigned> arraySize; // new: size if it's an array
+  BType Type;               // declared type, an Array for `let x:T[N]`
+  std::unique_ptr<ast> val; // can be single value or ArrayLiteralNode
+  Symbol *sym = nullptr;
+  bool soa = false; // @soa: store each field of the elements contiguously
 
-  VariableDeclareNode(const std::string &n, std::unique_ptr<ast> v, Token t,
-                      std::optional<unsigned> size = 1)
-      : name(n), val(std::move(v)), Type(t), arraySize(size) {}
+  VariableDeclareNode(const std::string &n, std::unique_ptr<ast> v, BType t)
+      : name(n), val(std::move(v)), Type(std::move(t)) {}
 
   std::string repr() override;
 
   llvm::Value *codegen(CodegenContext &cc) override;
+  void analyze(SemaContext &sc) override;
+  void forEachChild(const ChildVisitor &fn) override;
+  std::unique_ptr<ast> fold(FoldContext &fc) override;
 };
 
 struct AssignmentNode : ast {
   std::string name;
   std::unique_ptr<ast> val;
+  Symbol *sym = nullptr;
   AssignmentNode(const std::string &n, std::unique_ptr<ast> v)
       : name(n), val(std::move(v)) {}
   std::string repr() override;
   llvm::Value *codegen(CodegenContext &cc) override;
+  void analyze(SemaContext &sc) override;
+  void forEachChild(const ChildVisitor &fn) override;
 };
 
 struct ReturnNode : ast {
   std::unique_ptr<ast> expr;
+  BType retType; // the enclosing function's, set by sema
   ReturnNode(std::unique_ptr<ast> exp) : expr(std::move(exp)) {}
   std::string repr() override;
   llvm::Value *codegen(CodegenContext &cc) override;
+  void analyze(SemaContext &sc) override;
+  void forEachChild(const ChildVisitor &fn) override;
 };
 struct CompoundNode : ast {
   std::vector<std::unique_ptr<ast>> blocks;
   CompoundNode(std::vector<std::unique_ptr<ast>> b) : blocks(std::move(b)) {}
   std::string repr() override;
   llvm::Value *codegen(CodegenContext &cc) override;
+  void analyze(SemaContext &sc) override;
+  void forEachChild(const ChildVisitor &fn) override;
+  std::unique_ptr<ast> fold(FoldContext &fc) override;
 };
 
 struct FunctionNode : ast {
   std::string name;
-  std::vector<std::tuple<std::string, llvm::Type *>> args;
+  std::vector<std::tuple<std::string, BType>> args;
   bool isVaridic;
   std::unique_ptr<ast> content;
-  Token ReturnType;
+  BType ReturnType;
+  // Parameters first, then every let in the body, in declaration order.
+  std::vector<std::unique_ptr<Symbol>> locals;
+  bool fastMath = false;  // @fastmath
+  bool unchecked = false; // @unchecked: no slice bounds checks
 
   FunctionNode(const std::string &s,
-               std::vector<std::tuple<std::string, llvm::Type *>> ars,
-               std::unique_ptr<ast> cntnt, Token RetType, bool varidic)
+               std::vector<std::tuple<std::string, BType>> ars,
+               std::unique_ptr<ast> cntnt, BType RetType, bool varidic)
       : name(s), args(ars), content(std::move(cntnt)), ReturnType(RetType),
         isVaridic(varidic) {}
 
   std::string repr() override;
   llvm::Value *codegen(CodegenContext &cc) override;
+  void declare(SemaContext &sc) override;
+  void declare(CodegenContext &cc) override;
+  void analyze(SemaContext &sc) override;
+  void forEachChild(const ChildVisitor &fn) override;
+  std::unique_ptr<ast> fold(FoldContext &fc) override;
 };
 
 struct VariableReferenceNode : ast {
   std::string Name;
+  Symbol *sym = nullptr;
 
   VariableReferenceNode(const std::string &s) : Name(s) {}
   std::string repr() override;
   llvm::Value *codegen(CodegenContext &cc) override;
+  void analyze(SemaContext &sc) override;
+  std::unique_ptr<ast> fold(FoldContext &fc) override;
 };
 
 struct WhileNode : ast {
@@ -190,6 +282,9 @@ struct WhileNode : ast {
       : condition(std::move(condtn)), body(std::move(bdy)) {}
   std::string repr() override;
   llvm::Value *codegen(CodegenContext &cc) override;
+  void analyze(SemaContext &sc) override;
+  void forEachChild(const ChildVisitor &fn) override;
+  std::unique_ptr<ast> fold(FoldContext &fc) override;
 };
 
 struct IfNode : ast {
@@ -204,37 +299,113 @@ struct IfNode : ast {
 
   std::string repr() override;
   llvm::Value *codegen(CodegenContext &cc) override;
+  void analyze(SemaContext &sc) override;
+  void forEachChild(const ChildVisitor &fn) override;
+  std::unique_ptr<ast> fold(FoldContext &fc) override;
 };
 
 struct BinaryOperationNode : ast {
   std::unique_ptr<ast> Left;
   std::unique_ptr<ast> Right;
   TokenType Type;
+  BType operandType; // both sides are converted to this before the op
   BinaryOperationNode(TokenType tp, std::unique_ptr<ast> LHS,
                       std::unique_ptr<ast> RHS)
       : Type(tp), Left(std::move(LHS)), Right(std::move(RHS)) {}
 
   std::string repr() override;
   llvm::Value *codegen(CodegenContext &cc) override;
+  void analyze(SemaContext &sc) override;
+  void forEachChild(const ChildVisitor &fn) override;
+  std::unique_ptr<ast> fold(FoldContext &fc) override;
+};
+
+// Prefix operator; currently only `~`.
+struct UnaryOperationNode : ast {
+  TokenType Type;
+  std::unique_ptr<ast> Operand;
+  UnaryOperationNode(TokenType tp, std::unique_ptr<ast> operand)
+      : Type(tp), Operand(std::move(operand)) {}
+
+  std::string repr() override;
+  llvm::Value *codegen(CodegenContext &cc) override;
+  void analyze(SemaContext &sc) override;
+  void forEachChild(const ChildVisitor &fn) override;
+  std::unique_ptr<ast> fold(FoldContext &fc) override;
 };
 
 struct BreakNode : ast {
   std::string repr() override;
   llvm::Value *codegen(CodegenContext &cc) override;
+  void analyze(SemaContext &sc) override;
 };
 
 struct ContinueNode : ast {
   std::string repr() override;
   llvm::Value *codegen(CodegenContext &cc) override;
+  void analyze(SemaContext &sc) override;
 };
+// Bit-manipulation builtins, lowered straight to LLVM intrinsics. A user
+// function with the same name takes precedence.
+enum class Builtin {
+  None,
+  Popcount,
+  Clz,
+  Ctz,
+  Bswap,
+  Rotl,
+  Rotr,
+  // SIMD vectors
+  Shuffle,
+  ReduceAdd,
+  ReduceMul,
+  ReduceMin,
+  ReduceMax,
+  ReduceAnd,
+  ReduceOr,
+  ReduceXor,
+  Load,
+  Store,
+  AlignedLoad,
+  AlignedStore,
+  // Slices
+  Len,
+  MakeSlice,
+  // Buffered output (runtime/io.c)
+  Write,
+  Flush,
+  SetBuffering,
+  // Memory-mapped files (runtime/file.c)
+  MapFile,
+  UnmapFile,
+  Advise,
+  CreateFile,
+  AppendFile,
+  CloseFile,
+  // Asynchronous I/O (runtime/aio.c)
+  AioRead,
+  AioWrite,
+  AioOpen,
+  AioClose,
+  AioSubmit,
+  AioPoll,
+  AioWait,
+};
+
 struct CallNode : ast {
   std::string name;
   std::vector<std::unique_ptr<ast>> args;
+  std::vector<BType> paramTypes; // declared parameter types, set by sema
+  Builtin builtin = Builtin::None; // set by sema
+  std::string symbol; // stdlib definition to call instead, set by sema
+  bool variadic = false; // symbol takes C varargs, set by sema
 
   CallNode(const std::string &s, std::vector<std::unique_ptr<ast>> arg)
       : name(s), args(std::move(arg)) {}
   std::string repr() override;
   llvm::Value *codegen(CodegenContext &cc) override;
+  void analyze(SemaContext &sc) override;
+  void forEachChild(const ChildVisitor &fn) override;
 };
 
 struct ForNode : ast {
@@ -250,35 +421,88 @@ struct ForNode : ast {
 
   std::string repr() override;
   llvm::Value *codegen(CodegenContext &cc) override;
+  void analyze(SemaContext &sc) override;
+  void forEachChild(const ChildVisitor &fn) override;
+};
+
+enum class Schedule { Static, Dynamic };
+enum class ReduceOp { Add, Mul, And, Or, Xor, Min, Max };
+
+struct Reduction {
+  ReduceOp op;
+  std::string name;
+  SourceLoc loc;
+  Symbol *sym = nullptr;
+};
+
+// The parts of `parallel for` that a plain range loop does not have. The
+// body is outlined and run by basiq_parallel_for (runtime/parallel.c).
+struct ParallelSpec {
+  Schedule schedule = Schedule::Static;
+  int64_t chunk = 0; // 0 lets the runtime choose
+  std::vector<Reduction> reductions;
+  // Locals of the enclosing function the body uses; filled in by sema and
+  // passed to the outlined body by reference.
+  std::vector<Symbol *> captures;
+};
+
+// `for i in start..end [step n]`: i takes start, start + n, ... while it is
+// below end (above end for a negative step). Bounds are evaluated once and
+// i is read-only, so codegen can emit a canonical phi induction variable.
+struct RangeForNode : ast {
+  std::string var;
+  std::unique_ptr<ast> start;
+  std::unique_ptr<ast> end;
+  std::unique_ptr<ast> step; // null for 1
+  std::unique_ptr<ast> body;
+  Symbol *sym = nullptr;
+  int64_t stepValue = 1; // set by sema once step has folded to a literal
+  std::unique_ptr<ParallelSpec> parallel; // null for a serial loop
+
+  RangeForNode(const std::string &v, std::unique_ptr<ast> s,
+               std::unique_ptr<ast> e, std::unique_ptr<ast> st,
+               std::unique_ptr<ast> b)
+      : var(v), start(std::move(s)), end(std::move(e)), step(std::move(st)),
+        body(std::move(b)) {}
+
+  std::string repr() override;
+  llvm::Value *codegen(CodegenContext &cc) override;
+  void analyze(SemaContext &sc) override;
+  void forEachChild(const ChildVisitor &fn) override;
+  std::unique_ptr<ast> fold(FoldContext &fc) override;
 };
 
 struct ArrayLiteralNode : ast {
-  llvm::Type *ElementType;
   std::vector<std::unique_ptr<ast>> Elements;
 
-  ArrayLiteralNode(llvm::Type *elemType,
-                   std::vector<std::unique_ptr<ast>> elements)
-      : ElementType(elemType), Elements(std::move(elements)) {}
+  ArrayLiteralNode(std::vector<std::unique_ptr<ast>> elements)
+      : Elements(std::move(elements)) {}
 
   std::string repr() override;
   llvm::Value *codegen(CodegenContext &cc) override;
+  void analyze(SemaContext &sc) override;
+  void forEachChild(const ChildVisitor &fn) override;
 };
 
 struct ArrayAccessNode : ast {
   std::string arrayName;
   std::unique_ptr<ast> indexExpr;
+  Symbol *sym = nullptr;
 
   ArrayAccessNode(const std::string &name, std::unique_ptr<ast> index)
       : arrayName(name), indexExpr(std::move(index)) {}
 
   std::string repr() override;
   llvm::Value *codegen(CodegenContext &cc) override;
+  void analyze(SemaContext &sc) override;
+  void forEachChild(const ChildVisitor &fn) override;
 };
 
 struct ArrayAssignNode : ast {
   std::string name;           // array name
   std::unique_ptr<ast> index; // index expression
   std::unique_ptr<ast> value; // value to assign
+  Symbol *sym = nullptr;
 
   ArrayAssignNode(const std::string &n, std::unique_ptr<ast> idx,
                   std::unique_ptr<ast> val)
@@ -287,15 +511,42 @@ struct ArrayAssignNode : ast {
   std::string repr() override;
 
   llvm::Value *codegen(CodegenContext &cc) override;
+  void analyze(SemaContext &sc) override;
+  void forEachChild(const ChildVisitor &fn) override;
+};
+
+// name[lo..hi]: elements lo up to, not including, hi of an array or slice,
+// as a slice. lo defaults to 0 and hi to the length.
+struct SubSliceNode : ast {
+  std::string name;
+  std::unique_ptr<ast> lo; // may be null
+  std::unique_ptr<ast> hi; // may be null
+  Symbol *sym = nullptr;
+
+  SubSliceNode(const std::string &n, std::unique_ptr<ast> l,
+               std::unique_ptr<ast> h)
+      : name(n), lo(std::move(l)), hi(std::move(h)) {}
+
+  std::string repr() override;
+  llvm::Value *codegen(CodegenContext &cc) override;
+  void analyze(SemaContext &sc) override;
+  void forEachChild(const ChildVisitor &fn) override;
 };
 
+// sizeof(x) / alignof(x), where x is an expression or a type. Both are
+// DataLayout constants; the operand is never evaluated.
 struct SizeOfNode : ast {
   std::unique_ptr<ast> val;
+  BType type; // the operand when it is a type, or once sema resolves it
+  bool align = false;
 
   SizeOfNode(std::unique_ptr<ast> valval) : val(std::move(valval)) {}
+  SizeOfNode(BType t) : type(std::move(t)) {}
   std::string repr() override;
 
   llvm::Value *codegen(CodegenContext &cc) override;
+  void analyze(SemaContext &sc) override;
+  void forEachChild(const ChildVisitor &fn) override;
 };
 
 struct SyscallNode : ast {
@@ -306,21 +557,26 @@ struct SyscallNode : ast {
   std::string repr() override { return "SYSCALLNODE"; }
 
   llvm::Value *codegen(CodegenContext &cc) override;
+  void analyze(SemaContext &sc) override;
+  void forEachChild(const ChildVisitor &fn) override;
 };
 
 struct PointerReferenceNode : ast {
   std::string name;
+  Symbol *sym = nullptr;
   PointerReferenceNode(const std::string &s) : name(s) {}
 
   std::string repr() override;
 
   llvm::Value *codegen(CodegenContext &cc) override;
+  void analyze(SemaContext &sc) override;
 };
 
 struct PointerDeReferenceAssingNode : ast {
   std::string name;
   std::unique_ptr<ast> val;
   std::unique_ptr<ast> index;
+  Symbol *sym = nullptr;
 
   PointerDeReferenceAssingNode(const std::string &n, std::unique_ptr<ast> v,
                                std::unique_ptr<ast> i)
@@ -329,37 +585,81 @@ struct PointerDeReferenceAssingNode : ast {
   std::string repr() override;
 
   llvm::Value *codegen(CodegenContext &cc) override;
+  void analyze(SemaContext &sc) override;
+  void forEachChild(const ChildVisitor &fn) override;
 };
 
 struct DeReferenceNode : ast {
   std::string name;
   std::unique_ptr<ast> index;
+  Symbol *sym = nullptr;
 
   DeReferenceNode(const std::string &n, std::unique_ptr<ast> idx)
       : name(n), index(std::move(idx)) {}
   std::string repr() override { return "PointerDeReferenceNode"; }
 
   llvm::Value *codegen(CodegenContext &cc) override;
+  void analyze(SemaContext &sc) override;
+  void forEachChild(const ChildVisitor &fn) override;
 };
 
 struct CastNode : ast {
   std::unique_ptr<ast> Value;
-  llvm::Type *targetType;
+  BType targetType;
 
-  CastNode(std::unique_ptr<ast> V, llvm::Type *type)
-      : Value(std::move(V)), targetType(type) {}
+  CastNode(std::unique_ptr<ast> V, BType type)
+      : Value(std::move(V)), targetType(std::move(type)) {}
   std::string repr() override { return "CastNode"; }
 
   llvm::Value *codegen(CodegenContext &cc) override;
+  void analyze(SemaContext &sc) override;
+  void forEachChild(const ChildVisitor &fn) override;
+  std::unique_ptr<ast> fold(FoldContext &fc) override;
 };
 
+// Fields are laid out in declaration order unless the struct is marked
+// @reorder (sorted by decreasing alignment, which removes padding between
+// them) or @packed (no padding at all, alignment 1).
 struct StructCreateNode : ast {
-  std::unordered_map<std::string, llvm::Type *> types;
   std::string name;
+  std::vector<std::pair<std::string, BType>> fields;
+  bool packed = false;
+  bool reorder = false;
   StructCreateNode(const std::string &s,
-                   std::unordered_map<std::string, llvm::Type *> tps)
-      : name(s), types(std::move(tps)) {}
-  std::string repr() override { return "CastNode"; }
+                   std::vector<std::pair<std::string, BType>> fs)
+      : name(s), fields(std::move(fs)) {}
+  std::string repr() override { return "StructCreateNode(" + name + ")"; }
+
+  llvm::Value *codegen(CodegenContext &cc) override;
+  void declare(SemaContext &sc) override;
+  void declare(CodegenContext &cc) override;
+  void analyze(SemaContext &sc) override;
+};
+
+// base.field, where base is a struct lvalue (a variable, array element or
+// another member) or a pointer to a struct, which is dereferenced.
+struct MemberAccessNode : ast {
+  std::unique_ptr<ast> base;
+  std::string field;
+
+  MemberAccessNode(std::unique_ptr<ast> b, const std::string &f)
+      : base(std::move(b)), field(f) {}
+  std::string repr() override;
+
+  llvm::Value *codegen(CodegenContext &cc) override;
+  void analyze(SemaContext &sc) override;
+  void forEachChild(const ChildVisitor &fn) override;
+};
+
+struct MemberAssignNode : ast {
+  std::unique_ptr<ast> target; // a MemberAccessNode
+  std::unique_ptr<ast> val;
+
+  MemberAssignNode(std::unique_ptr<ast> t, std::unique_ptr<ast> v)
+      : target(std::move(t)), val(std::move(v)) {}
+  std::string repr() override;
 
   llvm::Value *codegen(CodegenContext &cc) override;
+  void analyze(SemaContext &sc) override;
+  void forEachChild(const ChildVisitor &fn) override;
 };
@@ -0,0 +1,49 @@
+#pragma once
+#include <ast.h>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// AST-level constant folding and propagation. Runs between parsing and
+// codegen, so even unoptimized builds see literal-only expressions as a
+// single constant.
+struct FoldContext {
+  // Known constant bindings per scope. A null entry means the name is
+  // declared in that scope but not a constant, which shadows outer bindings.
+  std::vector<std::unordered_map<std::string, std::unique_ptr<ast>>> scopes;
+
+  // Names written anywhere in the current function (assigned, array-assigned
+  // or address-taken). Such lets are never propagated.
+  std::unordered_set<std::string> written;
+
+  void pushScope() { scopes.push_back({}); }
+  void popScope() { scopes.pop_back(); }
+
+  void bind(const std::string &name, std::unique_ptr<ast> value) {
+    scopes.back()[name] = std::move(value);
+  }
+
+  ast *lookup(const std::string &name) {
+    for (auto it = scopes.rbegin(); it != scopes.rend(); ++it) {
+      auto found = it->find(name);
+      if (found != it->end())
+        return found->second.get();
+    }
+    return nullptr;
+  }
+
+  // Folds the node in the slot, replacing it if it simplifies.
+  void fold(std::unique_ptr<ast> &node) {
+    if (!node)
+      return;
+    if (auto replacement = node->fold(*this)) {
+      if (!replacement->loc.line)
+        replacement->loc = node->loc;
+      node = std::move(replacement);
+    }
+  }
+};
+
+void foldProgram(std::vector<std::unique_ptr<ast>> &program);
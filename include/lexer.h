@@ -8,6 +8,7 @@ enum TokenType {
   AUTHOR,
   IMPORT,
   SYSCALL,
+  ATTRIBUTE, // any other @word, e.g. @fastmath
   // Keywords
   LET,
   FUNC,
@@ -20,6 +21,7 @@ enum TokenType {
   CLASS,
   STRUCT,
   SIZEOF,
+  ALIGNOF,
   TYPES,
   BREAK,
   CONTINUE,
@@ -38,6 +40,12 @@ enum TokenType {
   MINUS,
   STAR,
   SLASH,
+  PERCENT,
+  PIPE,
+  CARET,
+  TILDE,
+  SHL,
+  SHR,
   EQ,
   EQEQ,
   NOTEQ,
@@ -59,6 +67,7 @@ enum TokenType {
   DASHGREATER,
   ANDPERCENT,
   RANGE,
+  DOT,
   SEMICOLON,
   VARIDIC,
   // End of file
@@ -86,7 +95,8 @@ class Lexer {
   std::string filename = "<input>"; // ← add
 
 public:
-  Lexer(std::string inp) : input(inp) {}
+  Lexer(std::string inp, std::string file = "<input>")
+      : input(inp), filename(file) {}
   char Peek() const;
   char PeekNext() const;
   char PeekNextNext() const;
@@ -22,9 +22,25 @@ public:
   Token Consume();
   Token Expect(TokenType tk);
 
+  // Creates an AST node stamped with the location of tok.
+  template <typename T, typename... Args>
+  std::unique_ptr<T> node(const Token &tok, Args &&...args) {
+    auto n = std::make_unique<T>(std::forward<Args>(args)...);
+    n->loc = {tok.file, tok.line, tok.col};
+    return n;
+  }
+
+  BType ParseType();
+
   std::unique_ptr<ast> ParseFactor();
+  std::unique_ptr<ast> ParseMembers(std::unique_ptr<ast> base);
   std::unique_ptr<ast> ParseAddSub();
+  std::unique_ptr<ast> ParseShift();
   std::unique_ptr<ast> ParseComparison();
+  std::unique_ptr<ast> ParseBitAnd();
+  std::unique_ptr<ast> ParseBitXor();
+  std::unique_ptr<ast> ParseBitOr();
+  std::unique_ptr<ast> ParseLogicalAnd();
   std::unique_ptr<ast> ParseTerm();
 
   std::unique_ptr<ast> ParseExpression();
@@ -35,9 +51,15 @@ public:
   std::unique_ptr<ReturnNode> ParseReturn();
   std::unique_ptr<IfNode> ParseIfElse();
   std::unique_ptr<WhileNode> ParseWhile();
-  std::unique_ptr<ForNode> ParseFor();
+  std::unique_ptr<ast> ParseFor();
+  std::unique_ptr<RangeForNode>
+  ParseRangeFor(const Token &start,
+                std::unique_ptr<ParallelSpec> parallel = nullptr);
+  std::unique_ptr<RangeForNode> ParseParallel();
+  void ParseReductions(ParallelSpec &spec);
   std::unique_ptr<StructCreateNode> ParseStruct();
   std::unique_ptr<ast> ParseAssignment();
+  std::unique_ptr<ast> ParseAttributed();
 
   std::unique_ptr<ast> ParseStatement();
 
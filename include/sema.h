@@ -0,0 +1,69 @@
+#pragma once
+#include <Diagnosis.h>
+#include <ast.h>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+struct FunctionSig {
+  BType ret;
+  std::vector<BType> params;
+  bool variadic = false;
+};
+
+// Semantic analysis. Resolves every variable use to its Symbol and gives
+// every expression a BASIQ-level type, so codegen is a straight lowering.
+struct SemaContext {
+  Diagnostics &diag;
+  std::vector<std::unordered_map<std::string, Symbol *>> scopes;
+  std::unordered_map<std::string, FunctionSig> functions;
+  // Fields of each struct, in declaration order.
+  std::unordered_map<std::string, std::vector<std::pair<std::string, BType>>>
+      structs;
+
+  FunctionNode *currentFunction = nullptr;
+  unsigned loopDepth = 0;
+  // Declared type of the let, assignment or return value being analyzed.
+  // Only vector `load` uses it, to pick its width.
+  BType expectedType;
+
+  // Enclosing parallel for bodies, innermost last. An outer local resolved
+  // inside one becomes a capture of that loop.
+  struct ParallelRegion {
+    size_t scopeDepth; // index of the loop's own scope
+    unsigned loopDepth;
+    ParallelSpec *spec;
+  };
+  std::vector<ParallelRegion> parallelRegions;
+
+  // Compiling for --freestanding, which has no threads for parallel for.
+  bool freestanding = false;
+
+  explicit SemaContext(Diagnostics &d) : diag(d) {}
+
+  void pushScope() { scopes.push_back({}); }
+  void popScope() { scopes.pop_back(); }
+
+  void error(const ast &at, const std::string &msg,
+             const std::string &hint = "") {
+    diag.error(at.loc, msg, hint);
+  }
+
+  void analyze(std::unique_ptr<ast> &node) {
+    if (node)
+      node->analyze(*this);
+  }
+
+  // Declares a local of the current function in the innermost scope.
+  Symbol *declare(const ast &at, const std::string &name, const BType &type);
+  // Finds the innermost symbol for name, reporting an error if there is none.
+  Symbol *resolve(const ast &at, const std::string &name);
+  Symbol *resolve(const SourceLoc &loc, const std::string &name);
+  // Reports an error if type names an unknown struct.
+  bool checkType(const ast &at, const BType &type);
+};
+
+void analyzeProgram(std::vector<std::unique_ptr<ast>> &program,
+                    Diagnostics &diag, bool freestanding = false);
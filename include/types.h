@@ -0,0 +1,210 @@
+#pragma once
+#include <algorithm>
+#include <cctype>
+#include <memory>
+#include <string>
+#include <utility>
+
+// BASIQ-level type, resolved by the parser and sema and lowered to an
+// llvm::Type only during codegen.
+struct BType {
+  enum Kind {
+    Unknown,
+    Void,
+    Boolean,
+    Char,
+    Integer, // Int32, or Int64 with --int64
+    Int8,
+    Int16,
+    Int32,
+    Int64,
+    UInt8,
+    UInt16,
+    UInt32,
+    UInt64,
+    Float,
+    Pointer,
+    Array,
+    Vector, // SIMD, e.g. Float4 or Int8x16; lowers to <N x T>
+    Slice,  // T[]: pointer and length, passed by value
+    Struct
+  };
+
+  // Width of Integer, set once from the command line before parsing.
+  static inline unsigned IntegerBits = 32;
+
+  Kind kind = Unknown;
+  std::shared_ptr<const BType> elem; // pointee, array or slice element
+  unsigned count = 0;                // array length or vector lanes
+  std::string name;                  // struct name
+
+  BType() = default;
+  BType(Kind k) : kind(k) {}
+
+  static BType pointerTo(const BType &pointee) {
+    BType t(Pointer);
+    t.elem = std::make_shared<const BType>(pointee);
+    return t;
+  }
+
+  static BType arrayOf(const BType &element, unsigned n) {
+    BType t(Array);
+    t.elem = std::make_shared<const BType>(element);
+    t.count = n;
+    return t;
+  }
+
+  static BType vectorOf(const BType &lane, unsigned n) {
+    BType t(Vector);
+    t.elem = std::make_shared<const BType>(lane);
+    t.count = n;
+    return t;
+  }
+
+  static BType sliceOf(const BType &element) {
+    BType t(Slice);
+    t.elem = std::make_shared<const BType>(element);
+    return t;
+  }
+
+  static BType structNamed(const std::string &n) {
+    BType t(Struct);
+    t.name = n;
+    return t;
+  }
+
+  bool isKnown() const { return kind != Unknown; }
+  bool isVoid() const { return kind == Void; }
+  bool isPointer() const { return kind == Pointer; }
+  bool isArray() const { return kind == Array; }
+  bool isVector() const { return kind == Vector; }
+  bool isSlice() const { return kind == Slice; }
+  bool isStruct() const { return kind == Struct; }
+  // Boolean, Char and the sized integers all lower to LLVM integers.
+  bool isInteger() const { return kind >= Boolean && kind <= UInt64; }
+  bool isUnsigned() const { return kind >= UInt8 && kind <= UInt64; }
+  bool isFloat() const { return kind == Float; }
+  bool isNumeric() const { return isInteger() || isFloat(); }
+
+  const BType &element() const { return *elem; }
+  // The lane type of a vector, the type itself otherwise.
+  const BType &scalar() const { return kind == Vector ? *elem : *this; }
+
+  // Bit width of an integer type.
+  unsigned bits() const {
+    switch (kind) {
+    case Boolean:
+      return 1;
+    case Char:
+    case Int8:
+    case UInt8:
+      return 8;
+    case Int16:
+    case UInt16:
+      return 16;
+    case Int32:
+    case UInt32:
+      return 32;
+    case Int64:
+    case UInt64:
+      return 64;
+    case Integer:
+      return IntegerBits;
+    default:
+      return 0;
+    }
+  }
+
+  // Maps a built-in type keyword to its type; Unknown if there is none.
+  static BType fromName(const std::string &n) {
+    static const std::pair<const char *, Kind> names[] = {
+        {"Integer", Integer}, {"Float", Float},   {"Boolean", Boolean},
+        {"Char", Char},       {"String", Char},   {"Void", Void},
+        {"Int8", Int8},       {"Int16", Int16},   {"Int32", Int32},
+        {"Int64", Int64},     {"UInt8", UInt8},   {"UInt16", UInt16},
+        {"UInt32", UInt32},   {"UInt64", UInt64},
+    };
+    for (const auto &entry : names)
+      if (n == entry.first)
+        return entry.second;
+
+    // Vector types: a numeric lane type followed by a power-of-two lane
+    // count, with an `x` in between when the lane name ends in a digit
+    // (Float4, Integer8, Int8x16, UInt32x4).
+    for (const auto &entry : names) {
+      std::string lane = entry.first;
+      if (entry.second <= Char || n.compare(0, lane.size(), lane) != 0)
+        continue;
+      std::string rest = n.substr(lane.size());
+      if (std::isdigit(static_cast<unsigned char>(lane.back()))) {
+        if (rest.empty() || rest[0] != 'x')
+          continue;
+        rest = rest.substr(1);
+      }
+      if (rest.empty() || rest.size() > 2 ||
+          !std::all_of(rest.begin(), rest.end(), ::isdigit))
+        continue;
+      unsigned lanes = std::stoul(rest);
+      if (lanes >= 2 && lanes <= 64 && (lanes & (lanes - 1)) == 0)
+        return vectorOf(entry.second, lanes);
+    }
+    return Unknown;
+  }
+
+  bool operator==(const BType &o) const {
+    if (kind != o.kind || count != o.count || name != o.name)
+      return false;
+    if (!elem || !o.elem)
+      return elem == o.elem;
+    return *elem == *o.elem;
+  }
+  bool operator!=(const BType &o) const { return !(*this == o); }
+
+  std::string str() const {
+    switch (kind) {
+    case Void:
+      return "Void";
+    case Boolean:
+      return "Boolean";
+    case Char:
+      return "Char";
+    case Integer:
+      return "Integer";
+    case Int8:
+      return "Int8";
+    case Int16:
+      return "Int16";
+    case Int32:
+      return "Int32";
+    case Int64:
+      return "Int64";
+    case UInt8:
+      return "UInt8";
+    case UInt16:
+      return "UInt16";
+    case UInt32:
+      return "UInt32";
+    case UInt64:
+      return "UInt64";
+    case Float:
+      return "Float";
+    case Pointer:
+      return elem->str() + "*";
+    case Array:
+      return elem->str() + "[" + std::to_string(count) + "]";
+    case Slice:
+      return elem->str() + "[]";
+    case Vector: {
+      std::string lane = elem->str();
+      return lane + (std::isdigit(static_cast<unsigned char>(lane.back()))
+                         ? "x"
+                         : "") +
+             std::to_string(count);
+    }
+    case Struct:
+      return name;
+    default:
+      return "<unknown>";
+    }
+  }
+};
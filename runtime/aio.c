@@ -0,0 +1,250 @@
+// Asynchronous I/O behind the aio_* builtins. Reads, writes, opens and
+// closes are queued, handed to the kernel as one batch by aio_submit, and
+// collected with aio_poll and aio_wait, so a single thread can keep many
+// requests in flight.
+//
+// Requests go through an io_uring, driven by its system calls directly. If
+// the kernel has no usable io_uring (before 5.6, or one a sandbox blocks),
+// aio_submit runs the batch with plain system calls, in order, and every
+// request is complete when it returns. Either way a request's ticket names
+// it until aio_wait collects the result.
+#include "basiq_rt.h"
+#include "sys.h"
+
+#include <linux/errno.h>
+#include <linux/io_uring.h>
+#include <stddef.h>
+
+#define MAX_REQUESTS 64 // also the submission queue size
+#define MAX_RW_COUNT 0x7ffff000 // the most Linux moves in one read or write
+
+enum { FREE, QUEUED, IN_FLIGHT, DONE };
+
+typedef struct {
+  uint8_t state;
+  uint8_t op; // IORING_OP_*, on the fallback too
+  int32_t fd;
+  char *data;  // the buffer, or the path to open
+  int64_t len; // the byte count, or for an open whether it is for writing
+  int64_t off;
+  int64_t result;
+} request;
+
+static request requests[MAX_REQUESTS];
+static int32_t queue[MAX_REQUESTS]; // tickets not yet submitted, in order
+static int32_t queued;
+
+static enum { UNTRIED, RING, FALLBACK } mode;
+static int32_t ring;
+static struct {
+  uint32_t *sq_head, *sq_tail, *sq_mask, *sq_array;
+  uint32_t *cq_head, *cq_tail, *cq_mask;
+  struct io_uring_sqe *sqes;
+  struct io_uring_cqe *cqes;
+} q;
+
+// Sets up the ring on first use, or settles on the fallback. OPENAT, CLOSE
+// and the plain READ and WRITE came in 5.6, the same release as
+// IORING_FEAT_RW_CUR_POS, which also lets offset -1 mean the file position.
+static void start(void) {
+  mode = FALLBACK;
+  struct io_uring_params p = {0};
+  int32_t fd = sys_ring_setup(MAX_REQUESTS, &p);
+  if (fd < 0)
+    return;
+  uint32_t need = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_RW_CUR_POS;
+  int64_t sq_len = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+  int64_t cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  int64_t rings_len = sq_len > cq_len ? sq_len : cq_len;
+  char *rings = (p.features & need) == need
+                    ? sys_map_ring(fd, rings_len, IORING_OFF_SQ_RING)
+                    : NULL;
+  char *sqes = rings ? sys_map_ring(fd,
+                                    p.sq_entries * sizeof(struct io_uring_sqe),
+                                    IORING_OFF_SQES)
+                     : NULL;
+  if (!sqes) {
+    if (rings)
+      sys_unmap(rings, rings_len);
+    sys_close(fd);
+    return;
+  }
+
+  q.sq_head = (uint32_t *)(rings + p.sq_off.head);
+  q.sq_tail = (uint32_t *)(rings + p.sq_off.tail);
+  q.sq_mask = (uint32_t *)(rings + p.sq_off.ring_mask);
+  q.sq_array = (uint32_t *)(rings + p.sq_off.array);
+  q.cq_head = (uint32_t *)(rings + p.cq_off.head);
+  q.cq_tail = (uint32_t *)(rings + p.cq_off.tail);
+  q.cq_mask = (uint32_t *)(rings + p.cq_off.ring_mask);
+  q.cqes = (struct io_uring_cqe *)(rings + p.cq_off.cqes);
+  q.sqes = (struct io_uring_sqe *)sqes;
+  ring = fd;
+  mode = RING;
+}
+
+static int32_t enqueue(uint8_t op, int32_t fd, char *data, int64_t len,
+                       int64_t off) {
+  if (mode == UNTRIED)
+    start();
+  for (int32_t t = 0; t < MAX_REQUESTS; ++t)
+    if (requests[t].state == FREE) {
+      requests[t] = (request){QUEUED, op, fd, data, len, off, 0};
+      queue[queued++] = t;
+      return t;
+    }
+  return -1;
+}
+
+static int64_t rw_count(int64_t n) {
+  return n < 0 ? 0 : n > MAX_RW_COUNT ? MAX_RW_COUNT : n;
+}
+
+int32_t basiq_aio_read(int32_t fd, char *data, int64_t len, int64_t off) {
+  return enqueue(IORING_OP_READ, fd, data, rw_count(len), off);
+}
+
+int32_t basiq_aio_write(int32_t fd, const char *data, int64_t len,
+                        int64_t off) {
+  return enqueue(IORING_OP_WRITE, fd, (char *)data, rw_count(len), off);
+}
+
+int32_t basiq_aio_open(const char *path, int32_t writable) {
+  return enqueue(IORING_OP_OPENAT, -1, (char *)path, writable != 0, 0);
+}
+
+int32_t basiq_aio_close(int32_t fd) {
+  return enqueue(IORING_OP_CLOSE, fd, NULL, 0, 0);
+}
+
+static void prepare(struct io_uring_sqe *sqe, int32_t t) {
+  const request *r = &requests[t];
+  *sqe = (struct io_uring_sqe){0};
+  sqe->opcode = r->op;
+  sqe->fd = r->fd;
+  sqe->user_data = (uint64_t)t;
+  if (r->op == IORING_OP_OPENAT) {
+    sqe->fd = -100; // AT_FDCWD
+    sqe->addr = (uint64_t)(uintptr_t)r->data;
+    sqe->open_flags = (uint32_t)sys_open_flags((int)r->len);
+    sqe->len = 0644;
+  } else if (r->op != IORING_OP_CLOSE) {
+    sqe->addr = (uint64_t)(uintptr_t)r->data;
+    sqe->len = (uint32_t)r->len;
+    sqe->off = (uint64_t)r->off;
+  }
+}
+
+// The fallback: what the kernel would have done with the request.
+static void run(request *r) {
+  switch (r->op) {
+  case IORING_OP_READ:
+    r->result = sys_read_at(r->fd, r->data, r->len, r->off);
+    break;
+  case IORING_OP_WRITE:
+    r->result = sys_write_at(r->fd, r->data, r->len, r->off);
+    break;
+  case IORING_OP_OPENAT:
+    r->result = sys_open(r->data, (int)r->len);
+    break;
+  default:
+    r->result = sys_close(r->fd);
+    break;
+  }
+  r->state = DONE;
+}
+
+// Hands the kernel whatever it has not yet taken from the submission queue
+// and, with wait, blocks until a completion is posted. Returns 0, or
+// -errno if io_uring_enter failed other than by being interrupted.
+static int64_t enter(int wait) {
+  uint32_t pending =
+      *q.sq_tail - __atomic_load_n(q.sq_head, __ATOMIC_ACQUIRE);
+  int64_t ret;
+  do
+    ret = sys_ring_enter(ring, pending, wait ? 1 : 0,
+                         wait ? IORING_ENTER_GETEVENTS : 0);
+  while (ret == -EINTR);
+  return ret < 0 ? ret : 0;
+}
+
+// Records every completion the kernel has posted.
+static void reap(void) {
+  uint32_t head = *q.cq_head;
+  uint32_t tail = __atomic_load_n(q.cq_tail, __ATOMIC_ACQUIRE);
+  for (; head != tail; ++head) {
+    const struct io_uring_cqe *c = &q.cqes[head & *q.cq_mask];
+    requests[c->user_data].result = c->res;
+    requests[c->user_data].state = DONE;
+  }
+  __atomic_store_n(q.cq_head, head, __ATOMIC_RELEASE);
+}
+
+// Moves to the fallback once io_uring_enter fails (a seccomp filter that
+// allows setup but not enter, say), rather than retrying forever. Requests
+// the kernel never took run now; those it took but has not completed
+// cannot be waited for any more and fail with the error.
+static void abandon_ring(int64_t error) {
+  reap();
+  uint32_t head = __atomic_load_n(q.sq_head, __ATOMIC_ACQUIRE);
+  for (; head != *q.sq_tail; ++head) {
+    uint32_t slot = q.sq_array[head & *q.sq_mask];
+    run(&requests[q.sqes[slot].user_data]);
+  }
+  for (int32_t t = 0; t < MAX_REQUESTS; ++t)
+    if (requests[t].state == IN_FLIGHT) {
+      requests[t].result = error;
+      requests[t].state = DONE;
+    }
+  mode = FALLBACK;
+}
+
+int32_t basiq_aio_submit(void) {
+  int32_t n = queued;
+  queued = 0;
+  if (mode != RING) {
+    for (int32_t i = 0; i < n; ++i)
+      run(&requests[queue[i]]);
+    return n;
+  }
+  // At most MAX_REQUESTS tickets exist, so the queue always has room.
+  uint32_t tail = *q.sq_tail;
+  for (int32_t i = 0; i < n; ++i, ++tail) {
+    uint32_t slot = tail & *q.sq_mask;
+    prepare(&q.sqes[slot], queue[i]);
+    q.sq_array[slot] = slot;
+    requests[queue[i]].state = IN_FLIGHT;
+  }
+  __atomic_store_n(q.sq_tail, tail, __ATOMIC_RELEASE);
+  int64_t error = enter(0);
+  if (error < 0)
+    abandon_ring(error);
+  return n;
+}
+
+int32_t basiq_aio_poll(void) {
+  if (mode == RING)
+    reap();
+  for (int32_t t = 0; t < MAX_REQUESTS; ++t)
+    if (requests[t].state == DONE)
+      return t;
+  return -1;
+}
+
+int64_t basiq_aio_wait(int32_t ticket) {
+  if (ticket < 0 || ticket >= MAX_REQUESTS || requests[ticket].state == FREE)
+    return -EINVAL;
+  request *r = &requests[ticket];
+  if (r->state == QUEUED)
+    basiq_aio_submit();
+  if (mode == RING)
+    for (reap(); r->state != DONE; reap()) {
+      int64_t error = enter(1);
+      if (error < 0) {
+        abandon_ring(error);
+        break;
+      }
+    }
+  r->state = FREE;
+  return r->result;
+}
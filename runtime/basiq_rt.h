@@ -0,0 +1,127 @@
+#pragma once
+// Runtime support linked into every compiled BASIQ program (libbasiq_rt.a
+// and libbasiq.bc).
+// The compiler emits calls to these by name, so the signatures here are the
+// ABI and must match what src/codegen.cpp declares.
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Body of a `parallel for`, outlined by the compiler. Runs iterations
+// [lo, hi) of the loop; env carries the captured variables.
+typedef void (*basiq_loop_body)(void *env, int64_t lo, int64_t hi);
+
+enum basiq_schedule {
+  // Each thread runs one contiguous block, or with a chunk size, every
+  // nthreads-th chunk. No balancing; lowest overhead for uniform work.
+  BASIQ_SCHEDULE_STATIC = 0,
+  // Each thread starts on its own block and takes it a chunk at a time;
+  // threads that run out steal half of another thread's remaining block.
+  BASIQ_SCHEDULE_DYNAMIC = 1,
+};
+
+// Runs body over iterations [0, count) on the thread pool and returns once
+// all of them are done. chunk 0 picks a default for the schedule. Calls made
+// from inside a loop body run serially on the calling thread.
+//
+// The pool has one thread per online CPU, or BASIQ_THREADS if set, and is
+// started on first use.
+void basiq_parallel_for(int64_t count, int32_t schedule, int64_t chunk,
+                        basiq_loop_body body, void *env);
+
+// Buffered output (runtime/io.c), behind the write, flush and setbuf
+// builtins. fds 0-15 are buffered; others are written straight through.
+enum basiq_buffering {
+  BASIQ_BUFFER_NONE = 0, // every write is a write(2)
+  BASIQ_BUFFER_LINE = 1, // flushed after a write containing a newline
+  BASIQ_BUFFER_FULL = 2, // flushed only when full
+};
+
+// Appends len bytes to fd's buffer. Everything still buffered is written
+// at exit.
+void basiq_write(int32_t fd, const char *data, int64_t len);
+// Returns room for n bytes at the end of fd's buffer, locked until
+// basiq_commit appends the first len of them. For formatting straight into
+// the buffer; NULL (and nothing locked) when fd is not buffered or n is
+// more than a buffer holds.
+char *basiq_reserve(int32_t fd, int64_t n);
+void basiq_commit(int32_t fd, int64_t len);
+void basiq_flush(int32_t fd);
+void basiq_flush_all(void);
+// Flushes fd, then switches it to mode. By default stdout is line buffered
+// on a terminal and fully buffered otherwise, and stderr is line buffered.
+void basiq_set_buffering(int32_t fd, int32_t mode);
+
+// Memory-mapped files (runtime/file.c), behind the map_file, unmap_file,
+// advise, create_file, append_file and close_file builtins.
+enum basiq_advice { // madvise hints, with Linux's values
+  BASIQ_ADVISE_NORMAL = 0,
+  BASIQ_ADVISE_RANDOM = 1,
+  BASIQ_ADVISE_SEQUENTIAL = 2, // the default for map_file
+  BASIQ_ADVISE_WILLNEED = 3,
+  BASIQ_ADVISE_DONTNEED = 4,
+};
+
+// Maps path read-only and stores its length, or returns NULL with length 0
+// if it cannot be opened or is empty.
+const char *basiq_map_file(const char *path, int64_t *len);
+void basiq_unmap_file(const char *data, int64_t len);
+void basiq_advise(const char *data, int64_t len, int32_t advice);
+// Output files are built by appending into a mapping of the file. Returns
+// a handle, or -1. Up to 16 files can be open at once; each is for one
+// thread at a time.
+int32_t basiq_create_file(const char *path);
+void basiq_append_file(int32_t file, const char *data, int64_t len);
+// Returns the file's length, or -1 if it could not be written in full.
+int64_t basiq_close_file(int32_t file);
+
+// Asynchronous I/O (runtime/aio.c), behind the aio_* builtins, through an
+// io_uring or, without one, plain system calls at submit time. Queuing a
+// request returns its ticket, or -1 when all 64 are taken; nothing starts
+// until basiq_aio_submit. An offset of -1 reads or writes at the file
+// position. Buffers and paths must stay valid until the request is
+// collected. For one thread at a time.
+int32_t basiq_aio_read(int32_t fd, char *data, int64_t len, int64_t off);
+int32_t basiq_aio_write(int32_t fd, const char *data, int64_t len,
+                        int64_t off);
+// Opens path read-only, or for writing: created or truncated.
+int32_t basiq_aio_open(const char *path, int32_t writable);
+int32_t basiq_aio_close(int32_t fd);
+// Submits everything queued in one system call; returns how many requests.
+int32_t basiq_aio_submit(void);
+// Returns the ticket of a completed request not yet collected, or -1,
+// without blocking.
+int32_t basiq_aio_poll(void);
+// Blocks until the request is complete, then frees its ticket and returns
+// the result: a byte count, the opened fd, 0 for a close, or -errno.
+int64_t basiq_aio_wait(int32_t ticket);
+
+// Standard library. BASIQ calls these without the basiq_ prefix; sema's
+// library table holds the matching BASIQ signatures.
+//
+// runtime/stdlib.c is shipped as libbasiq.bc rather than in this archive,
+// and linked into the program's module before optimization. itoa and ftoa
+// NUL-terminate and return the length written; ftoa prints the shortest
+// decimal that reads back as x.
+int64_t basiq_itoa(int64_t n, char *str);
+int64_t basiq_ftoa(float x, char *str);
+// %d %u %x take any integer, %f a Float, %s a NUL-terminated Char*, %c a
+// Char; %% is a literal %.
+void basiq_printf(const char *fmt, ...);
+
+// runtime/string.c, with SSE2 and AVX2 kernels picked at startup. Strings
+// are NUL-terminated; searches return an index, or -1 if there is no match.
+int64_t basiq_strlen(const char *s);
+int32_t basiq_strcmp(const char *a, const char *b);
+int64_t basiq_memchr(const char *s, int32_t c, int64_t n);
+int64_t basiq_strstr(const char *h, const char *needle);
+int64_t basiq_strcpy(char *dst, const char *src); // returns strlen(src)
+void basiq_string_concat(char *a, const char *b);
+void basiq_to_upper(char *s);
+void basiq_to_lower(char *s);
+
+#ifdef __cplusplus
+}
+#endif
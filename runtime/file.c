@@ -0,0 +1,132 @@
+// Memory-mapped files behind the map_file, advise and unmap_file builtins,
+// and the create_file / append_file / close_file builder.
+//
+// map_file maps a whole file read-only, so a program scans it in place with
+// no read calls or copies; the descriptor is closed at once, as the mapping
+// keeps the file open. A built file is a shared writable mapping that bytes
+// are appended into. When it fills, the file is extended to twice the size
+// and mapped again; close_file trims it to the bytes appended.
+#include "basiq_rt.h"
+#include "sys.h"
+
+#include <stdatomic.h>
+#include <string.h>
+
+#define MAX_BUILDERS 16
+#define INITIAL_SIZE (1 << 20)
+
+typedef struct {
+  int open;
+  int failed; // an append could not grow the file; close_file reports it
+  int32_t fd;
+  char *data;
+  int64_t size, used;
+} file_builder;
+
+static file_builder builders[MAX_BUILDERS];
+static atomic_flag builders_lock = ATOMIC_FLAG_INIT;
+
+const char *basiq_map_file(const char *path, int64_t *len) {
+  *len = 0;
+  int32_t fd = sys_open(path, 0);
+  if (fd < 0)
+    return NULL;
+  int64_t size = sys_file_size(fd);
+  char *data = size > 0 ? sys_map(fd, size, 0) : NULL;
+  sys_close(fd);
+  if (!data)
+    return NULL;
+  sys_advise(data, size, BASIQ_ADVISE_SEQUENTIAL);
+  *len = size;
+  return data;
+}
+
+void basiq_unmap_file(const char *data, int64_t len) {
+  if (data && len > 0)
+    sys_unmap((void *)data, len);
+}
+
+void basiq_advise(const char *data, int64_t len, int32_t advice) {
+  if (!data || len <= 0)
+    return;
+  // madvise takes whole pages.
+  uintptr_t start = (uintptr_t)data & ~(uintptr_t)(sys_page_size() - 1);
+  sys_advise((void *)start, (int64_t)((uintptr_t)data + len - start), advice);
+}
+
+int32_t basiq_create_file(const char *path) {
+  while (atomic_flag_test_and_set_explicit(&builders_lock,
+                                           memory_order_acquire))
+    ;
+  int32_t slot = 0;
+  while (slot < MAX_BUILDERS && builders[slot].open)
+    ++slot;
+  if (slot < MAX_BUILDERS)
+    builders[slot].open = 1;
+  atomic_flag_clear_explicit(&builders_lock, memory_order_release);
+  if (slot == MAX_BUILDERS)
+    return -1;
+
+  file_builder *b = &builders[slot];
+  b->fd = sys_open(path, 1);
+  b->data = NULL;
+  if (b->fd >= 0 && sys_truncate(b->fd, INITIAL_SIZE) == 0)
+    b->data = sys_map(b->fd, INITIAL_SIZE, 1);
+  if (!b->data) {
+    if (b->fd >= 0)
+      sys_close(b->fd);
+    b->open = 0;
+    return -1;
+  }
+  b->failed = 0;
+  b->size = INITIAL_SIZE;
+  b->used = 0;
+  return slot;
+}
+
+static file_builder *builder(int32_t file) {
+  if (file < 0 || file >= MAX_BUILDERS || !builders[file].open)
+    return NULL;
+  return &builders[file];
+}
+
+// The file is extended before the new mapping is made, and the old one is
+// only dropped once that has worked, so a failure loses nothing appended.
+static int grow(file_builder *b, int64_t needed) {
+  int64_t size = b->size;
+  while (size < needed)
+    size *= 2;
+  if (sys_truncate(b->fd, size) != 0)
+    return 0;
+  char *data = sys_map(b->fd, size, 1);
+  if (!data)
+    return 0;
+  sys_unmap(b->data, b->size);
+  b->data = data;
+  b->size = size;
+  return 1;
+}
+
+void basiq_append_file(int32_t file, const char *data, int64_t len) {
+  file_builder *b = builder(file);
+  if (!b || b->failed || len <= 0)
+    return;
+  if (b->used + len > b->size && !grow(b, b->used + len)) {
+    b->failed = 1;
+    return;
+  }
+  memcpy(b->data + b->used, data, (size_t)len);
+  b->used += len;
+}
+
+int64_t basiq_close_file(int32_t file) {
+  file_builder *b = builder(file);
+  if (!b)
+    return -1;
+  sys_unmap(b->data, b->size);
+  int ok = !b->failed && sys_truncate(b->fd, b->used) == 0;
+  sys_close(b->fd);
+  int64_t used = b->used;
+  b->open = 0;
+  return ok ? used : -1;
+}
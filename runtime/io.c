@@ -0,0 +1,135 @@
+// Buffered output behind the write, flush and setbuf builtins.
+//
+// Each low-numbered fd has its own buffer. Bytes are copied in and leave in
+// a single write(2) when the buffer fills, at a newline in line mode, on
+// flush, and at exit. Writes at least a buffer long skip the copy.
+#include "basiq_rt.h"
+#include "sys.h"
+
+#include <stdatomic.h>
+#include <string.h>
+
+#define BUFFERED_FDS 16
+#define BUFFER_SIZE (64 * 1024)
+
+typedef struct {
+  atomic_flag lock; // loop bodies may print from several threads
+  int configured;   // mode has been chosen
+  int32_t mode;
+  int64_t used;
+  char data[BUFFER_SIZE];
+} out_buffer;
+
+static out_buffer buffers[BUFFERED_FDS];
+
+// Output errors are dropped, as with an unchecked printf.
+static void write_all(int32_t fd, const char *p, int64_t n) {
+  while (n > 0) {
+    int64_t done = sys_write(fd, p, n);
+    if (done < 0)
+      return;
+    p += done;
+    n -= done;
+  }
+}
+
+static void drain(int32_t fd, out_buffer *b) {
+  write_all(fd, b->data, b->used);
+  b->used = 0;
+}
+
+// Locks fd's buffer, picking its mode on first use: stdout is line buffered
+// on a terminal and fully buffered otherwise, stderr is line buffered, and
+// anything else is fully buffered.
+static out_buffer *acquire(int32_t fd) {
+  out_buffer *b = &buffers[fd];
+  while (atomic_flag_test_and_set_explicit(&b->lock, memory_order_acquire))
+    ;
+  if (!b->configured) {
+    b->configured = 1;
+    if (fd == 2 || (fd == 1 && sys_is_terminal(1)))
+      b->mode = BASIQ_BUFFER_LINE;
+    else
+      b->mode = BASIQ_BUFFER_FULL;
+  }
+  return b;
+}
+
+static void release(out_buffer *b) {
+  atomic_flag_clear_explicit(&b->lock, memory_order_release);
+}
+
+void basiq_write(int32_t fd, const char *data, int64_t len) {
+  if (len <= 0)
+    return;
+  if (fd < 0 || fd >= BUFFERED_FDS) {
+    write_all(fd, data, len);
+    return;
+  }
+
+  out_buffer *b = acquire(fd);
+  if (b->mode == BASIQ_BUFFER_NONE) {
+    write_all(fd, data, len);
+  } else {
+    if (b->used + len > BUFFER_SIZE)
+      drain(fd, b);
+    if (len >= BUFFER_SIZE) {
+      write_all(fd, data, len);
+    } else {
+      memcpy(b->data + b->used, data, (size_t)len);
+      b->used += len;
+    }
+    if (b->mode == BASIQ_BUFFER_LINE && basiq_memchr(data, '\n', len) >= 0)
+      drain(fd, b);
+  }
+  release(b);
+}
+
+char *basiq_reserve(int32_t fd, int64_t n) {
+  if (fd < 0 || fd >= BUFFERED_FDS || n > BUFFER_SIZE)
+    return NULL;
+  out_buffer *b = acquire(fd);
+  if (b->used + n > BUFFER_SIZE)
+    drain(fd, b);
+  return b->data + b->used;
+}
+
+void basiq_commit(int32_t fd, int64_t n) {
+  out_buffer *b = &buffers[fd];
+  const char *added = b->data + b->used;
+  b->used += n;
+  if (b->mode == BASIQ_BUFFER_NONE ||
+      (b->mode == BASIQ_BUFFER_LINE && basiq_memchr(added, '\n', n) >= 0))
+    drain(fd, b);
+  release(b);
+}
+
+void basiq_flush(int32_t fd) {
+  if (fd < 0 || fd >= BUFFERED_FDS)
+    return;
+  out_buffer *b = acquire(fd);
+  drain(fd, b);
+  release(b);
+}
+
+void basiq_set_buffering(int32_t fd, int32_t mode) {
+  if (fd < 0 || fd >= BUFFERED_FDS)
+    return;
+  out_buffer *b = acquire(fd);
+  drain(fd, b);
+  b->mode = mode;
+  release(b);
+}
+
+void basiq_flush_all(void) {
+  for (int32_t fd = 0; fd < BUFFERED_FDS; ++fd)
+    if (buffers[fd].used)
+      basiq_flush(fd);
+}
+
+// Runs when main returns or exit() is called. A program that ends with a
+// raw exit syscall skips it and must flush first. --freestanding programs
+// never run destructors; their _start calls basiq_flush_all instead.
+__attribute__((destructor)) static void flush_at_exit(void) {
+  basiq_flush_all();
+}
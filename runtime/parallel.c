@@ -0,0 +1,214 @@
+// Thread pool behind `parallel for`.
+//
+// Workers sleep on a condition variable between loops. Starting a loop
+// publishes it and bumps a generation counter; the caller then works as
+// thread 0 and waits for the others to check back in. Dynamic loops keep one
+// range of iterations per thread, and a thread whose range runs dry steals
+// the back half of someone else's.
+#include "basiq_rt.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define MAX_THREADS 256
+// Dynamic chunks default to this fraction of a thread's initial block, so
+// there is something left to steal when the work is uneven.
+#define DYNAMIC_SPLIT 8
+
+// Iterations a thread still owns. Padded to a cache line so owners taking
+// chunks off the front do not contend with each other.
+typedef struct {
+  _Alignas(64) pthread_mutex_t lock;
+  int64_t lo, hi;
+} work_range;
+
+static struct {
+  int nthreads; // including the thread that starts a loop
+
+  pthread_mutex_t mu;
+  pthread_cond_t wake;
+  pthread_cond_t done;
+  unsigned long generation;
+  int busy; // workers that have not finished the current loop
+
+  // Serialises loops started from different threads.
+  pthread_mutex_t start;
+
+  // The current loop.
+  basiq_loop_body body;
+  void *env;
+  int64_t count;
+  int64_t chunk;
+  int32_t schedule;
+  work_range ranges[MAX_THREADS];
+} pool;
+
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+static _Thread_local int in_loop;
+
+static int64_t min64(int64_t a, int64_t b) { return a < b ? a : b; }
+
+static void run_static(int self) {
+  int64_t n = pool.nthreads;
+  if (!pool.chunk) {
+    int64_t lo = pool.count * self / n;
+    int64_t hi = pool.count * (self + 1) / n;
+    if (lo < hi)
+      pool.body(pool.env, lo, hi);
+    return;
+  }
+  for (int64_t lo = self * pool.chunk; lo < pool.count;
+       lo += n * pool.chunk)
+    pool.body(pool.env, lo, min64(lo + pool.chunk, pool.count));
+}
+
+// Moves the back half of some other thread's range into ours. Returns 0 once
+// every range is empty.
+static int steal(int self) {
+  for (int i = 1; i < pool.nthreads; ++i) {
+    work_range *victim = &pool.ranges[(self + i) % pool.nthreads];
+    pthread_mutex_lock(&victim->lock);
+    int64_t left = victim->hi - victim->lo;
+    int64_t lo = victim->hi - (left + 1) / 2;
+    int64_t hi = victim->hi;
+    if (left > 0)
+      victim->hi = lo;
+    pthread_mutex_unlock(&victim->lock);
+
+    if (left > 0) {
+      work_range *own = &pool.ranges[self];
+      pthread_mutex_lock(&own->lock);
+      own->lo = lo;
+      own->hi = hi;
+      pthread_mutex_unlock(&own->lock);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void run_dynamic(int self) {
+  work_range *own = &pool.ranges[self];
+  int64_t chunk = pool.chunk;
+  if (!chunk) {
+    chunk = pool.count / ((int64_t)pool.nthreads * DYNAMIC_SPLIT);
+    if (chunk < 1)
+      chunk = 1;
+  }
+
+  for (;;) {
+    pthread_mutex_lock(&own->lock);
+    int64_t lo = own->lo;
+    int64_t hi = min64(lo + chunk, own->hi);
+    own->lo = hi;
+    pthread_mutex_unlock(&own->lock);
+
+    if (lo < hi)
+      pool.body(pool.env, lo, hi);
+    else if (!steal(self))
+      return;
+  }
+}
+
+static void run_share(int self) {
+  if (pool.schedule == BASIQ_SCHEDULE_DYNAMIC)
+    run_dynamic(self);
+  else
+    run_static(self);
+}
+
+static void *worker_main(void *arg) {
+  int self = (int)(intptr_t)arg;
+  unsigned long seen = 0;
+  in_loop = 1;
+
+  for (;;) {
+    pthread_mutex_lock(&pool.mu);
+    while (pool.generation == seen)
+      pthread_cond_wait(&pool.wake, &pool.mu);
+    seen = pool.generation;
+    pthread_mutex_unlock(&pool.mu);
+
+    run_share(self);
+
+    pthread_mutex_lock(&pool.mu);
+    if (--pool.busy == 0)
+      pthread_cond_signal(&pool.done);
+    pthread_mutex_unlock(&pool.mu);
+  }
+  return NULL;
+}
+
+static void pool_init(void) {
+  long n = 0;
+  const char *env = getenv("BASIQ_THREADS");
+  if (env)
+    n = strtol(env, NULL, 10);
+  if (n <= 0)
+    n = sysconf(_SC_NPROCESSORS_ONLN);
+  if (n < 1)
+    n = 1;
+  if (n > MAX_THREADS)
+    n = MAX_THREADS;
+
+  pthread_mutex_init(&pool.mu, NULL);
+  pthread_cond_init(&pool.wake, NULL);
+  pthread_cond_init(&pool.done, NULL);
+  pthread_mutex_init(&pool.start, NULL);
+  for (int i = 0; i < MAX_THREADS; ++i)
+    pthread_mutex_init(&pool.ranges[i].lock, NULL);
+
+  // If a thread cannot be created, run with the ones we have.
+  pool.nthreads = 1;
+  for (long i = 1; i < n; ++i) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, worker_main, (void *)(intptr_t)i))
+      break;
+    pthread_detach(thread);
+    pool.nthreads++;
+  }
+}
+
+void basiq_parallel_for(int64_t count, int32_t schedule, int64_t chunk,
+                        basiq_loop_body body, void *env) {
+  if (count <= 0)
+    return;
+  pthread_once(&pool_once, pool_init);
+  if (in_loop || pool.nthreads == 1 || count == 1) {
+    body(env, 0, count);
+    return;
+  }
+
+  pthread_mutex_lock(&pool.start);
+  pool.body = body;
+  pool.env = env;
+  pool.count = count;
+  pool.chunk = chunk > 0 ? chunk : 0;
+  pool.schedule = schedule;
+  if (schedule == BASIQ_SCHEDULE_DYNAMIC) {
+    // Workers are asleep until the generation changes, so no locking yet.
+    int64_t n = pool.nthreads;
+    for (int64_t i = 0; i < n; ++i) {
+      pool.ranges[i].lo = count * i / n;
+      pool.ranges[i].hi = count * (i + 1) / n;
+    }
+  }
+
+  pthread_mutex_lock(&pool.mu);
+  pool.busy = pool.nthreads - 1;
+  pool.generation++;
+  pthread_cond_broadcast(&pool.wake);
+  pthread_mutex_unlock(&pool.mu);
+
+  in_loop = 1;
+  run_share(0);
+  in_loop = 0;
+
+  pthread_mutex_lock(&pool.mu);
+  while (pool.busy)
+    pthread_cond_wait(&pool.done, &pool.mu);
+  pthread_mutex_unlock(&pool.mu);
+
+  pthread_mutex_unlock(&pool.start);
+}
@@ -0,0 +1,84 @@
+// Process entry for --freestanding programs, which are linked statically
+// with no libc (x86-64 Linux only).
+//
+// The kernel enters _start with argc, argv and envp on the stack. We run the
+// constructors (string.c picks its kernels in one), call main, flush
+// buffered output and leave through exit_group; nothing registered with
+// atexit or as a destructor runs. The mem* functions LLVM and the C compiler
+// may emit calls to are defined here too.
+#include "basiq_rt.h"
+
+#include <stddef.h>
+
+int main(int argc, char **argv, char **envp);
+
+// Bounds of .init_array, provided by the linker in a static link.
+typedef void (*init_fn)(int argc, char **argv, char **envp);
+extern const init_fn __init_array_start[] __attribute__((weak));
+extern const init_fn __init_array_end[] __attribute__((weak));
+
+__attribute__((noreturn)) static void exit_group(int64_t status) {
+  for (;;)
+    __asm__ volatile("syscall"
+                     :
+                     : "a"(231), "D"(status)
+                     : "rcx", "r11", "memory");
+}
+
+// Called by _start with the stack pointer the kernel handed over.
+__attribute__((noreturn, used)) void basiq_start_main(int64_t *sp) {
+  int argc = (int)sp[0];
+  char **argv = (char **)(sp + 1);
+  char **envp = argv + argc + 1;
+  for (const init_fn *f = __init_array_start; f < __init_array_end; ++f)
+    (*f)(argc, argv, envp);
+  int status = main(argc, argv, envp);
+  basiq_flush_all();
+  exit_group(status);
+}
+
+// Clears the frame pointer so unwinders stop here, and aligns the stack to
+// 16 bytes for the call.
+__asm__(".text\n"
+        ".global _start\n"
+        ".type _start, @function\n"
+        "_start:\n"
+        "  xor %ebp, %ebp\n"
+        "  mov %rsp, %rdi\n"
+        "  and $-16, %rsp\n"
+        "  call basiq_start_main\n"
+        "  hlt\n");
+
+void *memcpy(void *dst, const void *src, size_t n) {
+  void *ret = dst;
+  __asm__ volatile("rep movsb" : "+D"(dst), "+S"(src), "+c"(n) : : "memory");
+  return ret;
+}
+
+void *memmove(void *dst, const void *src, size_t n) {
+  if ((uintptr_t)dst - (uintptr_t)src >= n)
+    return memcpy(dst, src, n); // no overlap, or dst below src
+  // Copy backwards from the last byte.
+  void *ret = dst;
+  const char *s = (const char *)src + n - 1;
+  char *d = (char *)dst + n - 1;
+  __asm__ volatile("std\n\trep movsb\n\tcld"
+                   : "+D"(d), "+S"(s), "+c"(n)
+                   :
+                   : "memory");
+  return ret;
+}
+
+void *memset(void *dst, int c, size_t n) {
+  void *ret = dst;
+  __asm__ volatile("rep stosb" : "+D"(dst), "+c"(n) : "a"(c) : "memory");
+  return ret;
+}
+
+int memcmp(const void *a, const void *b, size_t n) {
+  const unsigned char *x = a, *y = b;
+  for (size_t i = 0; i < n; ++i)
+    if (x[i] != y[i])
+      return x[i] - y[i];
+  return 0;
+}
@@ -0,0 +1,362 @@
+// The BASIQ standard library: number formatting (itoa, ftoa) and printf.
+// The string functions are native code in runtime/string.c.
+//
+// This file is compiled to LLVM bitcode (libbasiq.bc), not into basiq_rt.
+// The compiler links the functions a program calls into its module before
+// optimizing, so they inline into their callers like BASIQ code would. The
+// compiler calls them by their basiq_ names; the BASIQ-level signatures are
+// in sema's library table and must match these.
+#include "basiq_rt.h"
+#include "ryu_tables.h"
+
+#include <stdarg.h>
+
+// Longest text one number formats to: a float in fixed notation, with a
+// sign and 21 digits before the point.
+#define NUMBER_MAX 24
+
+static const char digit_pairs[201] = "00010203040506070809"
+                                     "10111213141516171819"
+                                     "20212223242526272829"
+                                     "30313233343536373839"
+                                     "40414243444546474849"
+                                     "50515253545556575859"
+                                     "60616263646566676869"
+                                     "70717273747576777879"
+                                     "80818283848586878889"
+                                     "90919293949596979899";
+
+static int decimal_length(uint64_t v) {
+  int n = 1;
+  for (;;) {
+    if (v < 10)
+      return n;
+    if (v < 100)
+      return n + 1;
+    if (v < 1000)
+      return n + 2;
+    if (v < 10000)
+      return n + 3;
+    v /= 10000;
+    n += 4;
+  }
+}
+
+// Writes the len digits of v, as decimal_length counted them, back to front
+// two at a time, so they land in order with nothing to reverse.
+static void put_digits(char *out, uint64_t v, int len) {
+  char *p = out + len;
+  while (v >= 100) {
+    const char *pair = &digit_pairs[(v % 100) * 2];
+    v /= 100;
+    *--p = pair[1];
+    *--p = pair[0];
+  }
+  if (v >= 10) {
+    *--p = digit_pairs[v * 2 + 1];
+    *--p = digit_pairs[v * 2];
+  } else {
+    *--p = (char)('0' + v);
+  }
+}
+
+static int64_t format_unsigned(char *out, uint64_t v) {
+  int len = decimal_length(v);
+  put_digits(out, v, len);
+  return len;
+}
+
+static int64_t format_signed(char *out, int64_t v) {
+  // The magnitude is taken as unsigned so the most negative value works too.
+  if (v >= 0)
+    return format_unsigned(out, (uint64_t)v);
+  *out = '-';
+  return 1 + format_unsigned(out + 1, 0 - (uint64_t)v);
+}
+
+static int64_t format_hex(char *out, uint64_t v) {
+  int len = (64 - __builtin_clzll(v | 1) + 3) / 4;
+  for (int i = len - 1; i >= 0; --i, v >>= 4)
+    out[i] = "0123456789abcdef"[v & 15];
+  return len;
+}
+
+// --- Shortest round-trip float to decimal, after Ryu (Adams, PLDI 2018) ---
+//
+// Finds the decimal with the fewest digits that still reads back as the same
+// float, with one 32x64-bit multiply per bound instead of big integers.
+
+// Bit length of 5^e, for 0 <= e <= 3528.
+static int32_t pow5bits(int32_t e) {
+  return (int32_t)(((uint32_t)e * 1217359) >> 19) + 1;
+}
+
+// floor(log10(2^e)) and floor(log10(5^e)), for 0 <= e <= 1650.
+static uint32_t log10_pow2(int32_t e) { return ((uint32_t)e * 78913) >> 18; }
+static uint32_t log10_pow5(int32_t e) { return ((uint32_t)e * 732923) >> 20; }
+
+static int multiple_of_pow5(uint32_t v, uint32_t p) {
+  uint32_t count = 0;
+  for (; v % 5 == 0; v /= 5)
+    ++count;
+  return count >= p;
+}
+
+static int multiple_of_pow2(uint32_t v, uint32_t p) {
+  return (v & ((1u << p) - 1)) == 0;
+}
+
+static uint32_t mul_shift(uint32_t m, uint64_t factor, int32_t shift) {
+  return (uint32_t)(((unsigned __int128)m * factor) >> shift);
+}
+
+typedef struct {
+  uint32_t digits;
+  int32_t exponent; // value = digits * 10^exponent
+} float_decimal;
+
+static float_decimal shortest_decimal(uint32_t mantissa, uint32_t exponent) {
+  int32_t e2;
+  uint32_t m2;
+  if (exponent == 0) {
+    e2 = 1 - 127 - 23 - 2;
+    m2 = mantissa;
+  } else {
+    e2 = (int32_t)exponent - 127 - 23 - 2;
+    m2 = (1u << 23) | mantissa;
+  }
+  int accept_bounds = (m2 & 1) == 0; // round-half-even reads ties back here
+
+  // The value and the midpoints to its neighbours, times 4 (e2 has 2 off).
+  // The lower gap is half as wide at a power of two.
+  uint32_t mv = 4 * m2;
+  uint32_t mp = 4 * m2 + 2;
+  uint32_t mm_shift = mantissa != 0 || exponent <= 1;
+  uint32_t mm = 4 * m2 - 1 - mm_shift;
+
+  // Scale all three to a decimal exponent e10, tracking whether the digits
+  // dropped by the scaling were all zero.
+  uint32_t vr, vp, vm;
+  int32_t e10;
+  int vm_trailing_zeros = 0, vr_trailing_zeros = 0;
+  uint32_t last_removed = 0;
+  if (e2 >= 0) {
+    uint32_t q = log10_pow2(e2);
+    e10 = (int32_t)q;
+    int32_t k = FLOAT_POW5_INV_BITCOUNT + pow5bits((int32_t)q) - 1;
+    int32_t i = -e2 + (int32_t)q + k;
+    vr = mul_shift(mv, FLOAT_POW5_INV_SPLIT[q], i);
+    vp = mul_shift(mp, FLOAT_POW5_INV_SPLIT[q], i);
+    vm = mul_shift(mm, FLOAT_POW5_INV_SPLIT[q], i);
+    if (q != 0 && (vp - 1) / 10 <= vm / 10) {
+      // No digit is removed below, but rounding needs the one dropped here.
+      int32_t l = FLOAT_POW5_INV_BITCOUNT + pow5bits((int32_t)q - 1) - 1;
+      last_removed = mul_shift(mv, FLOAT_POW5_INV_SPLIT[q - 1],
+                               -e2 + (int32_t)q - 1 + l) %
+                     10;
+    }
+    if (q <= 9) {
+      // At most one of mv, mp and mm is a multiple of 5.
+      if (mv % 5 == 0)
+        vr_trailing_zeros = multiple_of_pow5(mv, q);
+      else if (accept_bounds)
+        vm_trailing_zeros = multiple_of_pow5(mm, q);
+      else
+        vp -= multiple_of_pow5(mp, q);
+    }
+  } else {
+    uint32_t q = log10_pow5(-e2);
+    e10 = (int32_t)q + e2;
+    int32_t i = -e2 - (int32_t)q;
+    int32_t k = pow5bits(i) - FLOAT_POW5_BITCOUNT;
+    int32_t j = (int32_t)q - k;
+    vr = mul_shift(mv, FLOAT_POW5_SPLIT[i], j);
+    vp = mul_shift(mp, FLOAT_POW5_SPLIT[i], j);
+    vm = mul_shift(mm, FLOAT_POW5_SPLIT[i], j);
+    if (q != 0 && (vp - 1) / 10 <= vm / 10) {
+      j = (int32_t)q - 1 - (pow5bits(i + 1) - FLOAT_POW5_BITCOUNT);
+      last_removed = mul_shift(mv, FLOAT_POW5_SPLIT[i + 1], j) % 10;
+    }
+    if (q <= 1) {
+      // mv has two trailing zero bits, mp one, and mm one iff mm_shift is 1.
+      vr_trailing_zeros = 1;
+      if (accept_bounds)
+        vm_trailing_zeros = mm_shift == 1;
+      else
+        --vp;
+    } else if (q < 31) {
+      vr_trailing_zeros = multiple_of_pow2(mv, q - 1);
+    }
+  }
+
+  // Drop digits while the bounds still differ, then round what is left.
+  int32_t removed = 0;
+  uint32_t output;
+  if (vm_trailing_zeros || vr_trailing_zeros) {
+    // Rare: the exact value may be a tie, or the lower bound reachable.
+    while (vp / 10 > vm / 10) {
+      vm_trailing_zeros &= vm % 10 == 0;
+      vr_trailing_zeros &= last_removed == 0;
+      last_removed = vr % 10;
+      vr /= 10;
+      vp /= 10;
+      vm /= 10;
+      ++removed;
+    }
+    if (vm_trailing_zeros) {
+      while (vm % 10 == 0) {
+        vr_trailing_zeros &= last_removed == 0;
+        last_removed = vr % 10;
+        vr /= 10;
+        vp /= 10;
+        vm /= 10;
+        ++removed;
+      }
+    }
+    if (vr_trailing_zeros && last_removed == 5 && vr % 2 == 0)
+      last_removed = 4; // exactly halfway: round to even
+    output = vr + ((vr == vm && (!accept_bounds || !vm_trailing_zeros)) ||
+                   last_removed >= 5);
+  } else {
+    while (vp / 10 > vm / 10) {
+      last_removed = vr % 10;
+      vr /= 10;
+      vp /= 10;
+      vm /= 10;
+      ++removed;
+    }
+    output = vr + (vr == vm || last_removed >= 5);
+  }
+  return (float_decimal){output, e10 + removed};
+}
+
+static int64_t put_text(char *out, const char *s) {
+  int64_t n = 0;
+  for (; s[n]; ++n)
+    out[n] = s[n];
+  return n;
+}
+
+// Fixed notation while the point is at most 21 digits in or 5 zeros out,
+// like JavaScript's Number#toString: 150, 0.25, 0.000001, 1e-7, 1e+21.
+static int64_t format_float(char *out, float f) {
+  union {
+    float f;
+    uint32_t bits;
+  } u = {f};
+  uint32_t mantissa = u.bits & ((1u << 23) - 1);
+  uint32_t exponent = (u.bits >> 23) & 0xff;
+  char *p = out;
+  if (exponent == 0xff && mantissa)
+    return put_text(out, "nan");
+  if (u.bits >> 31)
+    *p++ = '-';
+  if (exponent == 0xff)
+    return p - out + put_text(p, "inf");
+  if (exponent == 0 && mantissa == 0) {
+    *p = '0';
+    return p - out + 1;
+  }
+
+  float_decimal d = shortest_decimal(mantissa, exponent);
+  int len = decimal_length(d.digits);
+  int point = len + d.exponent; // digits before the decimal point
+  if (point >= len && point <= 21) {
+    put_digits(p, d.digits, len);
+    for (p += len; len < point; ++len)
+      *p++ = '0';
+  } else if (point > 0 && point < len) {
+    // The digits before the point move down one to make room for it.
+    put_digits(p + 1, d.digits, len);
+    for (int i = 0; i < point; ++i)
+      p[i] = p[i + 1];
+    p[point] = '.';
+    p += len + 1;
+  } else if (point <= 0 && point > -6) {
+    *p++ = '0';
+    *p++ = '.';
+    for (; point < 0; ++point)
+      *p++ = '0';
+    put_digits(p, d.digits, len);
+    p += len;
+  } else {
+    put_digits(p + 1, d.digits, len);
+    p[0] = p[1];
+    if (len > 1) {
+      p[1] = '.';
+      p += len + 1;
+    } else {
+      p += 1;
+    }
+    int32_t e = point - 1;
+    *p++ = 'e';
+    *p++ = e < 0 ? '-' : '+';
+    p += format_unsigned(p, (uint64_t)(e < 0 ? -e : e));
+  }
+  return p - out;
+}
+
+int64_t basiq_itoa(int64_t n, char *str) {
+  int64_t len = format_signed(str, n);
+  str[len] = '\0';
+  return len;
+}
+
+int64_t basiq_ftoa(float x, char *str) {
+  int64_t len = format_float(str, x);
+  str[len] = '\0';
+  return len;
+}
+
+// Formats one number straight into stdout's buffer.
+static void print_number(char spec, va_list *ap) {
+  char scratch[NUMBER_MAX];
+  char *out = basiq_reserve(1, NUMBER_MAX);
+  char *to = out ? out : scratch;
+  int64_t len;
+  if (spec == 'd')
+    len = format_signed(to, va_arg(*ap, int64_t));
+  else if (spec == 'u')
+    len = format_unsigned(to, va_arg(*ap, uint64_t));
+  else if (spec == 'x')
+    len = format_hex(to, va_arg(*ap, uint64_t));
+  else
+    len = format_float(to, (float)va_arg(*ap, double));
+  if (out)
+    basiq_commit(1, len);
+  else
+    basiq_write(1, scratch, len);
+}
+
+// The compiler passes integer arguments widened to 64 bits and Floats as
+// doubles, so the specs take no length modifiers.
+void basiq_printf(const char *fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  int64_t len = basiq_strlen(fmt), i = 0;
+  for (;;) {
+    int64_t at = basiq_memchr(fmt + i, '%', len - i);
+    if (at < 0)
+      break;
+    basiq_write(1, fmt + i, at);
+    i += at + 1;
+    char spec = fmt[i];
+    if (spec == 'd' || spec == 'u' || spec == 'x' || spec == 'f') {
+      print_number(spec, &ap);
+    } else if (spec == 's') {
+      const char *s = va_arg(ap, const char *);
+      basiq_write(1, s, basiq_strlen(s));
+    } else if (spec == 'c') {
+      char c = (char)va_arg(ap, int64_t);
+      basiq_write(1, &c, 1);
+    } else if (spec == '%') {
+      basiq_write(1, "%", 1);
+    } else {
+      // An unknown spec, or a % ending the format, prints as written.
+      basiq_write(1, fmt + i - 1, spec ? 2 : 1);
+    }
+    i += spec != '\0';
+  }
+  basiq_write(1, fmt + i, len - i);
+  va_end(ap);
+}
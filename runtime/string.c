@@ -0,0 +1,180 @@
+// String builtins: strlen, strcmp, memchr, strstr, strcpy, string_concat,
+// to_upper and to_lower.
+//
+// The kernels in string_kernels.inc are built once for SSE2, which every
+// x86-64 CPU has, and once for AVX2. The SSE2 set is used until startup
+// finds AVX2 and switches to it, so a program whose constructors never run
+// still gets working kernels. Other targets use plain byte loops.
+#include "basiq_rt.h"
+
+static int near_page_end(const void *p, int64_t w) {
+  return ((uintptr_t)p & 4095) > (uintptr_t)(4096 - w);
+}
+
+static int bytes_equal(const char *a, const char *b, int64_t n) {
+  for (int64_t i = 0; i < n; ++i)
+    if (a[i] != b[i])
+      return 0;
+  return 1;
+}
+
+typedef struct {
+  int64_t (*length)(const char *s);
+  int32_t (*compare)(const char *a, const char *b);
+  int64_t (*find_byte)(const char *s, int32_t c, int64_t n);
+  int64_t (*find)(const char *h, const char *needle);
+  void (*copy)(char *dst, const char *src, int64_t n);
+  void (*flip_case)(char *s, int64_t n, char lo, char hi);
+} string_kernels;
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <immintrin.h>
+
+#define KERNEL(name) name##_sse2
+#define TARGET
+#define W 16
+#define ALL_LANES 0xffffu
+#define vec __m128i
+#define VLOAD(p) _mm_load_si128((const __m128i *)(p))
+#define VLOADU(p) _mm_loadu_si128((const __m128i *)(p))
+#define VSTOREU(p, v) _mm_storeu_si128((__m128i *)(p), v)
+#define VSPLAT(c) _mm_set1_epi8((char)(c))
+#define VEQ(a, b) (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(a, b))
+#define VAND(a, b) _mm_and_si128(a, b)
+#define VXOR(a, b) _mm_xor_si128(a, b)
+#define VIN(v, lo, hi)                                                         \
+  _mm_and_si128(_mm_cmpgt_epi8(v, VSPLAT((lo) - 1)),                           \
+                _mm_cmpgt_epi8(VSPLAT((hi) + 1), v))
+#include "string_kernels.inc"
+#undef KERNEL
+#undef TARGET
+#undef W
+#undef ALL_LANES
+#undef vec
+#undef VLOAD
+#undef VLOADU
+#undef VSTOREU
+#undef VSPLAT
+#undef VEQ
+#undef VAND
+#undef VXOR
+#undef VIN
+
+#define KERNEL(name) name##_avx2
+#define TARGET __attribute__((target("avx2")))
+#define W 32
+#define ALL_LANES 0xffffffffu
+#define vec __m256i
+#define VLOAD(p) _mm256_load_si256((const __m256i *)(p))
+#define VLOADU(p) _mm256_loadu_si256((const __m256i *)(p))
+#define VSTOREU(p, v) _mm256_storeu_si256((__m256i *)(p), v)
+#define VSPLAT(c) _mm256_set1_epi8((char)(c))
+#define VEQ(a, b) (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b))
+#define VAND(a, b) _mm256_and_si256(a, b)
+#define VXOR(a, b) _mm256_xor_si256(a, b)
+#define VIN(v, lo, hi)                                                         \
+  _mm256_and_si256(_mm256_cmpgt_epi8(v, VSPLAT((lo) - 1)),                     \
+                   _mm256_cmpgt_epi8(VSPLAT((hi) + 1), v))
+#include "string_kernels.inc"
+
+static string_kernels kernels = {length_sse2, compare_sse2,
+                                 find_byte_sse2, find_sse2,
+                                 copy_sse2,     flip_case_sse2};
+
+// AVX2 needs both the CPU and the OS, which must save the YMM registers.
+static int have_avx2(void) {
+  unsigned a, b, c, d;
+  if (!__get_cpuid(1, &a, &b, &c, &d) || !(c & bit_OSXSAVE) || !(c & bit_AVX))
+    return 0;
+  unsigned lo, hi;
+  __asm__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+  if ((lo & 6) != 6)
+    return 0;
+  return __get_cpuid_count(7, 0, &a, &b, &c, &d) && (b & bit_AVX2);
+}
+
+__attribute__((constructor)) static void choose_kernels(void) {
+  if (have_avx2())
+    kernels = (string_kernels){length_avx2, compare_avx2, find_byte_avx2,
+                               find_avx2,   copy_avx2,    flip_case_avx2};
+}
+
+#else
+
+static int64_t length_bytes(const char *s) {
+  int64_t n = 0;
+  while (s[n])
+    ++n;
+  return n;
+}
+
+static int32_t compare_bytes(const char *a, const char *b) {
+  while (*a && *a == *b)
+    ++a, ++b;
+  return (unsigned char)*a - (unsigned char)*b;
+}
+
+static int64_t find_byte_bytes(const char *s, int32_t c, int64_t n) {
+  for (int64_t i = 0; i < n; ++i)
+    if (s[i] == (char)c)
+      return i;
+  return -1;
+}
+
+static int64_t find_bytes(const char *h, const char *needle) {
+  int64_t k = length_bytes(needle), n = length_bytes(h);
+  for (int64_t i = 0; i + k <= n; ++i)
+    if (bytes_equal(h + i, needle, k))
+      return i;
+  return -1;
+}
+
+static void copy_bytes(char *dst, const char *src, int64_t n) {
+  for (int64_t i = 0; i < n; ++i)
+    dst[i] = src[i];
+}
+
+static void flip_case_bytes(char *s, int64_t n, char lo, char hi) {
+  for (int64_t i = 0; i < n; ++i)
+    if (s[i] >= lo && s[i] <= hi)
+      s[i] ^= 0x20;
+}
+
+static const string_kernels kernels = {length_bytes, compare_bytes,
+                                       find_byte_bytes, find_bytes,
+                                       copy_bytes,     flip_case_bytes};
+
+#endif
+
+int64_t basiq_strlen(const char *s) { return kernels.length(s); }
+
+int32_t basiq_strcmp(const char *a, const char *b) {
+  return kernels.compare(a, b);
+}
+
+int64_t basiq_memchr(const char *s, int32_t c, int64_t n) {
+  return n > 0 ? kernels.find_byte(s, c, n) : -1;
+}
+
+int64_t basiq_strstr(const char *h, const char *needle) {
+  return kernels.find(h, needle);
+}
+
+int64_t basiq_strcpy(char *dst, const char *src) {
+  int64_t n = kernels.length(src);
+  kernels.copy(dst, src, n + 1);
+  return n;
+}
+
+void basiq_string_concat(char *a, const char *b) {
+  basiq_strcpy(a + kernels.length(a), b);
+}
+
+void basiq_to_upper(char *s) {
+  kernels.flip_case(s, kernels.length(s), 'a', 'z');
+}
+
+void basiq_to_lower(char *s) {
+  kernels.flip_case(s, kernels.length(s), 'A', 'Z');
+}
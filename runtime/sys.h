@@ -0,0 +1,212 @@
+#pragma once
+// The system calls the runtime makes, behind one small interface. Hosted
+// builds go through libc; BASIQ_FREESTANDING builds (x86-64 Linux, no
+// libc) issue them directly. Calls returning int64_t give -errno on
+// failure; mappings give NULL.
+#include <stdint.h>
+
+#ifdef BASIQ_FREESTANDING
+
+static inline int64_t sys_call(int64_t n, int64_t a, int64_t b, int64_t c,
+                               int64_t d, int64_t e, int64_t f) {
+  register int64_t r10 __asm__("r10") = d;
+  register int64_t r8 __asm__("r8") = e;
+  register int64_t r9 __asm__("r9") = f;
+  int64_t ret;
+  __asm__ volatile("syscall"
+                   : "=a"(ret)
+                   : "a"(n), "D"(a), "S"(b), "d"(c), "r"(r10), "r"(r8),
+                     "r"(r9)
+                   : "rcx", "r11", "memory");
+  return ret;
+}
+
+static inline int64_t sys_write(int32_t fd, const char *p, int64_t n) {
+  int64_t done;
+  do
+    done = sys_call(1, fd, (int64_t)p, n, 0, 0, 0);
+  while (done == -4); // EINTR
+  return done;
+}
+
+// isatty: TCGETS succeeds only on a terminal.
+static inline int sys_is_terminal(int32_t fd) {
+  char termios[64];
+  return sys_call(16, fd, 0x5401, (int64_t)termios, 0, 0, 0) == 0;
+}
+
+// open(2) flags for reading, or for writing: created or truncated. With
+// O_CLOEXEC.
+static inline int32_t sys_open_flags(int writable) {
+  return (writable ? 02 | 0100 | 01000 : 0) | 02000000;
+}
+
+// Opens path read-only, or for writing with mode 0644.
+static inline int32_t sys_open(const char *path, int writable) {
+  return (int32_t)sys_call(257, -100, (int64_t)path, sys_open_flags(writable),
+                           0644, 0, 0); // openat(AT_FDCWD, ...)
+}
+
+// read(2), or pread(2) at off if off is not negative; the same for write.
+static inline int64_t sys_read_at(int32_t fd, char *p, int64_t n,
+                                  int64_t off) {
+  return off < 0 ? sys_call(0, fd, (int64_t)p, n, 0, 0, 0)
+                 : sys_call(17, fd, (int64_t)p, n, off, 0, 0);
+}
+
+static inline int64_t sys_write_at(int32_t fd, const char *p, int64_t n,
+                                   int64_t off) {
+  return off < 0 ? sys_call(1, fd, (int64_t)p, n, 0, 0, 0)
+                 : sys_call(18, fd, (int64_t)p, n, off, 0, 0);
+}
+
+static inline int64_t sys_close(int32_t fd) {
+  return sys_call(3, fd, 0, 0, 0, 0, 0);
+}
+
+static inline int64_t sys_file_size(int32_t fd) {
+  int64_t st[18]; // struct stat; st_size is the seventh word
+  int64_t ret = sys_call(5, fd, (int64_t)st, 0, 0, 0, 0);
+  return ret < 0 ? ret : st[6];
+}
+
+static inline int64_t sys_truncate(int32_t fd, int64_t len) {
+  return sys_call(77, fd, len, 0, 0, 0, 0);
+}
+
+// Maps len bytes of fd: shared and writable, or private and read-only.
+static inline char *sys_map(int32_t fd, int64_t len, int writable) {
+  int64_t ret = sys_call(9, 0, len, writable ? 3 : 1, writable ? 1 : 2, fd, 0);
+  return ret < 0 && ret > -4096 ? 0 : (char *)ret;
+}
+
+static inline void sys_unmap(void *p, int64_t len) {
+  sys_call(11, (int64_t)p, len, 0, 0, 0, 0);
+}
+
+static inline void sys_advise(void *p, int64_t len, int32_t advice) {
+  sys_call(28, (int64_t)p, len, advice, 0, 0, 0);
+}
+
+static inline int64_t sys_page_size(void) { return 4096; }
+
+static inline int32_t sys_ring_setup(uint32_t entries, void *params) {
+  return (int32_t)sys_call(425, entries, (int64_t)params, 0, 0, 0, 0);
+}
+
+static inline int64_t sys_ring_enter(int32_t ring, uint32_t submit,
+                                     uint32_t wait, uint32_t flags) {
+  return sys_call(426, ring, submit, wait, flags, 0, 0);
+}
+
+// Maps len bytes of an io_uring at off, shared, writable and prefaulted.
+static inline char *sys_map_ring(int32_t ring, int64_t len, int64_t off) {
+  int64_t ret = sys_call(9, 0, len, 3, 1 | 0x8000, ring, off); // MAP_POPULATE
+  return ret < 0 && ret > -4096 ? 0 : (char *)ret;
+}
+
+#else
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static inline int64_t sys_write(int32_t fd, const char *p, int64_t n) {
+  ssize_t done;
+  do
+    done = write(fd, p, (size_t)n);
+  while (done < 0 && errno == EINTR);
+  return done < 0 ? -errno : done;
+}
+
+static inline int sys_is_terminal(int32_t fd) { return isatty(fd); }
+
+// open(2) flags for reading, or for writing: created or truncated. With
+// O_CLOEXEC.
+static inline int32_t sys_open_flags(int writable) {
+  return (writable ? O_RDWR | O_CREAT | O_TRUNC : O_RDONLY) | O_CLOEXEC;
+}
+
+// Opens path read-only, or for writing with mode 0644.
+static inline int32_t sys_open(const char *path, int writable) {
+  int fd = open(path, sys_open_flags(writable), 0644);
+  return fd < 0 ? -errno : fd;
+}
+
+// read(2), or pread(2) at off if off is not negative; the same for write.
+static inline int64_t sys_read_at(int32_t fd, char *p, int64_t n,
+                                  int64_t off) {
+  ssize_t done = off < 0 ? read(fd, p, (size_t)n) : pread(fd, p, (size_t)n, off);
+  return done < 0 ? -errno : done;
+}
+
+static inline int64_t sys_write_at(int32_t fd, const char *p, int64_t n,
+                                   int64_t off) {
+  ssize_t done =
+      off < 0 ? write(fd, p, (size_t)n) : pwrite(fd, p, (size_t)n, off);
+  return done < 0 ? -errno : done;
+}
+
+static inline int64_t sys_close(int32_t fd) {
+  return close(fd) < 0 ? -errno : 0;
+}
+
+static inline int64_t sys_file_size(int32_t fd) {
+  struct stat st;
+  return fstat(fd, &st) < 0 ? -errno : st.st_size;
+}
+
+static inline int64_t sys_truncate(int32_t fd, int64_t len) {
+  return ftruncate(fd, len) < 0 ? -errno : 0;
+}
+
+// Maps len bytes of fd: shared and writable, or private and read-only.
+static inline char *sys_map(int32_t fd, int64_t len, int writable) {
+  int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+  void *p = mmap(NULL, (size_t)len, prot, writable ? MAP_SHARED : MAP_PRIVATE,
+                 fd, 0);
+  return p == MAP_FAILED ? NULL : p;
+}
+
+static inline void sys_unmap(void *p, int64_t len) { munmap(p, (size_t)len); }
+
+static inline void sys_advise(void *p, int64_t len, int32_t advice) {
+  madvise(p, (size_t)len, advice);
+}
+
+static inline int64_t sys_page_size(void) { return sysconf(_SC_PAGESIZE); }
+
+// io_uring has no libc wrappers. Headers too old to name its system calls
+// leave the runtime on its synchronous fallback.
+static inline int32_t sys_ring_setup(uint32_t entries, void *params) {
+#ifdef SYS_io_uring_setup
+  long ring = syscall(SYS_io_uring_setup, entries, params);
+  return ring < 0 ? -errno : (int32_t)ring;
+#else
+  (void)entries, (void)params;
+  return -ENOSYS;
+#endif
+}
+
+static inline int64_t sys_ring_enter(int32_t ring, uint32_t submit,
+                                     uint32_t wait, uint32_t flags) {
+#ifdef SYS_io_uring_enter
+  long done = syscall(SYS_io_uring_enter, ring, submit, wait, flags, NULL, 0);
+  return done < 0 ? -errno : done;
+#else
+  (void)ring, (void)submit, (void)wait, (void)flags;
+  return -ENOSYS;
+#endif
+}
+
+// Maps len bytes of an io_uring at off, shared, writable and prefaulted.
+static inline char *sys_map_ring(int32_t ring, int64_t len, int64_t off) {
+  void *p = mmap(NULL, (size_t)len, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, ring, off);
+  return p == MAP_FAILED ? NULL : p;
+}
+
+#endif
@@ -20,12 +20,11 @@ std::string CharNode::repr() {
   return "CharNode(" + std::to_string(static_cast<int>(val)) + ")";
 }
 
-// std::string StringNode::repr() { return "StringNode(" + val + ")"; }
+std::string StringNode::repr() { return "StringNode(" + val + ")"; }
 
 std::string VariableDeclareNode::repr() {
   return "VariableDeclareNode(name=" + name +
-         ", value=" + (val ? val->repr() : "null") + ", Type=" + Type.value +
-         ", Size=" + std::to_string(arraySize.value_or(1)) + ")";
+         ", value=" + (val ? val->repr() : "null") + ", Type=" + Type.str() + ")";
 }
 
 std::string AssignmentNode::repr() {
@@ -47,7 +46,7 @@ std::string CompoundNode::repr() {
 
 std::string FunctionNode::repr() {
   return "FunctionNode(Name=" + name + ", Value=[" + content->repr() +
-         "], ReturnType=" + ReturnType.value + ")";
+         "], ReturnType=" + ReturnType.str() + ")";
 }
 
 std::string VariableReferenceNode::repr() {
@@ -74,6 +73,11 @@ std::string BinaryOperationNode::repr() {
   return oss.str();
 }
 
+std::string UnaryOperationNode::repr() {
+  return std::string("UnaryOperationNode(Op=") + tokenName(Type) +
+         ", Operand=" + Operand->repr() + ")";
+}
+
 std::string BreakNode::repr() { return "BreakNode()"; }
 
 std::string ContinueNode::repr() { return "ContinueNode()"; }
@@ -99,6 +103,12 @@ std::string ForNode::repr() {
   return s;
 }
 
+std::string RangeForNode::repr() {
+  return std::string(parallel ? "Parallel" : "") + "RangeForNode(var=" + var + ", start=" + start->repr() +
+         ", end=" + end->repr() + ", step=" + (step ? step->repr() : "1") +
+         ", body=" + (body ? body->repr() : "null") + ")";
+}
+
 std::string ArrayLiteralNode::repr() {
   std::string s = "ArrayLiteralNode([";
   bool first = true;
@@ -122,7 +132,23 @@ std::string ArrayAssignNode::repr() {
          ", Value=" + value->repr() + ")";
 }
 
-std::string SizeOfNode::repr() { return "SizeOfNode(" + val->repr() + ")"; }
+std::string SubSliceNode::repr() {
+  return "SubSliceNode(Name=" + name + ", Lo=" + (lo ? lo->repr() : "0") +
+         ", Hi=" + (hi ? hi->repr() : "len") + ")";
+}
+
+std::string SizeOfNode::repr() {
+  return std::string(align ? "AlignOfNode(" : "SizeOfNode(") +
+         (val ? val->repr() : type.str()) + ")";
+}
+
+std::string MemberAccessNode::repr() {
+  return "MemberAccessNode(" + base->repr() + "." + field + ")";
+}
+
+std::string MemberAssignNode::repr() {
+  return "MemberAssignNode(" + target->repr() + ", Value=" + val->repr() + ")";
+}
 
 std::string PointerReferenceNode::repr() { return "PointerReferenceNode"; }
 
@@ -130,3 +156,108 @@ std::string PointerDeReferenceAssingNode::repr() {
   return "PointerDeReferenceAssingNode=" + name + ", Index=" + index->repr() +
          ", Value=" + val->repr() + ")";
 }
+
+// ===============================
+// Child traversal
+// ===============================
+
+static void visit(std::unique_ptr<ast> &child, const ChildVisitor &fn) {
+  if (child)
+    fn(child);
+}
+
+void VariableDeclareNode::forEachChild(const ChildVisitor &fn) {
+  visit(val, fn);
+}
+
+void AssignmentNode::forEachChild(const ChildVisitor &fn) { visit(val, fn); }
+
+void ReturnNode::forEachChild(const ChildVisitor &fn) { visit(expr, fn); }
+
+void CompoundNode::forEachChild(const ChildVisitor &fn) {
+  for (auto &block : blocks)
+    visit(block, fn);
+}
+
+void FunctionNode::forEachChild(const ChildVisitor &fn) { visit(content, fn); }
+
+void WhileNode::forEachChild(const ChildVisitor &fn) {
+  visit(condition, fn);
+  visit(body, fn);
+}
+
+void IfNode::forEachChild(const ChildVisitor &fn) {
+  visit(condition, fn);
+  visit(thenBlock, fn);
+  visit(elseBlock, fn);
+}
+
+void BinaryOperationNode::forEachChild(const ChildVisitor &fn) {
+  visit(Left, fn);
+  visit(Right, fn);
+}
+
+void UnaryOperationNode::forEachChild(const ChildVisitor &fn) {
+  visit(Operand, fn);
+}
+
+void CallNode::forEachChild(const ChildVisitor &fn) {
+  for (auto &arg : args)
+    visit(arg, fn);
+}
+
+void ForNode::forEachChild(const ChildVisitor &fn) {
+  visit(init, fn);
+  visit(condition, fn);
+  visit(increment, fn);
+  visit(body, fn);
+}
+
+void RangeForNode::forEachChild(const ChildVisitor &fn) {
+  visit(start, fn);
+  visit(end, fn);
+  visit(step, fn);
+  visit(body, fn);
+}
+
+void ArrayLiteralNode::forEachChild(const ChildVisitor &fn) {
+  for (auto &elem : Elements)
+    visit(elem, fn);
+}
+
+void ArrayAccessNode::forEachChild(const ChildVisitor &fn) {
+  visit(indexExpr, fn);
+}
+
+void ArrayAssignNode::forEachChild(const ChildVisitor &fn) {
+  visit(index, fn);
+  visit(value, fn);
+}
+
+void SubSliceNode::forEachChild(const ChildVisitor &fn) {
+  visit(lo, fn);
+  visit(hi, fn);
+}
+
+void SizeOfNode::forEachChild(const ChildVisitor &fn) { visit(val, fn); }
+
+void SyscallNode::forEachChild(const ChildVisitor &fn) {
+  for (auto &arg : args)
+    visit(arg, fn);
+}
+
+void PointerDeReferenceAssingNode::forEachChild(const ChildVisitor &fn) {
+  visit(index, fn);
+  visit(val, fn);
+}
+
+void DeReferenceNode::forEachChild(const ChildVisitor &fn) { visit(index, fn); }
+
+void CastNode::forEachChild(const ChildVisitor &fn) { visit(Value, fn); }
+
+void MemberAccessNode::forEachChild(const ChildVisitor &fn) { visit(base, fn); }
+
+void MemberAssignNode::forEachChild(const ChildVisitor &fn) {
+  visit(target, fn);
+  visit(val, fn);
+}
@@ -1,5 +1,6 @@
 #include "lexer.h"
 #include "llvm/IR/InlineAsm.h"
+#include <algorithm>
 #include <alloca.h>
 #include <ast.h>
 #include <cctype>
@@ -11,6 +12,7 @@
 #include <llvm-18/llvm/IR/Instructions.h>
 #include <llvm-18/llvm/IR/Intrinsics.h>
 #include <llvm-18/llvm/IR/LLVMContext.h>
+#include <llvm-18/llvm/IR/MDBuilder.h>
 #include <llvm-18/llvm/IR/Metadata.h>
 #include <llvm-18/llvm/IR/Type.h>
 #include <llvm-18/llvm/IR/Value.h>
@@ -18,66 +20,100 @@
 #include <llvm-18/llvm/Support/TypeName.h>
 #include <llvm-18/llvm/Support/raw_ostream.h>
 #include <memory>
+#include <optional>
 #include <stdexcept>
 #include <strings.h>
 #include <utility>
 #include <vector>
 
-llvm::Type *GetPointeeType(Token typeToken, CodegenContext &cc) {
-  std::string t = typeToken.value;
-  for (char &c : t)
-    c = toupper(c);
-
-  if (t.size() > 7 && t.substr(t.size() - 7) == "POINTER") {
-    Token baseToken;
-    baseToken.value = t.substr(0, t.size() - 7); // strip "POINTER"
-    return GetTypeNonVoid(baseToken, cc); // "CHAR" -> i8, "INTEGER" -> i32
+llvm::Type *lowerType(const BType &type, CodegenContext &cc) {
+  llvm::LLVMContext &ctx = *cc.TheContext;
+
+  switch (type.kind) {
+  case BType::Void:
+    return llvm::Type::getVoidTy(ctx);
+  case BType::Boolean:
+  case BType::Char:
+  case BType::Integer:
+  case BType::Int8:
+  case BType::Int16:
+  case BType::Int32:
+  case BType::Int64:
+  case BType::UInt8:
+  case BType::UInt16:
+  case BType::UInt32:
+  case BType::UInt64:
+    return llvm::Type::getIntNTy(ctx, type.bits());
+  case BType::Float:
+    return llvm::Type::getFloatTy(ctx);
+  case BType::Pointer: {
+    const BType &pointee = type.element();
+    llvm::Type *base = pointee.isVoid() ? llvm::Type::getInt8Ty(ctx)
+                                        : lowerType(pointee, cc);
+    return llvm::PointerType::get(base, 0);
   }
-  return nullptr;
-}
-
-llvm::Type *GetTypeNonVoid(Token type, CodegenContext &cc) {
-  std::string t = type.value;
-
-  for (char &c : t)
-    c = toupper(c);
-
-  if (t.size() > 7 && t.substr(t.size() - 7) == "POINTER") {
-    Token baseTypeToken;
-    baseTypeToken.value = t.substr(0, t.size() - 7);
-    llvm::Type *baseType = GetTypeNonVoid(baseTypeToken, cc);
-    return llvm::PointerType::get(baseType, 0);
+  case BType::Array:
+    return llvm::ArrayType::get(lowerType(type.element(), cc), type.count);
+  case BType::Vector:
+    return llvm::FixedVectorType::get(lowerType(type.element(), cc),
+                                      type.count);
+  // Two scalars, so a slice argument travels in a pair of registers.
+  case BType::Slice:
+    return llvm::StructType::get(
+        lowerType(BType::pointerTo(type.element()), cc),
+        llvm::Type::getInt64Ty(ctx));
+  case BType::Struct: {
+    // A struct may be named before its declaration is reached; start it
+    // opaque and let StructCreateNode::declare set the body.
+    auto &entry = cc.StructIndexList[type.name];
+    if (!entry)
+      entry = std::make_unique<StructIndex>(
+          llvm::StructType::create(*cc.TheContext, type.name),
+          std::vector<std::pair<std::string, size_t>>{});
+    return entry->TheStruct;
   }
-
-  if (type.type == IDENTIFIER) {
-    auto it = *cc.StructIndexList.find(type.value)->second;
-    return it.TheStruct;
+  default:
+    throw std::runtime_error("Cannot lower unresolved type");
   }
+}
 
-  if (t == "INTEGER") {
-    return llvm::Type::getInt32Ty(*cc.TheContext);
-  } else if (t == "FLOAT") {
-    return llvm::Type::getFloatTy(*cc.TheContext);
-  } else if (t == "STRING") {
-    return llvm::Type::getInt8Ty(*cc.TheContext);
-  } else if (t == "BOOLEAN") {
-    return llvm::Type::getInt1Ty(*cc.TheContext);
-  } else if (t == "CHAR") {
+// Element type of a pointer, as loads and GEPs through it need it.
+static llvm::Type *lowerPointee(const BType &pointerType, CodegenContext &cc) {
+  const BType &pointee = pointerType.element();
+  if (pointee.isVoid())
     return llvm::Type::getInt8Ty(*cc.TheContext);
-  }
-
-  throw std::runtime_error("Invalid Type: " + type.value);
-  return nullptr;
+  return lowerType(pointee, cc);
 }
 
-llvm::Type *GetTypeVoid(Token type, CodegenContext &cc) {
-  for (char &c : type.value)
-    c = toupper(c);
-
-  if (type.value == "VOID")
-    return llvm::Type::getVoidTy(*cc.TheContext);
+llvm::Value *castValue(llvm::IRBuilder<> &builder, llvm::Value *val,
+                       llvm::Type *targetType, bool isSigned);
+
+// Converts v from sema type `from` to `to` when both are scalars, so stores
+// and calls see the declared width. A scalar going into a vector is splatted
+// across its lanes, and vectors convert lane by lane. Aggregates are passed
+// through untouched.
+static llvm::Value *convertScalar(llvm::Value *v, const BType &from,
+                                  const BType &to, CodegenContext &cc) {
+  if (!v || from == to)
+    return v;
+  if (to.isVector() && from.isNumeric()) {
+    v = convertScalar(v, from, to.element(), cc);
+    return cc.Builder->CreateVectorSplat(to.count, v, "splat");
+  }
+  if (!from.scalar().isNumeric() || !to.scalar().isNumeric())
+    return v;
+  return castValue(*cc.Builder, v, lowerType(to, cc),
+                   !from.scalar().isUnsigned());
+}
 
-  return GetTypeNonVoid(type, cc);
+// Evaluates an array or pointer index and widens it to i64, so GEPs never
+// truncate large offsets.
+static llvm::Value *indexValue(ast &index, CodegenContext &cc) {
+  llvm::Value *v = index.codegen(cc);
+  if (!v || !v->getType()->isIntegerTy())
+    throw std::runtime_error("Array index must be integer");
+  return cc.Builder->CreateIntCast(v, cc.Builder->getInt64Ty(),
+                                   !index.exprType.isUnsigned(), "idx");
 }
 
 llvm::Value *CharNode::codegen(CodegenContext &cc) {
@@ -86,8 +122,7 @@ llvm::Value *CharNode::codegen(CodegenContext &cc) {
 }
 
 llvm::Value *IntegerNode::codegen(CodegenContext &cc) {
-  return llvm::ConstantInt::get(llvm::Type::getInt32Ty(*cc.TheContext), val,
-                                true);
+  return llvm::ConstantInt::get(lowerType(exprType, cc), val, true);
 }
 
 llvm::Value *FloatNode::codegen(CodegenContext &cc) {
@@ -100,83 +135,474 @@ llvm::Value *BooleanNode::codegen(CodegenContext &cc) {
                                 true);
 }
 
-// llvm::Value *StringNode::codegen(CodegenContext &cc) {
-//   return llvm::ConstantDataArray::getString(*cc.TheContext, val,
-//                                             true); // true = add null
-//                                             terminator
-// }
+llvm::Value *StringNode::codegen(CodegenContext &cc) {
+  llvm::GlobalVariable *&str = cc.StringPool[val];
+  if (!str) {
+    llvm::Constant *init = llvm::ConstantDataArray::getString(
+        *cc.TheContext, val, true); // true = add null terminator
+    str = new llvm::GlobalVariable(*cc.Module, init->getType(), true,
+                                   llvm::GlobalValue::PrivateLinkage, init,
+                                   ".str");
+    str->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global);
+    str->setAlignment(llvm::Align(1));
+  }
+  return str;
+}
+
+llvm::AllocaInst *CodegenContext::createEntryAlloca(llvm::Type *type,
+                                                    const std::string &name) {
+  llvm::BasicBlock &entry =
+      Builder->GetInsertBlock()->getParent()->getEntryBlock();
+  llvm::IRBuilder<> tmp(&entry, entry.begin());
+  return tmp.CreateAlloca(type, nullptr, name);
+}
+
+void CodegenContext::startLifetime(llvm::AllocaInst *alloca) {
+  if (LiveScopes.empty())
+    return;
+  uint64_t size =
+      Module->getDataLayout().getTypeAllocSize(alloca->getAllocatedType());
+  Builder->CreateLifetimeStart(alloca, Builder->getInt64(size));
+  LiveScopes.back().push_back(alloca);
+}
+
+void CodegenContext::endLifetimes(size_t depth) {
+  for (size_t i = LiveScopes.size(); i-- > depth;) {
+    for (llvm::AllocaInst *alloca : LiveScopes[i]) {
+      uint64_t size =
+          Module->getDataLayout().getTypeAllocSize(alloca->getAllocatedType());
+      Builder->CreateLifetimeEnd(alloca, Builder->getInt64(size));
+    }
+  }
+}
+
+// Fills the array at dst from lit. An all-constant literal becomes a private
+// constant global copied in with one memcpy; otherwise the elements are
+// stored one by one. Slots past the end of the literal are zeroed.
+static void storeArrayLiteral(ArrayLiteralNode &lit, llvm::Value *dst,
+                              llvm::ArrayType *arrayType,
+                              const BType &elemType, CodegenContext &cc) {
+  std::vector<llvm::Value *> vals;
+  bool allConstant = true;
+  for (auto &elem : lit.Elements) {
+    llvm::Value *v =
+        convertScalar(elem->codegen(cc), elem->exprType, elemType, cc);
+    if (!v)
+      throw std::runtime_error("Could not generate code for array element");
+    allConstant &= llvm::isa<llvm::Constant>(v);
+    vals.push_back(v);
+  }
+
+  const llvm::DataLayout &DL = cc.Module->getDataLayout();
+  llvm::Align align = DL.getABITypeAlign(arrayType);
+  llvm::Value *size = cc.Builder->getInt64(DL.getTypeAllocSize(arrayType));
+
+  if (allConstant) {
+    std::vector<llvm::Constant *> elems;
+    for (llvm::Value *v : vals)
+      elems.push_back(llvm::cast<llvm::Constant>(v));
+    elems.resize(arrayType->getNumElements(),
+                 llvm::Constant::getNullValue(arrayType->getElementType()));
+
+    auto *init = new llvm::GlobalVariable(
+        *cc.Module, arrayType, true, llvm::GlobalValue::PrivateLinkage,
+        llvm::ConstantArray::get(arrayType, elems), dst->getName() + ".init");
+    init->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global);
+    init->setAlignment(align);
+    cc.Builder->CreateMemCpy(dst, align, init, align, size);
+    return;
+  }
+
+  if (vals.size() < arrayType->getNumElements())
+    cc.Builder->CreateMemSet(dst, cc.Builder->getInt8(0), size, align);
+  for (size_t i = 0; i < vals.size(); ++i) {
+    llvm::Value *gep = cc.Builder->CreateGEP(
+        arrayType, dst, {cc.Builder->getInt32(0), cc.Builder->getInt32(i)},
+        "elemptr");
+    cc.Builder->CreateStore(vals[i], gep);
+  }
+}
+
+// Copies the array-typed expression src into dst as a whole.
+static void copyArray(ast &src, llvm::Value *dst, llvm::ArrayType *arrayType,
+                      const BType &elemType, CodegenContext &cc) {
+  if (auto *lit = dynamic_cast<ArrayLiteralNode *>(&src)) {
+    storeArrayLiteral(*lit, dst, arrayType, elemType, cc);
+    return;
+  }
+
+  const llvm::DataLayout &DL = cc.Module->getDataLayout();
+  llvm::Align align = DL.getABITypeAlign(arrayType);
+
+  // A string literal copies its bytes, terminator included, and zeroes the
+  // rest of the array.
+  if (auto *str = dynamic_cast<StringNode *>(&src)) {
+    uint64_t size = DL.getTypeAllocSize(arrayType);
+    uint64_t len = std::min<uint64_t>(str->val.size() + 1, size);
+    if (len < size)
+      cc.Builder->CreateMemSet(dst, cc.Builder->getInt8(0),
+                               cc.Builder->getInt64(size), align);
+    cc.Builder->CreateMemCpy(dst, align, str->codegen(cc), llvm::Align(1),
+                             cc.Builder->getInt64(len));
+    return;
+  }
+
+  if (auto *ref = dynamic_cast<VariableReferenceNode *>(&src)) {
+    if (const VWT *var = cc.lookup(ref->sym)) {
+      cc.Builder->CreateMemCpy(
+          dst, align, var->val, align,
+          cc.Builder->getInt64(DL.getTypeAllocSize(arrayType)));
+      return;
+    }
+  }
+
+  // Anything else produces the array as a first-class value.
+  cc.Builder->CreateAlignedStore(src.codegen(cc), dst, align);
+}
+
+// Storage of an @soa array: one array per field, in the struct's layout
+// order, so a field's values are contiguous across elements.
+static llvm::StructType *soaType(const BType &arrayType, CodegenContext &cc) {
+  auto *st = llvm::cast<llvm::StructType>(lowerType(arrayType.element(), cc));
+  std::vector<llvm::Type *> columns;
+  for (llvm::Type *field : st->elements())
+    columns.push_back(llvm::ArrayType::get(field, arrayType.count));
+  return llvm::StructType::get(*cc.TheContext, columns);
+}
+
+// Address of field `column` (an LLVM element index) of element i.
+static llvm::Value *soaField(const VWT &array, unsigned column,
+                             llvm::Value *i, CodegenContext &cc) {
+  llvm::IRBuilder<> &B = *cc.Builder;
+  return B.CreateGEP(array.type, array.val,
+                     {B.getInt64(0), B.getInt32(column), i}, "soa_ptr");
+}
+
+// Element i of an @soa array, gathered into a struct value.
+static llvm::Value *soaLoad(const VWT &array, llvm::StructType *st,
+                            llvm::Value *i, CodegenContext &cc) {
+  llvm::Value *v = llvm::UndefValue::get(st);
+  for (unsigned c = 0; c < st->getNumElements(); ++c) {
+    llvm::Value *field = cc.Builder->CreateLoad(
+        st->getElementType(c), soaField(array, c, i, cc), "soa_field");
+    v = cc.Builder->CreateInsertValue(v, field, c);
+  }
+  return v;
+}
+
+// A T[] value: the { ptr, i64 } pair of data and element count.
+static llvm::Value *makeSlice(llvm::Value *ptr, llvm::Value *len,
+                              CodegenContext &cc) {
+  auto *type =
+      llvm::StructType::get(ptr->getType(), cc.Builder->getInt64Ty());
+  llvm::Value *slice = cc.Builder->CreateInsertValue(
+      llvm::PoisonValue::get(type), ptr, 0);
+  return cc.Builder->CreateInsertValue(slice, len, 1, "slice");
+}
+
+// Continues if ok holds and traps otherwise. Every check in a function
+// shares one trap block, and the branch to it is weighted as never taken so
+// it is laid out cold and the checks cost one well-predicted branch each.
+static void boundsCheck(llvm::Value *ok, CodegenContext &cc) {
+  if (auto *known = llvm::dyn_cast<llvm::ConstantInt>(ok);
+      known && known->isOne())
+    return;
+  llvm::Function *F = cc.Builder->GetInsertBlock()->getParent();
+  if (!cc.TrapBB) {
+    cc.TrapBB = llvm::BasicBlock::Create(*cc.TheContext, "bounds.fail", F);
+    llvm::IRBuilder<> trap(cc.TrapBB);
+    trap.CreateIntrinsic(llvm::Intrinsic::trap, {}, {});
+    trap.CreateUnreachable();
+  }
+  auto *okBB = llvm::BasicBlock::Create(*cc.TheContext, "bounds.ok", F);
+  llvm::MDBuilder md(*cc.TheContext);
+  cc.Builder->CreateCondBr(ok, okBB, cc.TrapBB,
+                           md.createBranchWeights(1u << 20, 1));
+  cc.Builder->SetInsertPoint(okBB);
+}
+
+// True if an enclosing range loop has checked array[index] for all of its
+// iterations.
+static bool rangeChecked(const Symbol *array, ast &index,
+                         const CodegenContext &cc) {
+  auto *ref = dynamic_cast<VariableReferenceNode *>(&index);
+  return ref && std::find(cc.CheckedRanges.begin(), cc.CheckedRanges.end(),
+                          std::make_pair(array, (const Symbol *)ref->sym)) !=
+                    cc.CheckedRanges.end();
+}
+
+// --bounds-check on an index i into the array or vector variable sym.
+static void checkArrayIndex(const Symbol *sym, ast &index, llvm::Value *i,
+                            CodegenContext &cc) {
+  if (cc.CheckArrays && cc.BoundsChecks && !rangeChecked(sym, index, cc))
+    boundsCheck(cc.Builder->CreateICmpULT(
+                    i, cc.Builder->getInt64(sym->type.count), "inbounds"),
+                cc);
+}
+
+// --bounds-check on a `size`-byte access at `offset` bytes past ptr. A
+// pointer carries no length, so this asks the optimizer how much of the
+// object ptr points into is left (llvm.objectsize). That is known once the
+// pointer is traced back to a local, global or sized allocation; a pointer
+// of unknown origin passes and the check folds away.
+static void checkPointerAccess(llvm::Value *ptr, llvm::Value *offset,
+                               uint64_t size, CodegenContext &cc) {
+  if (!cc.CheckArrays || !cc.BoundsChecks)
+    return;
+  llvm::IRBuilder<> &B = *cc.Builder;
+  llvm::Value *left = B.CreateIntrinsic(
+      llvm::Intrinsic::objectsize, {B.getInt64Ty(), ptr->getType()},
+      {ptr, B.getFalse(), B.getTrue(), B.getTrue()}, nullptr, "objsize");
+  llvm::Value *fits =
+      B.CreateAnd(B.CreateICmpULE(offset, left),
+                  B.CreateICmpUGE(B.CreateSub(left, offset), B.getInt64(size)));
+  boundsCheck(B.CreateOr(B.CreateICmpEQ(left, B.getInt64(-1)), fits,
+                         "inbounds"),
+              cc);
+}
+
+// --bounds-check on element i of a pointer to elemType.
+static void checkPointerIndex(llvm::Value *ptr, llvm::Value *i,
+                              llvm::Type *elemType, CodegenContext &cc) {
+  if (!cc.CheckArrays || !cc.BoundsChecks)
+    return;
+  const llvm::DataLayout &DL = cc.Module->getDataLayout();
+  llvm::Value *offset = cc.Builder->CreateMul(
+      i, cc.Builder->getInt64(DL.getTypeAllocSize(elemType)));
+  checkPointerAccess(ptr, offset, DL.getTypeStoreSize(elemType), cc);
+}
+
+// Address of element `index` of the slice variable sym.
+static llvm::Value *sliceElement(const Symbol *sym, ast &index,
+                                 CodegenContext &cc) {
+  const VWT *var = cc.lookup(sym);
+  if (!var)
+    throw std::runtime_error("Unknown slice: " + sym->name);
+  llvm::IRBuilder<> &B = *cc.Builder;
+  llvm::Value *slice = B.CreateLoad(var->type, var->val, sym->name);
+  llvm::Value *i = indexValue(index, cc);
+  // Unsigned, so a negative index fails too.
+  if (cc.BoundsChecks && !rangeChecked(sym, index, cc))
+    boundsCheck(B.CreateICmpULT(i, B.CreateExtractValue(slice, 1, "len"),
+                                "inbounds"),
+                cc);
+  return B.CreateInBoundsGEP(lowerType(sym->type.element(), cc),
+                             B.CreateExtractValue(slice, 0, "data"), i,
+                             sym->name + "_elem_ptr");
+}
+
+// Storage an aggregate expression lives in, with the alignment that is
+// known for it. Fields of @packed structs may be less aligned than their
+// type.
+struct Place {
+  llvm::Value *ptr;
+  llvm::Type *type;
+  llvm::Align align;
+};
+
+static Place placeOf(ast &node, CodegenContext &cc) {
+  const llvm::DataLayout &DL = cc.Module->getDataLayout();
+  llvm::Type *type = lowerType(node.exprType, cc);
+
+  if (auto *member = dynamic_cast<MemberAccessNode *>(&node)) {
+    Place base;
+    const BType &baseType = member->base->exprType;
+    auto *elem = dynamic_cast<ArrayAccessNode *>(member->base.get());
+    if (elem && elem->sym->soa) {
+      // arr[i].field of an @soa array is element i of that field's array.
+      const VWT *array = cc.lookup(elem->sym);
+      const auto &index = cc.StructIndexList[baseType.name]->index;
+      auto field = std::find_if(index.begin(), index.end(), [&](auto &entry) {
+        return entry.first == member->field;
+      });
+      if (!array || field == index.end())
+        throw std::runtime_error("Unknown field: " + member->field);
+      llvm::Value *i = indexValue(*elem->indexExpr, cc);
+      checkArrayIndex(elem->sym, *elem->indexExpr, i, cc);
+      return {soaField(*array, field->second, i, cc), type,
+              DL.getABITypeAlign(type)};
+    }
+    if (baseType.isPointer()) {
+      llvm::Type *st = lowerType(baseType.element(), cc);
+      base = {member->base->codegen(cc), st, DL.getABITypeAlign(st)};
+    } else {
+      base = placeOf(*member->base, cc);
+    }
+
+    auto *st = llvm::cast<llvm::StructType>(base.type);
+    const auto &index = cc.StructIndexList[baseType.isPointer()
+                                               ? baseType.element().name
+                                               : baseType.name]
+                            ->index;
+    auto field = std::find_if(index.begin(), index.end(), [&](auto &entry) {
+      return entry.first == member->field;
+    });
+    if (field == index.end())
+      throw std::runtime_error("Unknown field: " + member->field);
+    unsigned i = field->second;
+    uint64_t offset = DL.getStructLayout(st)->getElementOffset(i);
+    return {cc.Builder->CreateStructGEP(st, base.ptr, i, member->field), type,
+            llvm::commonAlignment(base.align, offset)};
+  }
+
+  if (auto *ref = dynamic_cast<VariableReferenceNode *>(&node)) {
+    if (const VWT *var = cc.lookup(ref->sym))
+      return {var->val, type, DL.getABITypeAlign(type)};
+  }
+
+  if (auto *elem = dynamic_cast<ArrayAccessNode *>(&node);
+      elem && elem->sym && elem->sym->type.isSlice())
+    return {sliceElement(elem->sym, *elem->indexExpr, cc), type,
+            DL.getABITypeAlign(type)};
+
+  if (auto *elem = dynamic_cast<ArrayAccessNode *>(&node)) {
+    if (const VWT *array = cc.lookup(elem->sym)) {
+      llvm::Value *index = indexValue(*elem->indexExpr, cc);
+      checkArrayIndex(elem->sym, *elem->indexExpr, index, cc);
+      llvm::Value *ptr = cc.Builder->CreateGEP(
+          array->type, array->val, {cc.Builder->getInt64(0), index},
+          elem->arrayName + "_elem_ptr");
+      return {ptr, type, DL.getABITypeAlign(type)};
+    }
+  }
+
+  if (auto *deref = dynamic_cast<DeReferenceNode *>(&node)) {
+    if (const VWT *var = cc.lookup(deref->sym)) {
+      llvm::Value *ptr = cc.Builder->CreateLoad(var->type, var->val,
+                                                deref->name + "_ptr");
+      if (deref->index) {
+        llvm::Value *i = indexValue(*deref->index, cc);
+        checkPointerIndex(ptr, i, type, cc);
+        ptr = cc.Builder->CreateGEP(type, ptr, {i}, "ptr_elem");
+      }
+      return {ptr, type, DL.getABITypeAlign(type)};
+    }
+  }
+
+  // Sema only lets a struct be cast to its own type.
+  if (auto *cast = dynamic_cast<CastNode *>(&node);
+      cast && cast->Value->exprType == node.exprType)
+    return placeOf(*cast->Value, cc);
+
+  throw std::runtime_error("Expression has no storage: " + node.repr());
+}
+
+// Copies the struct-typed expression src into dst.
+static void copyStruct(ast &src, llvm::Value *dst, llvm::Align dstAlign,
+                       CodegenContext &cc) {
+  if (auto *elem = dynamic_cast<ArrayAccessNode *>(&src); elem &&
+                                                        elem->sym->soa) {
+    cc.Builder->CreateAlignedStore(src.codegen(cc), dst, dstAlign);
+    return;
+  }
+  Place from = placeOf(src, cc);
+  uint64_t size = cc.Module->getDataLayout().getTypeAllocSize(from.type);
+  cc.Builder->CreateMemCpy(dst, dstAlign, from.ptr, from.align,
+                           cc.Builder->getInt64(size));
+}
+
+// Evaluates expr as a value of type `to`. A named array or string literal
+// going into a slice is viewed in place rather than loaded.
+static llvm::Value *valueAs(ast &expr, const BType &to, CodegenContext &cc) {
+  if (to.isSlice() && !expr.exprType.isSlice()) {
+    if (auto *str = dynamic_cast<StringNode *>(&expr))
+      return makeSlice(str->codegen(cc), cc.Builder->getInt64(str->val.size()),
+                       cc);
+    return makeSlice(placeOf(expr, cc).ptr,
+                     cc.Builder->getInt64(expr.exprType.count), cc);
+  }
+  return convertScalar(expr.codegen(cc), expr.exprType, to, cc);
+}
 
 llvm::Value *VariableDeclareNode::codegen(CodegenContext &cc) {
-  llvm::Type *elementType = GetTypeNonVoid(Type, cc);
+  llvm::Type *varType = lowerType(Type, cc);
   llvm::AllocaInst *alloca = nullptr;
 
   if (!cc.Builder->GetInsertBlock())
     std::cout << "NO INSERT BLOCK\n";
 
-  if (arraySize.has_value() && *arraySize > 1) {
-    llvm::ArrayType *arrayType = llvm::ArrayType::get(elementType, *arraySize);
-    alloca = cc.Builder->CreateAlloca(arrayType, nullptr, name);
+  if (soa) {
+    varType = soaType(Type, cc);
+    alloca = cc.createEntryAlloca(varType, name);
+    cc.startLifetime(alloca);
+    const llvm::DataLayout &DL = cc.Module->getDataLayout();
+    cc.Builder->CreateMemSet(
+        alloca, cc.Builder->getInt8(0),
+        cc.Builder->getInt64(DL.getTypeAllocSize(varType)), alloca->getAlign());
+
+  } else if (Type.isArray()) {
+    llvm::ArrayType *arrayType = llvm::cast<llvm::ArrayType>(varType);
+    alloca = cc.createEntryAlloca(arrayType, name);
+    // Align arrays big enough to hold a vector to their size (up to a cache
+    // line) so aload/astore on them are legal and loops over them vectorize
+    // without peeling.
+    const llvm::DataLayout &layout = cc.Module->getDataLayout();
+    uint64_t size = layout.getTypeAllocSize(arrayType);
+    if (size >= 16) {
+      uint64_t align = std::min<uint64_t>(64, 1ull << llvm::Log2_64(size));
+      alloca->setAlignment(std::max(alloca->getAlign(), llvm::Align(align)));
+    }
+    cc.startLifetime(alloca);
 
     if (val) {
-      ArrayLiteralNode *arrayNode = dynamic_cast<ArrayLiteralNode *>(val.get());
-      if (arrayNode) {
-        for (size_t i = 0; i < arrayNode->Elements.size(); ++i) {
-          llvm::Value *elemVal = arrayNode->Elements[i]->codegen(cc);
-          llvm::Value *gep = cc.Builder->CreateGEP(
-              arrayType, alloca,
-              {cc.Builder->getInt32(0), cc.Builder->getInt32(i)}, "elemptr");
-          cc.Builder->CreateStore(elemVal, gep);
-        }
-      }
+      copyArray(*val, alloca, arrayType, Type.element(), cc);
     } else {
-      for (unsigned i = 0; i < *arraySize; ++i) {
-        llvm::Value *gep = cc.Builder->CreateGEP(
-            arrayType, alloca,
-            {cc.Builder->getInt32(0), cc.Builder->getInt32(i)});
-        llvm::Value *zero = llvm::ConstantInt::get(elementType, 0);
-        cc.Builder->CreateStore(zero, gep);
-      }
+      const llvm::DataLayout &DL = cc.Module->getDataLayout();
+      cc.Builder->CreateMemSet(
+          alloca, cc.Builder->getInt8(0),
+          cc.Builder->getInt64(DL.getTypeAllocSize(arrayType)),
+          alloca->getAlign());
     }
 
+  } else if (Type.isStruct() && val) {
+    alloca = cc.createEntryAlloca(varType, name);
+    cc.startLifetime(alloca);
+    copyStruct(*val, alloca, alloca->getAlign(), cc);
+
   } else {
-    // Scalar or single-element array treated as scalar
-    alloca = cc.Builder->CreateAlloca(elementType, nullptr, name);
+    alloca = cc.createEntryAlloca(varType, name);
+    cc.startLifetime(alloca);
     llvm::Value *initVal =
-        val ? val->codegen(cc) : llvm::Constant::getNullValue(elementType);
+        val ? valueAs(*val, Type, cc) : llvm::Constant::getNullValue(varType);
     cc.Builder->CreateStore(initVal, alloca);
   }
 
-  llvm::Type *pointeeType = nullptr;
-  if (elementType->isPointerTy()) {
-    Token baseTypeToken;
-    baseTypeToken.value =
-        Type.value.substr(0, Type.value.size() - 7); // strip "POINTER"
-    pointeeType = GetTypeNonVoid(baseTypeToken, cc);
-  }
-  cc.addVariable(name, alloca, elementType, pointeeType);
+  llvm::Type *pointeeType = Type.isPointer() ? lowerPointee(Type, cc) : nullptr;
+  cc.addVariable(sym, alloca, varType, pointeeType);
   return alloca;
 }
 
 llvm::Value *AssignmentNode::codegen(CodegenContext &cc) {
-  llvm::Value *var = cc.lookup(name);
+  const VWT *var = cc.lookup(sym);
   if (!var) {
     llvm::errs() << "Error: variable '" << name << "' not declared!\n";
     return nullptr; // prevents cast crash
   }
 
-  llvm::Value *valueVal = val->codegen(cc);
+  if (sym->type.isArray()) {
+    copyArray(*val, var->val, llvm::cast<llvm::ArrayType>(var->type),
+              sym->type.element(), cc);
+    return nullptr;
+  }
+  if (sym->type.isStruct()) {
+    copyStruct(*val, var->val,
+               cc.Module->getDataLayout().getABITypeAlign(var->type), cc);
+    return nullptr;
+  }
+
+  llvm::Value *valueVal = valueAs(*val, sym->type, cc);
   if (!valueVal) {
     llvm::errs() << "Error IN ASSINGMENT NODE: RHS expression returned null!\n";
     return nullptr;
   }
 
   // Store the value into the existing alloca
-  return cc.Builder->CreateStore(valueVal, var);
+  return cc.Builder->CreateStore(valueVal, var->val);
 }
 
 llvm::Value *ReturnNode::codegen(CodegenContext &cc) {
   if (expr) {
-    llvm::Value *retVal = expr->codegen(cc);
+    llvm::Value *retVal = valueAs(*expr, retType, cc);
     return cc.Builder->CreateRet(retVal);
   } else {
     return cc.Builder->CreateRetVoid();
@@ -186,8 +612,7 @@ llvm::Value *ReturnNode::codegen(CodegenContext &cc) {
 llvm::Value *CompoundNode::codegen(CodegenContext &cc) {
   llvm::Value *last = nullptr;
 
-  cc.pushScope();
-
+  cc.pushLifetimeScope();
   for (auto &stmt : blocks) {
     if (!stmt)
       continue;
@@ -200,53 +625,61 @@ llvm::Value *CompoundNode::codegen(CodegenContext &cc) {
     if (cc.Builder->GetInsertBlock()->getTerminator())
       break;
   }
+  cc.popLifetimeScope();
 
-  cc.popScope();
   return last;
 }
 
-llvm::Value *FunctionNode::codegen(CodegenContext &cc) {
+void FunctionNode::declare(CodegenContext &cc) {
   std::vector<llvm::Type *> argTypes;
   for (auto &a : args)
-    argTypes.push_back(std::get<1>(a)); // was a.second
+    argTypes.push_back(lowerType(std::get<1>(a), cc));
 
-  llvm::Type *retTy = GetTypeVoid(ReturnType, cc);
+  llvm::Type *retTy = lowerType(ReturnType, cc);
   auto *FT = llvm::FunctionType::get(retTy, argTypes, isVaridic);
   auto *Fn = llvm::Function::Create(FT, llvm::Function::ExternalLinkage, name,
                                     cc.Module.get());
 
+  unsigned i = 0;
+  for (auto &arg : Fn->args())
+    arg.setName(std::get<0>(args[i++]));
+}
+
+llvm::Value *FunctionNode::codegen(CodegenContext &cc) {
+  llvm::Function *Fn = cc.Module->getFunction(name);
+  if (!Fn) {
+    declare(cc);
+    Fn = cc.Module->getFunction(name);
+  }
+  llvm::Type *retTy = Fn->getReturnType();
+
   auto *BB = llvm::BasicBlock::Create(*cc.TheContext, "entry", Fn);
   cc.Builder->SetInsertPoint(BB);
-  cc.pushScope();
+
+  llvm::FastMathFlags FMF;
+  if (fastMath || cc.FastMath)
+    FMF.setFast();
+  cc.Builder->setFastMathFlags(FMF);
+  cc.BoundsChecks = !unchecked;
+  cc.TrapBB = nullptr;
+  cc.CheckedRanges.clear();
+
+  std::vector<VWT> outerLocals = std::move(cc.Locals);
+  cc.Locals.assign(locals.size(), VWT{});
+  cc.LiveScopes.clear();
+  cc.LoopScopeDepth = 0;
 
   unsigned i = 0;
   for (auto &arg : Fn->args()) {
-    const auto &argName = std::get<0>(args[i]);      // was args[i].first
-    llvm::Type *declaredType = std::get<1>(args[i]); // was args[i].second
-    i++;
+    const Symbol &param = *locals[i++];
 
-    arg.setName(argName);
     llvm::Type *argType = arg.getType();
-    auto *alloca = cc.Builder->CreateAlloca(argType, nullptr, argName);
+    auto *alloca = cc.createEntryAlloca(argType, param.name);
     cc.Builder->CreateStore(&arg, alloca);
 
-    llvm::Type *pointeeType = nullptr;
-    if (argType->isPointerTy()) {
-      auto &ctx = *cc.TheContext;
-      if (declaredType == llvm::PointerType::get(llvm::Type::getInt8Ty(ctx), 0))
-        pointeeType = llvm::Type::getInt8Ty(ctx);
-      else if (declaredType ==
-               llvm::PointerType::get(llvm::Type::getInt32Ty(ctx), 0))
-        pointeeType = llvm::Type::getInt32Ty(ctx);
-      else if (declaredType ==
-               llvm::PointerType::get(llvm::Type::getFloatTy(ctx), 0))
-        pointeeType = llvm::Type::getFloatTy(ctx);
-      else if (declaredType ==
-               llvm::PointerType::get(llvm::Type::getInt1Ty(ctx), 0))
-        pointeeType = llvm::Type::getInt1Ty(ctx);
-    }
-
-    cc.addVariable(argName, alloca, argType, pointeeType);
+    llvm::Type *pointeeType =
+        param.type.isPointer() ? lowerPointee(param.type, cc) : nullptr;
+    cc.addVariable(&param, alloca, argType, pointeeType);
   }
 
   llvm::Value *retVal = content->codegen(cc);
@@ -257,44 +690,30 @@ llvm::Value *FunctionNode::codegen(CodegenContext &cc) {
       cc.Builder->CreateRetVoid();
     } else {
       if (!retVal) {
-        Fn->eraseFromParent();
-        cc.popScope();
-        return nullptr;
+        // Other functions may already call this one, so keep the
+        // declaration and drop only the body.
+        Fn->deleteBody();
+        cc.Locals = std::move(outerLocals);
+        throw std::runtime_error("function '" + name +
+                                 "' does not return a value");
       }
       cc.Builder->CreateRet(retVal);
     }
   }
 
   llvm::verifyFunction(*Fn);
-  cc.popScope();
+  cc.Locals = std::move(outerLocals);
   return Fn;
 }
 
 llvm::Value *VariableReferenceNode::codegen(CodegenContext &cc) {
-  llvm::Value *var = cc.lookup(Name);
+  const VWT *var = cc.lookup(sym);
   if (!var)
     throw std::runtime_error("Unknown variable: " + Name);
+  if (var->isValue)
+    return var->val;
 
-  if (!var->getType()->isPointerTy())
-    return var;
-
-  llvm::errs() << "Var type: ";
-  var->getType()->print(llvm::errs());
-  llvm::errs() << "\n";
-
-  llvm::Type *elemTy = nullptr;
-
-  if (auto *AI = llvm::dyn_cast<llvm::AllocaInst>(var))
-    elemTy = AI->getAllocatedType();
-  else if (auto *GV = llvm::dyn_cast<llvm::GlobalVariable>(var))
-    elemTy = GV->getValueType();
-  else if (auto *GEP = llvm::dyn_cast<llvm::GetElementPtrInst>(var))
-    elemTy = GEP->getResultElementType();
-  else
-    throw std::runtime_error("Cannot determine element type of variable: " +
-                             Name);
-
-  return cc.Builder->CreateLoad(elemTy, var, Name);
+  return cc.Builder->CreateLoad(var->type, var->val, Name);
 }
 
 // llvm::Value *VariableReferenceNode::codegen(CodegenContext &cc) {
@@ -346,17 +765,21 @@ llvm::Value *WhileNode::codegen(CodegenContext &cc) {
 
   llvm::BasicBlock *oldBreak = cc.BreakBB;
   llvm::BasicBlock *oldCont = cc.ContinueBB;
+  size_t oldDepth = cc.LoopScopeDepth;
   cc.BreakBB = afterBB;
   cc.ContinueBB = condBB;
+  cc.LoopScopeDepth = cc.LiveScopes.size();
 
   if (!body->codegen(cc)) {
     cc.BreakBB = oldBreak;
     cc.ContinueBB = oldCont;
+    cc.LoopScopeDepth = oldDepth;
     return nullptr;
   }
 
   cc.BreakBB = oldBreak;
   cc.ContinueBB = oldCont;
+  cc.LoopScopeDepth = oldDepth;
 
   if (!cc.Builder->GetInsertBlock()->getTerminator())
     cc.Builder->CreateBr(condBB);
@@ -392,18 +815,14 @@ llvm::Value *IfNode::codegen(CodegenContext &cc) {
 
   // --- then ---
   cc.Builder->SetInsertPoint(thenBB);
-  cc.pushScope();
   thenBlock->codegen(cc);
-  cc.popScope();
   if (!cc.Builder->GetInsertBlock()->getTerminator()) // ← ADD THIS CHECK
     cc.Builder->CreateBr(mergeBB);
 
   // --- else ---
   if (elseBB) {
     cc.Builder->SetInsertPoint(elseBB);
-    cc.pushScope();
     elseBlock->codegen(cc);
-    cc.popScope();
     if (!cc.Builder->GetInsertBlock()->getTerminator()) // ← AND THIS
       cc.Builder->CreateBr(mergeBB);
   }
@@ -463,133 +882,182 @@ llvm::Value *IfNode::codegen(CodegenContext &cc) {
 //   return nullptr;
 // }
 
-llvm::Value *BinaryOperationNode::codegen(CodegenContext &cc) {
-  llvm::Value *LHS = Left->codegen(cc);
-  llvm::Value *RHS = Right->codegen(cc);
-
-  if (!LHS || !RHS)
-    throw std::runtime_error("null operand in binary operation");
-
-  LHS->getType()->print(llvm::errs());
-  llvm::errs() << "\n";
-  RHS->getType()->print(llvm::errs());
-  llvm::errs() << "\n";
-
-  switch (Type) {
+static llvm::Value *toBool(llvm::Value *v, CodegenContext &cc,
+                           const char *name) {
+  if (v->getType()->isIntegerTy(1))
+    return v;
+  return cc.Builder->CreateICmpNE(v, llvm::ConstantInt::get(v->getType(), 0),
+                                  name);
+}
 
-  case TokenType::PLUS:
-  case TokenType::MINUS:
-  case TokenType::STAR:
-  case TokenType::SLASH: {
-    // If either operand is i1, promote to i32
-    auto *i32 = llvm::Type::getInt32Ty(*cc.TheContext);
-    if (LHS->getType()->isIntegerTy(1))
-      LHS = cc.Builder->CreateIntCast(LHS, i32, true);
-    if (RHS->getType()->isIntegerTy(1))
-      RHS = cc.Builder->CreateIntCast(RHS, i32, true);
-
-    // If types still mismatch, cast RHS to match LHS
-    if (LHS->getType() != RHS->getType()) {
-      if (LHS->getType()->isIntegerTy() && RHS->getType()->isIntegerTy()) {
-        RHS = cc.Builder->CreateIntCast(RHS, LHS->getType(), true);
-      } else {
-        throw std::runtime_error(
-            "Cannot perform arithmetic on incompatible types");
-      }
+// True if evaluating node cannot trap, has no side effects and costs about
+// as much as the branch it would save: literals, locals and non-trapping
+// arithmetic on them. Loads through arrays and pointers are excluded, since
+// the whole point of `i < n && buf[i] != 0` is not to perform them.
+static bool isCheapAndPure(ast *node, unsigned budget = 4) {
+  if (budget == 0)
+    return false;
+  if (dynamic_cast<IntegerNode *>(node) || dynamic_cast<CharNode *>(node) ||
+      dynamic_cast<BooleanNode *>(node) || dynamic_cast<FloatNode *>(node) ||
+      dynamic_cast<VariableReferenceNode *>(node))
+    return true;
+  if (auto *n = dynamic_cast<CastNode *>(node))
+    return isCheapAndPure(n->Value.get(), budget - 1);
+  if (auto *n = dynamic_cast<UnaryOperationNode *>(node))
+    return isCheapAndPure(n->Operand.get(), budget - 1);
+  if (auto *n = dynamic_cast<BinaryOperationNode *>(node)) {
+    // Division traps on zero, and the logical operators branch themselves.
+    switch (n->Type) {
+    case TokenType::SLASH:
+    case TokenType::PERCENT:
+    case TokenType::AND:
+    case TokenType::OR:
+      return false;
+    default:
+      return isCheapAndPure(n->Left.get(), budget - 1) &&
+             isCheapAndPure(n->Right.get(), budget - 1);
     }
-
-    if (Type == TokenType::PLUS)
-      return cc.Builder->CreateAdd(LHS, RHS, "addtmp");
-    if (Type == TokenType::MINUS)
-      return cc.Builder->CreateSub(LHS, RHS, "subtmp");
-    if (Type == TokenType::STAR)
-      return cc.Builder->CreateMul(LHS, RHS, "multmp");
-    if (Type == TokenType::SLASH)
-      return cc.Builder->CreateSDiv(LHS, RHS, "divtmp");
   }
+  return false;
+}
 
-  case TokenType::EQEQ: {
-    if (LHS->getType() != RHS->getType()) {
-      if (LHS->getType()->isIntegerTy() && RHS->getType()->isIntegerTy()) {
-        RHS = cc.Builder->CreateIntCast(RHS, LHS->getType(), true);
-      } else {
-        throw std::runtime_error("Cannot compare incompatible types");
-      }
-    }
-
-    return cc.Builder->CreateICmpEQ(LHS, RHS, "eqtmp");
+// && and || evaluate the right operand only when the left one does not
+// already decide the result.
+static llvm::Value *codegenLogical(BinaryOperationNode &op,
+                                   CodegenContext &cc) {
+  bool isAnd = op.Type == TokenType::AND;
+  llvm::Value *LHS = toBool(op.Left->codegen(cc), cc, "lhsbool");
+
+  // A cheap right side is cheaper to compute than to branch around.
+  if (isCheapAndPure(op.Right.get())) {
+    llvm::Value *RHS = toBool(op.Right->codegen(cc), cc, "rhsbool");
+    return isAnd ? cc.Builder->CreateSelect(LHS, RHS, cc.Builder->getFalse(),
+                                            "andtmp")
+                 : cc.Builder->CreateSelect(LHS, cc.Builder->getTrue(), RHS,
+                                            "ortmp");
   }
 
-  case TokenType::NOTEQ: {
-    if (LHS->getType() != RHS->getType()) {
-      if (LHS->getType()->isIntegerTy() && RHS->getType()->isIntegerTy()) {
-        RHS = cc.Builder->CreateIntCast(RHS, LHS->getType(), true);
-      } else {
-        throw std::runtime_error("Cannot compare incompatible types");
-      }
-    }
+  llvm::Function *func = cc.Builder->GetInsertBlock()->getParent();
+  llvm::BasicBlock *lhsBB = cc.Builder->GetInsertBlock();
+  llvm::BasicBlock *rhsBB = llvm::BasicBlock::Create(
+      *cc.TheContext, isAnd ? "and.rhs" : "or.rhs", func);
+  llvm::BasicBlock *mergeBB = llvm::BasicBlock::Create(
+      *cc.TheContext, isAnd ? "and.end" : "or.end", func);
+
+  if (isAnd)
+    cc.Builder->CreateCondBr(LHS, rhsBB, mergeBB);
+  else
+    cc.Builder->CreateCondBr(LHS, mergeBB, rhsBB);
 
-    return cc.Builder->CreateICmpNE(LHS, RHS, "netmp");
-  }
-  case TokenType::AND: {
-    // Convert LHS to i1 if needed
-    if (!LHS->getType()->isIntegerTy(1))
-      LHS = cc.Builder->CreateICmpNE(
-          LHS, llvm::ConstantInt::get(LHS->getType(), 0), "lhsbool");
+  cc.Builder->SetInsertPoint(rhsBB);
+  llvm::Value *RHS = toBool(op.Right->codegen(cc), cc, "rhsbool");
+  rhsBB = cc.Builder->GetInsertBlock();
+  cc.Builder->CreateBr(mergeBB);
 
-    // Convert RHS to i1 if needed
-    if (!RHS->getType()->isIntegerTy(1))
-      RHS = cc.Builder->CreateICmpNE(
-          RHS, llvm::ConstantInt::get(RHS->getType(), 0), "rhsbool");
+  cc.Builder->SetInsertPoint(mergeBB);
+  llvm::PHINode *phi = cc.Builder->CreatePHI(cc.Builder->getInt1Ty(), 2,
+                                             isAnd ? "andtmp" : "ortmp");
+  phi->addIncoming(isAnd ? cc.Builder->getFalse() : cc.Builder->getTrue(),
+                   lhsBB);
+  phi->addIncoming(RHS, rhsBB);
+  return phi;
+}
 
-    return cc.Builder->CreateAnd(LHS, RHS, "andtmp");
-  }
-  case TokenType::GTE: {
-    if (LHS->getType() != RHS->getType()) {
-      if (LHS->getType()->isIntegerTy() && RHS->getType()->isIntegerTy()) {
-        RHS = cc.Builder->CreateIntCast(RHS, LHS->getType(), true);
-      } else {
-        throw std::runtime_error("Cannot compare incompatible types");
-      }
-    }
-    return cc.Builder->CreateICmpSGE(LHS, RHS,
-                                     "gtetmp"); // signed greater or equal
-  }
+llvm::Value *BinaryOperationNode::codegen(CodegenContext &cc) {
+  if (Type == TokenType::AND || Type == TokenType::OR)
+    return codegenLogical(*this, cc);
 
-  case TokenType::LTE: {
-    if (LHS->getType() != RHS->getType()) {
-      if (LHS->getType()->isIntegerTy() && RHS->getType()->isIntegerTy()) {
-        RHS = cc.Builder->CreateIntCast(RHS, LHS->getType(), true);
-      } else {
-        throw std::runtime_error("Cannot compare incompatible types");
-      }
-    }
-    return cc.Builder->CreateICmpSLE(LHS, RHS,
-                                     "ltetmp"); // signed less or equal
-  }
+  llvm::Value *LHS = Left->codegen(cc);
+  llvm::Value *RHS = Right->codegen(cc);
 
-  case TokenType::GT: {
-    if (LHS->getType() != RHS->getType()) {
-      if (LHS->getType()->isIntegerTy() && RHS->getType()->isIntegerTy()) {
-        RHS = cc.Builder->CreateIntCast(RHS, LHS->getType(), true);
-      } else {
-        throw std::runtime_error("Cannot compare incompatible types");
-      }
-    }
-    return cc.Builder->CreateICmpSGT(LHS, RHS, "gttmp"); // signed greater than
+  if (!LHS || !RHS)
+    throw std::runtime_error("null operand in binary operation");
+
+  // Sema picked the common operand type; bring both sides to it. On vectors
+  // a scalar side is splatted and every operator works lane-wise.
+  llvm::Type *opTy = lowerType(operandType, cc);
+  if (operandType.isVector()) {
+    LHS = convertScalar(LHS, Left->exprType, operandType, cc);
+    RHS = convertScalar(RHS, Right->exprType, operandType, cc);
+  } else {
+    LHS = castValue(*cc.Builder, LHS, opTy, !Left->exprType.isUnsigned());
+    RHS = castValue(*cc.Builder, RHS, opTy, !Right->exprType.isUnsigned());
   }
 
-  case TokenType::LT: {
-    if (LHS->getType() != RHS->getType()) {
-      if (LHS->getType()->isIntegerTy() && RHS->getType()->isIntegerTy()) {
-        RHS = cc.Builder->CreateIntCast(RHS, LHS->getType(), true);
-      } else {
-        throw std::runtime_error("Cannot compare incompatible types");
-      }
+  // Fast-math flags, if enabled, come from the builder.
+  if (opTy->isFPOrFPVectorTy()) {
+    switch (Type) {
+    case TokenType::PLUS:
+      return cc.Builder->CreateFAdd(LHS, RHS, "faddtmp");
+    case TokenType::MINUS:
+      return cc.Builder->CreateFSub(LHS, RHS, "fsubtmp");
+    case TokenType::STAR:
+      return cc.Builder->CreateFMul(LHS, RHS, "fmultmp");
+    case TokenType::SLASH:
+      return cc.Builder->CreateFDiv(LHS, RHS, "fdivtmp");
+    case TokenType::PERCENT:
+      return cc.Builder->CreateFRem(LHS, RHS, "fremtmp");
+    // Ordered compares are false on NaN; != is the unordered one, so that
+    // it stays the negation of ==.
+    case TokenType::EQEQ:
+      return cc.Builder->CreateFCmpOEQ(LHS, RHS, "feqtmp");
+    case TokenType::NOTEQ:
+      return cc.Builder->CreateFCmpUNE(LHS, RHS, "fnetmp");
+    case TokenType::GTE:
+      return cc.Builder->CreateFCmpOGE(LHS, RHS, "fgtetmp");
+    case TokenType::LTE:
+      return cc.Builder->CreateFCmpOLE(LHS, RHS, "fltetmp");
+    case TokenType::GT:
+      return cc.Builder->CreateFCmpOGT(LHS, RHS, "fgttmp");
+    case TokenType::LT:
+      return cc.Builder->CreateFCmpOLT(LHS, RHS, "flttmp");
+    default:
+      throw std::runtime_error("Unknown binary operator " +
+                               std::string(tokenName(Type)));
     }
-    return cc.Builder->CreateICmpSLT(LHS, RHS, "lttmp"); // signed less than
   }
 
+  bool isUnsigned = operandType.scalar().isUnsigned();
+  switch (Type) {
+  case TokenType::PLUS:
+    return cc.Builder->CreateAdd(LHS, RHS, "addtmp");
+  case TokenType::MINUS:
+    return cc.Builder->CreateSub(LHS, RHS, "subtmp");
+  case TokenType::STAR:
+    return cc.Builder->CreateMul(LHS, RHS, "multmp");
+  case TokenType::SLASH:
+    return isUnsigned ? cc.Builder->CreateUDiv(LHS, RHS, "divtmp")
+                      : cc.Builder->CreateSDiv(LHS, RHS, "divtmp");
+  case TokenType::PERCENT:
+    return isUnsigned ? cc.Builder->CreateURem(LHS, RHS, "remtmp")
+                      : cc.Builder->CreateSRem(LHS, RHS, "remtmp");
+  case TokenType::ANDPERCENT:
+    return cc.Builder->CreateAnd(LHS, RHS, "bandtmp");
+  case TokenType::PIPE:
+    return cc.Builder->CreateOr(LHS, RHS, "bortmp");
+  case TokenType::CARET:
+    return cc.Builder->CreateXor(LHS, RHS, "xortmp");
+  case TokenType::SHL:
+    return cc.Builder->CreateShl(LHS, RHS, "shltmp");
+  case TokenType::SHR:
+    return isUnsigned ? cc.Builder->CreateLShr(LHS, RHS, "shrtmp")
+                      : cc.Builder->CreateAShr(LHS, RHS, "shrtmp");
+  case TokenType::EQEQ:
+    return cc.Builder->CreateICmpEQ(LHS, RHS, "eqtmp");
+  case TokenType::NOTEQ:
+    return cc.Builder->CreateICmpNE(LHS, RHS, "netmp");
+  case TokenType::GTE:
+    return isUnsigned ? cc.Builder->CreateICmpUGE(LHS, RHS, "gtetmp")
+                      : cc.Builder->CreateICmpSGE(LHS, RHS, "gtetmp");
+  case TokenType::LTE:
+    return isUnsigned ? cc.Builder->CreateICmpULE(LHS, RHS, "ltetmp")
+                      : cc.Builder->CreateICmpSLE(LHS, RHS, "ltetmp");
+  case TokenType::GT:
+    return isUnsigned ? cc.Builder->CreateICmpUGT(LHS, RHS, "gttmp")
+                      : cc.Builder->CreateICmpSGT(LHS, RHS, "gttmp");
+  case TokenType::LT:
+    return isUnsigned ? cc.Builder->CreateICmpULT(LHS, RHS, "lttmp")
+                      : cc.Builder->CreateICmpSLT(LHS, RHS, "lttmp");
   default:
     throw std::runtime_error("Unknown binary operator " +
                              std::string(tokenName(Type)));
@@ -661,27 +1129,397 @@ llvm::Value *BinaryOperationNode::codegen(CodegenContext &cc) {
 //   }
 // }
 
+llvm::Value *UnaryOperationNode::codegen(CodegenContext &cc) {
+  llvm::Value *v =
+      convertScalar(Operand->codegen(cc), Operand->exprType, exprType, cc);
+  return cc.Builder->CreateNot(v, "nottmp");
+}
+
 llvm::Value *BreakNode::codegen(CodegenContext &cc) {
   if (!cc.BreakBB) {
     std::cerr << "Error: 'break' not inside a loop.\n";
     return nullptr;
   }
+  cc.endLifetimes(cc.LoopScopeDepth);
   return cc.Builder->CreateBr(cc.BreakBB);
 }
 
+// Address of element i of the array variable or pointer in args[0], for
+// vector loads and stores.
+static llvm::Value *elementAddress(CallNode &call, unsigned lanes,
+                                   CodegenContext &cc) {
+  llvm::IRBuilder<> &B = *cc.Builder;
+  ast &base = *call.args[0];
+  llvm::Type *elemTy = lowerType(base.exprType.element(), cc);
+  llvm::Value *ptr;
+  if (base.exprType.isArray()) {
+    auto &ref = static_cast<VariableReferenceNode &>(base);
+    ptr = cc.lookup(ref.sym)->val;
+  } else {
+    ptr = base.codegen(cc);
+  }
+  llvm::Value *i = indexValue(*call.args[1], cc);
+
+  // --bounds-check: every lane has to be inside.
+  if (base.exprType.isArray() && cc.CheckArrays && cc.BoundsChecks) {
+    uint64_t n = base.exprType.count;
+    boundsCheck(lanes > n ? B.getFalse()
+                          : B.CreateICmpULE(i, B.getInt64(n - lanes),
+                                            "inbounds"),
+                cc);
+  } else if (!base.exprType.isArray()) {
+    const llvm::DataLayout &DL = cc.Module->getDataLayout();
+    checkPointerAccess(
+        ptr, B.CreateMul(i, B.getInt64(DL.getTypeAllocSize(elemTy))),
+        DL.getTypeStoreSize(llvm::FixedVectorType::get(elemTy, lanes)), cc);
+  }
+  return B.CreateGEP(elemTy, ptr, i, "vec_ptr");
+}
+
+static llvm::Value *codegenVectorBuiltin(CallNode &call, CodegenContext &cc) {
+  llvm::IRBuilder<> &B = *cc.Builder;
+  const llvm::DataLayout &DL = cc.Module->getDataLayout();
+
+  switch (call.builtin) {
+  // load/store only assume the element's alignment; aload/astore promise
+  // the address is aligned to the whole vector.
+  case Builtin::Load:
+  case Builtin::AlignedLoad: {
+    llvm::Type *ty = lowerType(call.exprType, cc);
+    llvm::Value *ptr = elementAddress(call, call.exprType.count, cc);
+    llvm::Align align = call.builtin == Builtin::Load
+                            ? DL.getABITypeAlign(ty->getScalarType())
+                            : llvm::Align(DL.getTypeStoreSize(ty));
+    return B.CreateAlignedLoad(ty, ptr, align, "vload");
+  }
+  case Builtin::Store:
+  case Builtin::AlignedStore: {
+    llvm::Value *ptr =
+        elementAddress(call, call.args[2]->exprType.count, cc);
+    llvm::Value *v = call.args[2]->codegen(cc);
+    llvm::Type *ty = v->getType();
+    llvm::Align align = call.builtin == Builtin::Store
+                            ? DL.getABITypeAlign(ty->getScalarType())
+                            : llvm::Align(DL.getTypeStoreSize(ty));
+    B.CreateAlignedStore(v, ptr, align);
+    return nullptr;
+  }
+
+  case Builtin::Shuffle: {
+    llvm::Value *a = call.args[0]->codegen(cc);
+    size_t first = 1;
+    llvm::Value *b = nullptr;
+    if (call.args[1]->exprType == call.args[0]->exprType) {
+      b = call.args[1]->codegen(cc);
+      first = 2;
+    }
+    llvm::SmallVector<int, 16> mask;
+    for (size_t i = first; i < call.args.size(); ++i)
+      mask.push_back(static_cast<IntegerNode &>(*call.args[i]).val);
+    return b ? B.CreateShuffleVector(a, b, mask, "shuffle")
+             : B.CreateShuffleVector(a, mask, "shuffle");
+  }
+
+  default:
+    break;
+  }
+
+  // Horizontal reductions. Float add and mul are reassociable so they
+  // lower to a shuffle tree rather than a serial chain.
+  llvm::Value *v = call.args[0]->codegen(cc);
+  const BType &lane = call.args[0]->exprType.element();
+  llvm::Type *laneTy = v->getType()->getScalarType();
+  bool isFloat = lane.isFloat();
+  bool isSigned = !lane.isUnsigned();
+
+  switch (call.builtin) {
+  case Builtin::ReduceAdd:
+    if (isFloat) {
+      auto *r =
+          B.CreateFAddReduce(llvm::ConstantFP::getNegativeZero(laneTy), v);
+      llvm::cast<llvm::Instruction>(r)->setHasAllowReassoc(true);
+      return r;
+    }
+    return B.CreateAddReduce(v);
+  case Builtin::ReduceMul:
+    if (isFloat) {
+      auto *r = B.CreateFMulReduce(llvm::ConstantFP::get(laneTy, 1.0), v);
+      llvm::cast<llvm::Instruction>(r)->setHasAllowReassoc(true);
+      return r;
+    }
+    return B.CreateMulReduce(v);
+  case Builtin::ReduceMin:
+    return isFloat ? B.CreateFPMinReduce(v) : B.CreateIntMinReduce(v, isSigned);
+  case Builtin::ReduceMax:
+    return isFloat ? B.CreateFPMaxReduce(v) : B.CreateIntMaxReduce(v, isSigned);
+  case Builtin::ReduceAnd:
+    return B.CreateAndReduce(v);
+  case Builtin::ReduceOr:
+    return B.CreateOrReduce(v);
+  case Builtin::ReduceXor:
+    return B.CreateXorReduce(v);
+  default:
+    throw std::runtime_error("Unknown builtin: " + call.name);
+  }
+}
+
+static llvm::Value *codegenSliceBuiltin(CallNode &call, CodegenContext &cc) {
+  ast &x = *call.args[0];
+  if (call.builtin == Builtin::MakeSlice) {
+    llvm::Value *len = cc.Builder->CreateIntCast(
+        call.args[1]->codegen(cc), cc.Builder->getInt64Ty(),
+        !call.args[1]->exprType.isUnsigned());
+    return makeSlice(x.codegen(cc), len, cc);
+  }
+  // An array's length is its type's; the array itself is not evaluated.
+  if (x.exprType.isArray())
+    return cc.Builder->getInt64(x.exprType.count);
+  return cc.Builder->CreateExtractValue(x.codegen(cc), 1, "len");
+}
+
+// Pointer and byte count of the text argument of write or append_file; see
+// analyzeTextArgs. A Char is spilled so it has an address.
+static std::pair<llvm::Value *, llvm::Value *> textArgs(CallNode &call,
+                                                       CodegenContext &cc) {
+  llvm::IRBuilder<> &B = *cc.Builder;
+  if (call.args[1]->exprType.kind == BType::Char) {
+    llvm::AllocaInst *c = cc.createEntryAlloca(B.getInt8Ty(), "char");
+    B.CreateStore(call.args[1]->codegen(cc), c);
+    return {c, B.getInt64(1)};
+  }
+  if (call.args.size() == 2) {
+    llvm::Value *text = valueAs(*call.args[1], BType::sliceOf(BType::Char), cc);
+    return {B.CreateExtractValue(text, 0), B.CreateExtractValue(text, 1)};
+  }
+  llvm::Value *data = call.args[1]->codegen(cc);
+  return {data, B.CreateIntCast(call.args[2]->codegen(cc), B.getInt64Ty(),
+                                !call.args[2]->exprType.isUnsigned())};
+}
+
+static llvm::Value *codegenOutputBuiltin(CallNode &call,
+                                         CodegenContext &cc) {
+  llvm::IRBuilder<> &B = *cc.Builder;
+  llvm::Type *i32 = B.getInt32Ty();
+  llvm::Type *i64 = B.getInt64Ty();
+  llvm::Type *ptrTy = llvm::PointerType::get(*cc.TheContext, 0);
+  llvm::Value *fd = B.CreateIntCast(call.args[0]->codegen(cc), i32,
+                                    !call.args[0]->exprType.isUnsigned());
+
+  if (call.builtin == Builtin::Flush) {
+    B.CreateCall(cc.Module->getOrInsertFunction("basiq_flush", B.getVoidTy(),
+                                                i32),
+                 {fd});
+    return nullptr;
+  }
+  if (call.builtin == Builtin::SetBuffering) {
+    llvm::Value *mode = B.CreateIntCast(call.args[1]->codegen(cc), i32,
+                                        !call.args[1]->exprType.isUnsigned());
+    B.CreateCall(cc.Module->getOrInsertFunction("basiq_set_buffering",
+                                                B.getVoidTy(), i32, i32),
+                 {fd, mode});
+    return nullptr;
+  }
+
+  auto [data, len] = textArgs(call, cc);
+  B.CreateCall(cc.Module->getOrInsertFunction("basiq_write", B.getVoidTy(),
+                                              i32, ptrTy, i64),
+               {fd, data, len});
+  return nullptr;
+}
+
+// Each aio_* builtin is a direct call to its basiq_aio_* function, with the
+// integer arguments converted to the parameter types.
+static llvm::Value *codegenAsyncBuiltin(CallNode &call, CodegenContext &cc) {
+  llvm::IRBuilder<> &B = *cc.Builder;
+  llvm::Type *i32 = B.getInt32Ty();
+  llvm::Type *i64 = B.getInt64Ty();
+  llvm::Type *ptrTy = llvm::PointerType::get(*cc.TheContext, 0);
+
+  const char *name;
+  std::vector<llvm::Type *> params;
+  llvm::Type *result = i32;
+  switch (call.builtin) {
+  case Builtin::AioRead:
+    name = "basiq_aio_read";
+    params = {i32, ptrTy, i64, i64};
+    break;
+  case Builtin::AioWrite:
+    name = "basiq_aio_write";
+    params = {i32, ptrTy, i64, i64};
+    break;
+  case Builtin::AioOpen:
+    name = "basiq_aio_open";
+    params = {ptrTy, i32};
+    break;
+  case Builtin::AioClose:
+    name = "basiq_aio_close";
+    params = {i32};
+    break;
+  case Builtin::AioSubmit:
+    name = "basiq_aio_submit";
+    break;
+  case Builtin::AioPoll:
+    name = "basiq_aio_poll";
+    break;
+  default:
+    name = "basiq_aio_wait";
+    params = {i32};
+    result = i64;
+    break;
+  }
+
+  std::vector<llvm::Value *> args;
+  for (size_t i = 0; i < params.size(); ++i) {
+    llvm::Value *v = call.args[i]->codegen(cc);
+    if (params[i]->isIntegerTy())
+      v = B.CreateIntCast(v, params[i], !call.args[i]->exprType.isUnsigned());
+    args.push_back(v);
+  }
+  return B.CreateCall(cc.Module->getOrInsertFunction(
+                          name, llvm::FunctionType::get(result, params, false)),
+                      args);
+}
+
+static llvm::Value *codegenFileBuiltin(CallNode &call, CodegenContext &cc) {
+  llvm::IRBuilder<> &B = *cc.Builder;
+  llvm::Type *voidTy = B.getVoidTy();
+  llvm::Type *i32 = B.getInt32Ty();
+  llvm::Type *i64 = B.getInt64Ty();
+  llvm::Type *ptrTy = llvm::PointerType::get(*cc.TheContext, 0);
+  auto intArg = [&](size_t i, llvm::Type *to) {
+    return B.CreateIntCast(call.args[i]->codegen(cc), to,
+                           !call.args[i]->exprType.isUnsigned());
+  };
+
+  switch (call.builtin) {
+  case Builtin::MapFile: {
+    llvm::AllocaInst *len = cc.createEntryAlloca(i64, "map.len");
+    llvm::Value *data = B.CreateCall(
+        cc.Module->getOrInsertFunction("basiq_map_file", ptrTy, ptrTy, ptrTy),
+        {call.args[0]->codegen(cc), len});
+    return makeSlice(data, B.CreateLoad(i64, len), cc);
+  }
+  case Builtin::UnmapFile:
+  case Builtin::Advise: {
+    llvm::Value *bytes =
+        valueAs(*call.args[0], BType::sliceOf(BType::Char), cc);
+    std::vector<llvm::Value *> args = {B.CreateExtractValue(bytes, 0),
+                                       B.CreateExtractValue(bytes, 1)};
+    if (call.builtin == Builtin::UnmapFile) {
+      B.CreateCall(cc.Module->getOrInsertFunction("basiq_unmap_file", voidTy,
+                                                  ptrTy, i64),
+                   args);
+      return nullptr;
+    }
+    args.push_back(intArg(1, i32));
+    B.CreateCall(cc.Module->getOrInsertFunction("basiq_advise", voidTy, ptrTy,
+                                                i64, i32),
+                 args);
+    return nullptr;
+  }
+  case Builtin::CreateFile:
+    return B.CreateCall(
+        cc.Module->getOrInsertFunction("basiq_create_file", i32, ptrTy),
+        {call.args[0]->codegen(cc)});
+  case Builtin::AppendFile: {
+    llvm::Value *file = intArg(0, i32);
+    auto [data, len] = textArgs(call, cc);
+    B.CreateCall(cc.Module->getOrInsertFunction("basiq_append_file", voidTy,
+                                                i32, ptrTy, i64),
+                 {file, data, len});
+    return nullptr;
+  }
+  default:
+    return B.CreateCall(
+        cc.Module->getOrInsertFunction("basiq_close_file", i64, i32),
+        {intArg(0, i32)});
+  }
+}
+
+static llvm::Value *codegenBuiltin(CallNode &call, CodegenContext &cc) {
+  if (call.builtin >= Builtin::AioRead)
+    return codegenAsyncBuiltin(call, cc);
+  if (call.builtin >= Builtin::MapFile)
+    return codegenFileBuiltin(call, cc);
+  if (call.builtin >= Builtin::Write)
+    return codegenOutputBuiltin(call, cc);
+  if (call.builtin >= Builtin::Len)
+    return codegenSliceBuiltin(call, cc);
+  if (call.builtin >= Builtin::Shuffle)
+    return codegenVectorBuiltin(call, cc);
+
+  llvm::IRBuilder<> &B = *cc.Builder;
+  llvm::Value *x = call.args[0]->codegen(cc);
+  llvm::Type *ty = x->getType();
+
+  switch (call.builtin) {
+  case Builtin::Popcount:
+    return B.CreateUnaryIntrinsic(llvm::Intrinsic::ctpop, x, nullptr,
+                                  "popcount");
+  // Zero input is defined and gives the bit width.
+  case Builtin::Clz:
+    return B.CreateBinaryIntrinsic(llvm::Intrinsic::ctlz, x, B.getFalse(),
+                                   nullptr, "clz");
+  case Builtin::Ctz:
+    return B.CreateBinaryIntrinsic(llvm::Intrinsic::cttz, x, B.getFalse(),
+                                   nullptr, "ctz");
+  case Builtin::Bswap:
+    return B.CreateUnaryIntrinsic(llvm::Intrinsic::bswap, x, nullptr, "bswap");
+  // A funnel shift of x with itself is a rotate; the amount is taken
+  // modulo the bit width.
+  case Builtin::Rotl:
+  case Builtin::Rotr: {
+    llvm::Value *n = B.CreateIntCast(call.args[1]->codegen(cc), ty, false);
+    auto id = call.builtin == Builtin::Rotl ? llvm::Intrinsic::fshl
+                                            : llvm::Intrinsic::fshr;
+    return B.CreateIntrinsic(id, {ty}, {x, x, n}, nullptr, call.name);
+  }
+  default:
+    throw std::runtime_error("Unknown builtin: " + call.name);
+  }
+}
+
 llvm::Value *CallNode::codegen(CodegenContext &cc) {
+  if (builtin != Builtin::None)
+    return codegenBuiltin(*this, cc);
+
+  // Every function was declared up front, so the callee exists even if its
+  // body comes later in the file. Library functions are declared on first
+  // use and defined when libbasiq.bc is linked in.
   llvm::Function *callee = cc.Module->getFunction(name);
+  if (!symbol.empty()) {
+    std::vector<llvm::Type *> params;
+    for (const BType &t : paramTypes)
+      params.push_back(lowerType(t, cc));
+    auto *type =
+        llvm::FunctionType::get(lowerType(exprType, cc), params, variadic);
+    callee = llvm::cast<llvm::Function>(
+        cc.Module->getOrInsertFunction(symbol, type).getCallee());
+  }
   if (!callee)
-    return nullptr;
+    throw std::runtime_error("Unknown function: " + name);
 
   //   if (callee->arg_size() != args.size())
   //     return nullptr;
 
   std::vector<llvm::Value *> argVals;
-  for (auto &arg : args) {
-    llvm::Value *v = arg->codegen(cc);
+  for (size_t i = 0; i < args.size(); i++) {
+    llvm::Value *v = i < paramTypes.size()
+                         ? valueAs(*args[i], paramTypes[i], cc)
+                         : args[i]->codegen(cc);
     if (!v)
       return nullptr;
+    // A C vararg callee reads every integer as 64 bits and every Float as a
+    // double (see basiq_printf).
+    const BType &t = args[i]->exprType;
+    if (variadic && i >= paramTypes.size()) {
+      if (t.isFloat())
+        v = cc.Builder->CreateFPExt(v, cc.Builder->getDoubleTy());
+      else if (t.isInteger())
+        v = cc.Builder->CreateIntCast(
+            v, cc.Builder->getInt64Ty(),
+            !t.isUnsigned() && t.kind != BType::Boolean);
+    }
     argVals.push_back(v);
   }
 
@@ -694,6 +1532,7 @@ llvm::Value *ContinueNode::codegen(CodegenContext &cc) {
     std::cerr << "Error: 'break' not inside a loop.\n";
     return nullptr;
   }
+  cc.endLifetimes(cc.LoopScopeDepth);
   return cc.Builder->CreateBr(cc.ContinueBB);
 }
 
@@ -707,6 +1546,8 @@ llvm::Value *ForNode::codegen(CodegenContext &cc) {
       llvm::BasicBlock::Create(*cc.TheContext, "loopcond", function);
   llvm::BasicBlock *loopBodyBB =
       llvm::BasicBlock::Create(*cc.TheContext, "loopbody", function);
+  llvm::BasicBlock *loopIncBB =
+      llvm::BasicBlock::Create(*cc.TheContext, "loopinc", function);
   llvm::BasicBlock *loopEndBB =
       llvm::BasicBlock::Create(*cc.TheContext, "loopend", function);
 
@@ -722,9 +1563,25 @@ llvm::Value *ForNode::codegen(CodegenContext &cc) {
   cc.Builder->CreateCondBr(condValue, loopBodyBB, loopEndBB);
 
   cc.Builder->SetInsertPoint(loopBodyBB);
+
+  llvm::BasicBlock *oldBreak = cc.BreakBB;
+  llvm::BasicBlock *oldCont = cc.ContinueBB;
+  size_t oldDepth = cc.LoopScopeDepth;
+  cc.BreakBB = loopEndBB;
+  cc.ContinueBB = loopIncBB;
+  cc.LoopScopeDepth = cc.LiveScopes.size();
+
   if (body)
     body->codegen(cc);
 
+  cc.BreakBB = oldBreak;
+  cc.ContinueBB = oldCont;
+  cc.LoopScopeDepth = oldDepth;
+
+  if (!cc.Builder->GetInsertBlock()->getTerminator())
+    cc.Builder->CreateBr(loopIncBB);
+
+  cc.Builder->SetInsertPoint(loopIncBB);
   if (increment)
     increment->codegen(cc);
 
@@ -737,80 +1594,593 @@ llvm::Value *ForNode::codegen(CodegenContext &cc) {
   return nullptr;
 }
 
-llvm::Value *ArrayLiteralNode::codegen(CodegenContext &cc) {
-  // Ensure there is at least one element
-  if (Elements.empty()) {
-    std::cerr << "Error: ArrayLiteralNode has no elements\n";
-    return nullptr;
+static llvm::Constant *reductionIdentity(ReduceOp op, const BType &type,
+                                         llvm::Type *ty) {
+  if (type.isFloat()) {
+    switch (op) {
+    case ReduceOp::Mul:
+      return llvm::ConstantFP::get(ty, 1.0);
+    case ReduceOp::Min:
+      return llvm::ConstantFP::getInfinity(ty, false);
+    case ReduceOp::Max:
+      return llvm::ConstantFP::getInfinity(ty, true);
+    default:
+      return llvm::ConstantFP::get(ty, 0.0);
+    }
   }
 
-  // Determine the element type from the first element
-  llvm::Value *firstElem = Elements[0]->codegen(cc);
-  if (!firstElem) {
-    std::cerr << "Error: Could not generate code for array element\n";
-    return nullptr;
+  unsigned bits = type.bits();
+  bool isUnsigned = type.isUnsigned();
+  switch (op) {
+  case ReduceOp::Mul:
+    return llvm::ConstantInt::get(ty, 1);
+  case ReduceOp::And:
+    return llvm::ConstantInt::get(ty, llvm::APInt::getAllOnes(bits));
+  case ReduceOp::Min:
+    return llvm::ConstantInt::get(ty, isUnsigned
+                                          ? llvm::APInt::getMaxValue(bits)
+                                          : llvm::APInt::getSignedMaxValue(bits));
+  case ReduceOp::Max:
+    return llvm::ConstantInt::get(ty, isUnsigned
+                                          ? llvm::APInt::getMinValue(bits)
+                                          : llvm::APInt::getSignedMinValue(bits));
+  default:
+    return llvm::ConstantInt::get(ty, 0);
   }
+}
 
-  llvm::Type *ElementType = firstElem->getType();
-  if (!ElementType) {
-    std::cerr << "Error: ElementType is null\n";
-    return nullptr;
+// Folds a chunk's partial result into the shared variable. Chunks finish
+// concurrently, so this is atomic; the runtime's join orders it before the
+// code after the loop, so monotonic ordering is enough.
+static void atomicCombine(ReduceOp op, const BType &type, llvm::Value *shared,
+                          llvm::Value *partial, CodegenContext &cc) {
+  llvm::IRBuilder<> &B = *cc.Builder;
+  auto order = llvm::AtomicOrdering::Monotonic;
+  bool isFloat = type.isFloat();
+  bool isUnsigned = type.isUnsigned();
+
+  using RMW = llvm::AtomicRMWInst;
+  std::optional<RMW::BinOp> rmw;
+  switch (op) {
+  case ReduceOp::Add:
+    rmw = isFloat ? RMW::FAdd : RMW::Add;
+    break;
+  case ReduceOp::And:
+    rmw = RMW::And;
+    break;
+  case ReduceOp::Or:
+    rmw = RMW::Or;
+    break;
+  case ReduceOp::Xor:
+    rmw = RMW::Xor;
+    break;
+  case ReduceOp::Min:
+    if (!isFloat)
+      rmw = isUnsigned ? RMW::UMin : RMW::Min;
+    break;
+  case ReduceOp::Max:
+    if (!isFloat)
+      rmw = isUnsigned ? RMW::UMax : RMW::Max;
+    break;
+  case ReduceOp::Mul:
+    break;
+  }
+  if (rmw) {
+    B.CreateAtomicRMW(*rmw, shared, partial, llvm::MaybeAlign(), order);
+    return;
   }
 
-  // Create array type
-  llvm::ArrayType *arrType = llvm::ArrayType::get(ElementType, Elements.size());
-  llvm::AllocaInst *arrayAlloc =
-      cc.Builder->CreateAlloca(arrType, nullptr, "arraytmp");
-
-  // Store each element in the allocated array
-  for (size_t i = 0; i < Elements.size(); i++) {
-    llvm::Value *elemVal = Elements[i]->codegen(cc);
-    if (!elemVal) {
-      std::cerr << "Error: Could not generate code for element at index " << i
-                << "\n";
-      continue;
+  // Everything else is a compare-and-swap loop on the integer bits.
+  llvm::Type *ty = partial->getType();
+  llvm::Type *intTy = B.getIntNTy(ty->getPrimitiveSizeInBits());
+  llvm::Function *F = B.GetInsertBlock()->getParent();
+  llvm::BasicBlock *pre = B.GetInsertBlock();
+  llvm::BasicBlock *loopBB =
+      llvm::BasicBlock::Create(*cc.TheContext, "reduce.cas", F);
+  llvm::BasicBlock *doneBB =
+      llvm::BasicBlock::Create(*cc.TheContext, "reduce.done", F);
+
+  llvm::LoadInst *initial = B.CreateLoad(intTy, shared, "reduce.old");
+  initial->setAtomic(order);
+  B.CreateBr(loopBB);
+
+  B.SetInsertPoint(loopBB);
+  llvm::PHINode *old = B.CreatePHI(intTy, 2, "reduce.seen");
+  old->addIncoming(initial, pre);
+  llvm::Value *cur = isFloat ? B.CreateBitCast(old, ty) : old;
+  llvm::Value *next;
+  if (op == ReduceOp::Mul)
+    next = isFloat ? B.CreateFMul(cur, partial) : B.CreateMul(cur, partial);
+  else if (op == ReduceOp::Min)
+    next = B.CreateMinNum(cur, partial);
+  else
+    next = B.CreateMaxNum(cur, partial);
+  if (isFloat)
+    next = B.CreateBitCast(next, intTy);
+
+  llvm::Value *pair = B.CreateAtomicCmpXchg(shared, old, next,
+                                            llvm::MaybeAlign(), order, order);
+  old->addIncoming(B.CreateExtractValue(pair, 0), loopBB);
+  B.CreateCondBr(B.CreateExtractValue(pair, 1), doneBB, loopBB);
+  B.SetInsertPoint(doneBB);
+}
+
+// True if node assigns sym, takes its address or reduces into it.
+static bool writes(ast *node, const Symbol *sym) {
+  if (auto *n = dynamic_cast<AssignmentNode *>(node); n && n->sym == sym)
+    return true;
+  if (auto *n = dynamic_cast<PointerReferenceNode *>(node); n && n->sym == sym)
+    return true;
+  if (auto *n = dynamic_cast<RangeForNode *>(node); n && n->parallel)
+    for (const Reduction &r : n->parallel->reductions)
+      if (r.sym == sym)
+        return true;
+  bool found = false;
+  node->forEachChild([&](std::unique_ptr<ast> &child) {
+    found = found || writes(child.get(), sym);
+  });
+  return found;
+}
+
+static bool leavesEarly(ast *node) {
+  if (dynamic_cast<BreakNode *>(node) || dynamic_cast<ContinueNode *>(node) ||
+      dynamic_cast<ReturnNode *>(node))
+    return true;
+  bool found = false;
+  node->forEachChild([&](std::unique_ptr<ast> &child) {
+    found = found || leavesEarly(child.get());
+  });
+  return found;
+}
+
+// Collects the checked arrays and slices node indexes with exactly iv every
+// time it runs. Only code that always runs counts: not the branches of an
+// if, loop bodies, or the right side of && and ||.
+static void collectRangeIndexes(ast *node, const Symbol *iv,
+                                const CodegenContext &cc,
+                                std::vector<const Symbol *> &out) {
+  if (!node)
+    return;
+  auto indexedBy = [&](Symbol *array, ast *index) {
+    auto *ref = dynamic_cast<VariableReferenceNode *>(index);
+    if (!array || !ref || ref->sym != iv ||
+        std::find(out.begin(), out.end(), array) != out.end())
+      return;
+    if (array->type.isSlice() ||
+        (cc.CheckArrays && (array->type.isArray() || array->type.isVector())))
+      out.push_back(array);
+  };
+  if (auto *n = dynamic_cast<ArrayAccessNode *>(node))
+    indexedBy(n->sym, n->indexExpr.get());
+  if (auto *n = dynamic_cast<ArrayAssignNode *>(node))
+    indexedBy(n->sym, n->index.get());
+
+  if (auto *n = dynamic_cast<IfNode *>(node))
+    return collectRangeIndexes(n->condition.get(), iv, cc, out);
+  if (auto *n = dynamic_cast<WhileNode *>(node))
+    return collectRangeIndexes(n->condition.get(), iv, cc, out);
+  if (auto *n = dynamic_cast<ForNode *>(node)) {
+    collectRangeIndexes(n->init.get(), iv, cc, out);
+    return collectRangeIndexes(n->condition.get(), iv, cc, out);
+  }
+  if (auto *n = dynamic_cast<RangeForNode *>(node)) {
+    collectRangeIndexes(n->start.get(), iv, cc, out);
+    return collectRangeIndexes(n->end.get(), iv, cc, out);
+  }
+  if (auto *n = dynamic_cast<BinaryOperationNode *>(node);
+      n && (n->Type == TokenType::AND || n->Type == TokenType::OR))
+    return collectRangeIndexes(n->Left.get(), iv, cc, out);
+  node->forEachChild([&](std::unique_ptr<ast> &child) {
+    collectRangeIndexes(child.get(), iv, cc, out);
+  });
+}
+
+// True if the loop's bounds alone keep its variable inside array:
+// `for i in k..len(a)` with a constant k >= 0 and a positive step.
+static bool boundedByLength(RangeForNode &loop, const Symbol *array) {
+  auto *first = dynamic_cast<IntegerNode *>(loop.start.get());
+  auto *len = dynamic_cast<CallNode *>(loop.end.get());
+  if (loop.stepValue <= 0 || !first || first->val < 0 || !len ||
+      len->builtin != Builtin::Len)
+    return false;
+  auto *ref = dynamic_cast<VariableReferenceNode *>(len->args[0].get());
+  return ref && ref->sym == array;
+}
+
+// Generates `void <fn>.parallel(ptr env, i64 lo, i64 hi)`, which runs
+// iterations [lo, hi) of the loop. env holds the first value of the
+// induction variable followed by the address of each capture. Reduction
+// variables get a private accumulator that is combined into the shared one
+// when the chunk is done.
+static llvm::Function *outlineParallelBody(RangeForNode &loop,
+                                           llvm::StructType *envTy,
+                                           CodegenContext &cc) {
+  llvm::IRBuilder<> &B = *cc.Builder;
+  llvm::LLVMContext &Ctx = *cc.TheContext;
+  ParallelSpec &spec = *loop.parallel;
+  llvm::Type *i64 = B.getInt64Ty();
+  llvm::Type *ptrTy = llvm::PointerType::get(Ctx, 0);
+
+  llvm::Function *parent = B.GetInsertBlock()->getParent();
+  auto *FT = llvm::FunctionType::get(B.getVoidTy(), {ptrTy, i64, i64}, false);
+  auto *Fn = llvm::Function::Create(FT, llvm::Function::InternalLinkage,
+                                    parent->getName() + ".parallel",
+                                    cc.Module.get());
+  llvm::Argument *env = Fn->getArg(0);
+  llvm::Argument *lo = Fn->getArg(1);
+  llvm::Argument *hi = Fn->getArg(2);
+  env->setName("env");
+  lo->setName("lo");
+  hi->setName("hi");
+
+  // The body becomes its own function, so it gets its own locals and scopes.
+  auto savedIP = B.saveIP();
+  std::vector<VWT> outerLocals = cc.Locals;
+  auto outerScopes = std::move(cc.LiveScopes);
+  size_t outerDepth = cc.LoopScopeDepth;
+  llvm::BasicBlock *outerBreak = cc.BreakBB;
+  llvm::BasicBlock *outerCont = cc.ContinueBB;
+  llvm::BasicBlock *outerTrap = cc.TrapBB;
+  cc.Locals.assign(outerLocals.size(), VWT{});
+  cc.LiveScopes.clear();
+  cc.TrapBB = nullptr;
+
+  auto *entryBB = llvm::BasicBlock::Create(Ctx, "entry", Fn);
+  B.SetInsertPoint(entryBB);
+  llvm::Value *first =
+      B.CreateLoad(i64, B.CreateStructGEP(envTy, env, 0), "first");
+
+  struct Partial {
+    const Reduction *reduction;
+    llvm::Value *shared;
+    llvm::AllocaInst *local;
+  };
+  std::vector<Partial> partials;
+
+  for (size_t j = 0; j < spec.captures.size(); ++j) {
+    Symbol *sym = spec.captures[j];
+    llvm::Value *addr = B.CreateLoad(
+        ptrTy, B.CreateStructGEP(envTy, env, j + 1), sym->name + ".addr");
+    const VWT &outer = outerLocals[sym->slot];
+
+    auto red = std::find_if(spec.reductions.begin(), spec.reductions.end(),
+                            [&](const Reduction &r) { return r.sym == sym; });
+    if (red != spec.reductions.end()) {
+      llvm::Type *ty = lowerType(sym->type, cc);
+      llvm::AllocaInst *local = cc.createEntryAlloca(ty, sym->name);
+      B.CreateStore(reductionIdentity(red->op, sym->type, ty), local);
+      cc.addVariable(sym, local, ty, nullptr);
+      partials.push_back({&*red, addr, local});
+    } else if (outer.isValue ||
+               ((sym->type.isNumeric() || sym->type.isPointer()) &&
+                !writes(loop.body.get(), sym))) {
+      // Scalars the body only reads are loaded once per chunk, which also
+      // spares the vectorizer from proving they do not alias the arrays.
+      cc.addValue(sym, B.CreateLoad(outer.type, addr, sym->name));
+    } else {
+      cc.addVariable(sym, addr, outer.type, outer.elementType);
     }
+  }
 
-    llvm::Value *gep = cc.Builder->CreateGEP(
-        arrType, arrayAlloc, {cc.Builder->getInt32(0), cc.Builder->getInt32(i)},
-        "elemptr");
+  llvm::BasicBlock *bodyBB = llvm::BasicBlock::Create(Ctx, "range.body", Fn);
+  llvm::BasicBlock *nextBB = llvm::BasicBlock::Create(Ctx, "range.next", Fn);
+  llvm::BasicBlock *endBB = llvm::BasicBlock::Create(Ctx, "range.end", Fn);
+  B.CreateCondBr(B.CreateICmpULT(lo, hi), bodyBB, endBB);
+
+  // Iteration k runs with i = first + k * step.
+  B.SetInsertPoint(bodyBB);
+  llvm::PHINode *k = B.CreatePHI(i64, 2, "k");
+  k->addIncoming(lo, entryBB);
+  llvm::Value *iv =
+      B.CreateAdd(first, B.CreateMul(k, B.getInt64(loop.stepValue)));
+  iv = B.CreateIntCast(iv, lowerType(loop.sym->type, cc), false, loop.var);
+  cc.addValue(loop.sym, iv);
+
+  cc.BreakBB = nullptr;
+  cc.ContinueBB = nextBB;
+  cc.LoopScopeDepth = 0;
+  if (loop.body)
+    loop.body->codegen(cc);
+  if (!B.GetInsertBlock()->getTerminator())
+    B.CreateBr(nextBB);
+
+  B.SetInsertPoint(nextBB);
+  llvm::Value *kNext = B.CreateAdd(k, B.getInt64(1), "k.next", true, true);
+  k->addIncoming(kNext, nextBB);
+  B.CreateCondBr(B.CreateICmpULT(kNext, hi), bodyBB, endBB);
+
+  B.SetInsertPoint(endBB);
+  for (const Partial &p : partials) {
+    llvm::Value *value =
+        B.CreateLoad(p.local->getAllocatedType(), p.local, p.reduction->name);
+    atomicCombine(p.reduction->op, p.reduction->sym->type, p.shared, value,
+                  cc);
+  }
+  B.CreateRetVoid();
+  llvm::verifyFunction(*Fn);
 
-    cc.Builder->CreateStore(elemVal, gep);
+  B.restoreIP(savedIP);
+  cc.Locals = std::move(outerLocals);
+  cc.LiveScopes = std::move(outerScopes);
+  cc.LoopScopeDepth = outerDepth;
+  cc.BreakBB = outerBreak;
+  cc.ContinueBB = outerCont;
+  cc.TrapBB = outerTrap;
+  return Fn;
+}
+
+// Computes the trip count, packs the captures into an env struct on the
+// stack and hands the outlined body to the runtime pool.
+static llvm::Value *codegenParallel(RangeForNode &loop, CodegenContext &cc) {
+  llvm::IRBuilder<> &B = *cc.Builder;
+  ParallelSpec &spec = *loop.parallel;
+  const BType &varType = loop.sym->type;
+  bool isUnsigned = varType.isUnsigned();
+  llvm::Type *i64 = B.getInt64Ty();
+  llvm::Type *ptrTy = llvm::PointerType::get(*cc.TheContext, 0);
+
+  auto widen = [&](ast &bound) {
+    llvm::Value *v =
+        convertScalar(bound.codegen(cc), bound.exprType, varType, cc);
+    return B.CreateIntCast(v, i64, !isUnsigned);
+  };
+  llvm::Value *first = widen(*loop.start);
+  llvm::Value *last = widen(*loop.end);
+
+  // ceil(distance / |step|), or 0 for an empty range.
+  bool up = loop.stepValue > 0;
+  uint64_t magnitude =
+      up ? uint64_t(loop.stepValue) : 0 - uint64_t(loop.stepValue);
+  llvm::Value *nonEmpty =
+      up ? (isUnsigned ? B.CreateICmpULT(first, last)
+                       : B.CreateICmpSLT(first, last))
+         : (isUnsigned ? B.CreateICmpUGT(first, last)
+                       : B.CreateICmpSGT(first, last));
+  llvm::Value *distance =
+      up ? B.CreateSub(last, first) : B.CreateSub(first, last);
+  llvm::Value *count =
+      B.CreateUDiv(B.CreateAdd(distance, B.getInt64(magnitude - 1)),
+                   B.getInt64(magnitude));
+  count = B.CreateSelect(nonEmpty, count, B.getInt64(0), "trip.count");
+
+  std::vector<llvm::Type *> fields{i64};
+  fields.insert(fields.end(), spec.captures.size(), ptrTy);
+  llvm::StructType *envTy = llvm::StructType::get(*cc.TheContext, fields);
+  llvm::AllocaInst *env = cc.createEntryAlloca(envTy, "parallel.env");
+
+  B.CreateStore(first, B.CreateStructGEP(envTy, env, 0));
+  for (size_t j = 0; j < spec.captures.size(); ++j) {
+    Symbol *sym = spec.captures[j];
+    const VWT *var = cc.lookup(sym);
+    if (!var)
+      throw std::runtime_error("Unknown variable: " + sym->name);
+
+    // Values with no storage of their own (range induction variables) are
+    // spilled so every capture can be passed by address.
+    llvm::Value *addr = var->val;
+    if (var->isValue) {
+      auto *spill = cc.createEntryAlloca(var->type, sym->name);
+      B.CreateStore(var->val, spill);
+      addr = spill;
+    }
+    B.CreateStore(addr, B.CreateStructGEP(envTy, env, j + 1));
   }
 
-  return arrayAlloc; // return pointer to the allocated array
+  llvm::Function *body = outlineParallelBody(loop, envTy, cc);
+
+  llvm::FunctionCallee runtime = cc.Module->getOrInsertFunction(
+      "basiq_parallel_for", B.getVoidTy(), i64, B.getInt32Ty(), i64, ptrTy,
+      ptrTy);
+  B.CreateCall(runtime,
+               {count, B.getInt32(spec.schedule == Schedule::Dynamic),
+                B.getInt64(spec.chunk), body, env});
+  return nullptr;
 }
 
-llvm::Value *ArrayAccessNode::codegen(CodegenContext &cc) {
-  llvm::Value *arrayPtr = cc.lookup(arrayName);
+// Emitted in rotated form: a guard in the preheader, the induction phi at
+// the top of the body and the only back edge from range.next, which is also
+// the continue target. This is the shape LoopSimplify/IndVars would produce,
+// so SCEV sees the trip count without having to rediscover the loop.
+llvm::Value *RangeForNode::codegen(CodegenContext &cc) {
+  if (parallel)
+    return codegenParallel(*this, cc);
 
-  if (!arrayPtr)
-    throw std::runtime_error("Unknown array: " + arrayName);
+  llvm::Function *F = cc.Builder->GetInsertBlock()->getParent();
+  llvm::LLVMContext &Ctx = *cc.TheContext;
+  llvm::IRBuilder<> &B = *cc.Builder;
+
+  const BType &varType = sym->type;
+  llvm::Type *ty = lowerType(varType, cc);
+  llvm::Value *first = convertScalar(start->codegen(cc), start->exprType,
+                                     varType, cc);
+  llvm::Value *last =
+      convertScalar(end->codegen(cc), end->exprType, varType, cc);
+
+  bool up = stepValue > 0;
+  bool isUnsigned = varType.isUnsigned();
+  auto inRange = [&](llvm::Value *i, const char *name) {
+    if (up)
+      return isUnsigned ? B.CreateICmpULT(i, last, name)
+                        : B.CreateICmpSLT(i, last, name);
+    return isUnsigned ? B.CreateICmpUGT(i, last, name)
+                      : B.CreateICmpSGT(i, last, name);
+  };
+
+  // Arrays and slices indexed by the loop variable on every iteration are
+  // checked once for the whole range before the loop, with a single branch,
+  // instead of at each access. A loop that would go out of bounds then traps
+  // before its first iteration. A slice's length is read once, so the body
+  // must not be able to change it.
+  std::vector<const Symbol *> hoisted;
+  if (cc.BoundsChecks && body && !leavesEarly(body.get()))
+    collectRangeIndexes(body.get(), sym, cc, hoisted);
+  hoisted.erase(std::remove_if(hoisted.begin(), hoisted.end(),
+                               [&](const Symbol *array) {
+                                 return array->type.isSlice() &&
+                                        (array->addressTaken ||
+                                         writes(body.get(), array));
+                               }),
+                hoisted.end());
+
+  // The number of steps after the first iteration, ceil(span / |step|) - 1,
+  // in i64. Only meaningful once the guard has passed; used by the hoisted
+  // bounds check and to count a loop with a step other than 1.
+  uint64_t magnitude = up ? uint64_t(stepValue) : 0 - uint64_t(stepValue);
+  llvm::Value *firstIdx = nullptr, *steps = nullptr;
+  if (!hoisted.empty() || magnitude != 1) {
+    llvm::Type *i64 = B.getInt64Ty();
+    firstIdx = B.CreateIntCast(first, i64, !isUnsigned);
+    llvm::Value *endIdx = B.CreateIntCast(last, i64, !isUnsigned);
+    llvm::Value *span = up ? B.CreateSub(endIdx, firstIdx)
+                           : B.CreateSub(firstIdx, endIdx);
+    steps = B.CreateUDiv(B.CreateSub(span, B.getInt64(1)),
+                         B.getInt64(magnitude), "range.steps");
+  }
+
+  llvm::BasicBlock *preheader = B.GetInsertBlock();
+  llvm::BasicBlock *bodyBB = llvm::BasicBlock::Create(Ctx, "range.body", F);
+  llvm::BasicBlock *nextBB = llvm::BasicBlock::Create(Ctx, "range.next", F);
+  llvm::BasicBlock *endBB = llvm::BasicBlock::Create(Ctx, "range.end", F);
+  llvm::BasicBlock *checkBB =
+      hoisted.empty() ? bodyBB
+                      : llvm::BasicBlock::Create(Ctx, "range.check", F, bodyBB);
+
+  B.CreateCondBr(inRange(first, "range.guard"), checkBB, endBB);
+
+  size_t oldChecked = cc.CheckedRanges.size();
+  if (!hoisted.empty()) {
+    // The guard passed, so the loop runs at least once and its variable
+    // moves monotonically from first to the last value it takes.
+    B.SetInsertPoint(checkBB);
+    llvm::Value *travel = B.CreateMul(steps, B.getInt64(magnitude));
+    llvm::Value *lastIdx = up ? B.CreateAdd(firstIdx, travel, "range.last")
+                              : B.CreateSub(firstIdx, travel, "range.last");
+
+    llvm::Value *ok = nullptr;
+    for (const Symbol *array : hoisted) {
+      cc.CheckedRanges.push_back({array, sym});
+      if (boundedByLength(*this, array))
+        continue;
+      llvm::Value *len;
+      if (array->type.isSlice()) {
+        const VWT *var = cc.lookup(array);
+        len = B.CreateExtractValue(
+            B.CreateLoad(var->type, var->val, array->name), 1, "len");
+      } else {
+        len = B.getInt64(array->type.count);
+      }
+      llvm::Value *fits = B.CreateAnd(B.CreateICmpULT(firstIdx, len),
+                                      B.CreateICmpULT(lastIdx, len));
+      ok = ok ? B.CreateAnd(ok, fits) : fits;
+    }
+    if (ok)
+      boundsCheck(ok, cc);
+    B.CreateBr(bodyBB);
+    preheader = B.GetInsertBlock();
+  }
 
-  llvm::Type *arrayType = nullptr;
+  B.SetInsertPoint(bodyBB);
+  llvm::PHINode *iv = B.CreatePHI(ty, 2, var);
+  iv->addIncoming(first, preheader);
+  cc.addValue(sym, iv);
+  llvm::PHINode *step = nullptr;
+  if (magnitude != 1) {
+    step = B.CreatePHI(B.getInt64Ty(), 2, "range.step");
+    step->addIncoming(B.getInt64(0), preheader);
+  }
+
+  llvm::BasicBlock *oldBreak = cc.BreakBB;
+  llvm::BasicBlock *oldCont = cc.ContinueBB;
+  size_t oldDepth = cc.LoopScopeDepth;
+  cc.BreakBB = endBB;
+  cc.ContinueBB = nextBB;
+  cc.LoopScopeDepth = cc.LiveScopes.size();
 
-  if (auto *allocaInst = llvm::dyn_cast<llvm::AllocaInst>(arrayPtr)) {
-    arrayType = allocaInst->getAllocatedType();
-  } else if (auto *globalVar = llvm::dyn_cast<llvm::GlobalVariable>(arrayPtr)) {
-    arrayType = globalVar->getValueType();
+  if (body)
+    body->codegen(cc);
+
+  cc.BreakBB = oldBreak;
+  cc.ContinueBB = oldCont;
+  cc.LoopScopeDepth = oldDepth;
+  cc.CheckedRanges.resize(oldChecked);
+
+  if (!B.GetInsertBlock()->getTerminator())
+    B.CreateBr(nextBB);
+
+  // A unit step stops exactly at end, so it cannot wrap and exits when the
+  // variable reaches it. A larger one could step past the type's range, so
+  // it counts steps instead and its variable promises nothing.
+  B.SetInsertPoint(nextBB);
+  llvm::Value *delta = llvm::ConstantInt::get(ty, magnitude);
+  bool noWrap = magnitude == 1;
+  llvm::Value *next =
+      up ? B.CreateAdd(iv, delta, var + ".next", noWrap && isUnsigned,
+                       noWrap && !isUnsigned)
+         : B.CreateSub(iv, delta, var + ".next", noWrap && isUnsigned,
+                       noWrap && !isUnsigned);
+  iv->addIncoming(next, nextBB);
+  if (step) {
+    llvm::Value *more = B.CreateICmpULT(step, steps, "range.cond");
+    step->addIncoming(
+        B.CreateAdd(step, B.getInt64(1), "range.step.next", true, true),
+        nextBB);
+    B.CreateCondBr(more, bodyBB, endBB);
   } else {
-    throw std::runtime_error(arrayName + " is not a valid array variable");
+    B.CreateCondBr(inRange(next, "range.cond"), bodyBB, endBB);
+  }
+
+  B.SetInsertPoint(endBB);
+  return nullptr;
+}
+
+llvm::Value *ArrayLiteralNode::codegen(CodegenContext &cc) {
+  // Ensure there is at least one element
+  if (Elements.empty()) {
+    std::cerr << "Error: ArrayLiteralNode has no elements\n";
+    return nullptr;
   }
 
-  if (!arrayType->isArrayTy())
-    throw std::runtime_error(arrayName + " is not an array");
+  llvm::ArrayType *arrType =
+      llvm::cast<llvm::ArrayType>(lowerType(exprType, cc));
+  llvm::AllocaInst *arrayAlloc =
+      cc.createEntryAlloca(arrType, "arraytmp");
+
+  storeArrayLiteral(*this, arrayAlloc, arrType, exprType.element(), cc);
+
+  return arrayAlloc; // return pointer to the allocated array
+}
+
+llvm::Value *ArrayAccessNode::codegen(CodegenContext &cc) {
+  const VWT *array = cc.lookup(sym);
+
+  if (!array)
+    throw std::runtime_error("Unknown array: " + arrayName);
+  if (sym->type.isSlice())
+    return cc.Builder->CreateLoad(lowerType(exprType, cc),
+                                  sliceElement(sym, *indexExpr, cc),
+                                  arrayName + "_elem");
+
+  llvm::Value *arrayPtr = array->val;
+  llvm::Type *arrayType = array->type;
 
   llvm::IRBuilder<> &builder = *cc.Builder;
 
-  llvm::Value *indexVal = indexExpr->codegen(cc);
-  if (!indexVal->getType()->isIntegerTy())
-    throw std::runtime_error("Array index must be integer");
+  llvm::Value *indexVal = indexValue(*indexExpr, cc);
+  checkArrayIndex(sym, *indexExpr, indexVal, cc);
 
-  if (indexVal->getType() != builder.getInt32Ty())
-    indexVal = builder.CreateIntCast(indexVal, builder.getInt32Ty(), true);
+  // A lane of a vector variable.
+  if (sym->type.isVector()) {
+    llvm::Value *vec = builder.CreateLoad(arrayType, arrayPtr, arrayName);
+    return builder.CreateExtractElement(vec, indexVal, arrayName + "_lane");
+  }
+
+  if (sym->soa) {
+    auto *st = llvm::cast<llvm::StructType>(lowerType(exprType, cc));
+    return soaLoad(*array, st, indexVal, cc);
+  }
 
   llvm::Value *elemPtr =
-      builder.CreateGEP(arrayType, arrayPtr, {builder.getInt32(0), indexVal},
+      builder.CreateGEP(arrayType, arrayPtr, {builder.getInt64(0), indexVal},
                         arrayName + "_elem_ptr");
 
   llvm::Type *elementType = arrayType->getArrayElementType();
@@ -821,36 +2191,47 @@ llvm::Value *ArrayAccessNode::codegen(CodegenContext &cc) {
 
 llvm::Value *ArrayAssignNode::codegen(CodegenContext &cc) {
 
-  llvm::Value *arrayVal = cc.lookup(name);
-  if (!arrayVal)
+  const VWT *array = cc.lookup(sym);
+  if (!array)
     throw std::runtime_error("Undefined array variable: " + name);
+  if (sym->type.isSlice()) {
+    llvm::Value *elemPtr = sliceElement(sym, *index, cc);
+    llvm::Value *val = valueAs(*value, sym->type.element(), cc);
+    cc.Builder->CreateStore(val, elemPtr);
+    return val;
+  }
 
-  llvm::AllocaInst *alloca = llvm::dyn_cast<llvm::AllocaInst>(arrayVal);
-  if (!alloca)
-    throw std::runtime_error(name + " is not stack allocated");
-
-  llvm::Type *arrayType = alloca->getAllocatedType();
-  if (!arrayType->isArrayTy())
-    throw std::runtime_error(name + " is not an array");
-
-  llvm::Value *index = this->index->codegen(cc);
-  if (!index)
-    throw std::runtime_error("Invalid index expression in array assignment");
+  llvm::Value *arrayVal = array->val;
+  llvm::Type *arrayType = array->type;
 
-  if (!index->getType()->isIntegerTy())
-    throw std::runtime_error("Array index must be integer");
+  llvm::Value *index = indexValue(*this->index, cc);
+  checkArrayIndex(sym, *this->index, index, cc);
+  llvm::Value *zero = cc.Builder->getInt64(0);
 
-  if (index->getType() != llvm::Type::getInt32Ty(*cc.TheContext))
-    index = cc.Builder->CreateIntCast(
-        index, llvm::Type::getInt32Ty(*cc.TheContext), true, "idxcast");
+  if (sym->type.isVector()) {
+    llvm::Value *val = convertScalar(value->codegen(cc), value->exprType,
+                                     sym->type.element(), cc);
+    llvm::Value *vec = cc.Builder->CreateLoad(arrayType, arrayVal, name);
+    vec = cc.Builder->CreateInsertElement(vec, val, index, name);
+    cc.Builder->CreateStore(vec, arrayVal);
+    return val;
+  }
 
-  llvm::Value *zero =
-      llvm::ConstantInt::get(llvm::Type::getInt32Ty(*cc.TheContext), 0);
+  // Scatter the struct's fields into their arrays.
+  if (sym->soa) {
+    llvm::Value *val = value->codegen(cc);
+    auto *st = llvm::cast<llvm::StructType>(val->getType());
+    for (unsigned c = 0; c < st->getNumElements(); ++c)
+      cc.Builder->CreateStore(cc.Builder->CreateExtractValue(val, c),
+                              soaField(*array, c, index, cc));
+    return val;
+  }
 
-  llvm::Value *elemPtr = cc.Builder->CreateGEP(arrayType, alloca, {zero, index},
-                                               name + "_elem_ptr");
+  llvm::Value *elemPtr = cc.Builder->CreateGEP(
+      arrayType, arrayVal, {zero, index}, name + "_elem_ptr");
 
-  llvm::Value *val = value->codegen(cc);
+  llvm::Value *val = convertScalar(value->codegen(cc), value->exprType,
+                                   sym->type.element(), cc);
   if (!val)
     throw std::runtime_error("Invalid RHS in array assignment");
 
@@ -863,51 +2244,41 @@ llvm::Value *ArrayAssignNode::codegen(CodegenContext &cc) {
   return val;
 }
 
-llvm::Value *SizeOfNode::codegen(CodegenContext &cc) {
-  if (!val) {
-    throw std::runtime_error("INVALUD VALUE AT SIZEOF NODE");
-    return nullptr;
+llvm::Value *SubSliceNode::codegen(CodegenContext &cc) {
+  const VWT *var = cc.lookup(sym);
+  if (!var)
+    throw std::runtime_error("Unknown array: " + name);
+  llvm::IRBuilder<> &B = *cc.Builder;
+
+  llvm::Value *data, *len;
+  if (sym->type.isSlice()) {
+    llvm::Value *slice = B.CreateLoad(var->type, var->val, name);
+    data = B.CreateExtractValue(slice, 0, "data");
+    len = B.CreateExtractValue(slice, 1, "len");
+  } else {
+    data = var->val;
+    len = B.getInt64(sym->type.count);
   }
-  // uint32_t type =
-  //     cc.Module->getDataLayout().getTypeAllocSize(val->codegen(cc)->getType());
-
-  return llvm::ConstantExpr::getSizeOf(val->codegen(cc)->getType());
+  llvm::Value *from = lo ? indexValue(*lo, cc) : B.getInt64(0);
+  llvm::Value *to = hi ? indexValue(*hi, cc) : len;
+  if (cc.BoundsChecks)
+    boundsCheck(B.CreateAnd(B.CreateICmpULE(from, to), B.CreateICmpULE(to, len),
+                            "inbounds"),
+                cc);
+
+  llvm::Value *ptr = B.CreateInBoundsGEP(lowerType(sym->type.element(), cc),
+                                         data, from, name + "_sub");
+  return makeSlice(ptr, B.CreateSub(to, from, "sublen"), cc);
 }
 
-llvm::Value *castToI64(llvm::Value *v, CodegenContext &cc,
-                       const std::string &varName = "") {
-  llvm::Type *i64Ty = llvm::Type::getInt64Ty(*cc.TheContext);
-
-  // Already i64
-  if (v->getType()->isIntegerTy(64))
-    return v;
-
-  // Single integer smaller than 64-bit → extend
-  if (v->getType()->isIntegerTy())
-    return cc.Builder->CreateZExt(v, i64Ty);
-
-  // Pointer or array stored in context
-  if (!varName.empty()) {
-    llvm::Type *type = cc.lookupType(varName);
-    llvm::Type *elemType = cc.lookupElementType(varName);
-
-    if (type && elemType) {
-      if (elemType->isIntegerTy(8)) {
-        // Arrays or pointers of i8 → cast to integer
-        if (type->isArrayTy())
-          v = cc.Builder->CreateBitCast(
-              v, llvm::PointerType::get(llvm::Type::getInt8Ty(*cc.TheContext),
-                                        false));
-        return cc.Builder->CreatePtrToInt(v, i64Ty);
-      }
-    }
-  }
-
-  // Float → integer
-  if (v->getType()->isFloatingPointTy())
-    return cc.Builder->CreateFPToUI(v, i64Ty);
-
-  llvm_unreachable("Unsupported type for syscall argument");
+llvm::Value *SizeOfNode::codegen(CodegenContext &cc) {
+  // The operand's type is known from sema; it is never evaluated. Sizes
+  // include tail padding, as an array element would.
+  const llvm::DataLayout &DL = cc.Module->getDataLayout();
+  llvm::Type *ty = lowerType(type, cc);
+  uint64_t n =
+      align ? DL.getABITypeAlign(ty).value() : DL.getTypeAllocSize(ty);
+  return llvm::ConstantInt::get(lowerType(exprType, cc), n);
 }
 
 llvm::Value *SyscallNode::codegen(CodegenContext &cc) {
@@ -917,7 +2288,8 @@ llvm::Value *SyscallNode::codegen(CodegenContext &cc) {
   // Generate code and cast each arg to i64
   for (auto &arg : args) {
     llvm::Value *v = arg->codegen(cc);
-    llvm_args.push_back(v);
+    llvm_args.push_back(
+        castValue(*cc.Builder, v, i64Ty, !arg->exprType.isUnsigned()));
   }
 
   // Zero-pad to 6 arguments
@@ -939,63 +2311,53 @@ llvm::Value *SyscallNode::codegen(CodegenContext &cc) {
       true // hasSideEffects
   );
 
-  return cc.Builder->CreateCall(asmSyscall, final_args);
+  llvm::Value *ret = cc.Builder->CreateCall(asmSyscall, final_args);
+  return cc.Builder->CreateTrunc(ret, lowerType(exprType, cc));
 }
 
 llvm::Value *PointerReferenceNode::codegen(CodegenContext &cc) {
-  llvm::Value *var = cc.lookup(name);
+  const VWT *var = cc.lookup(sym);
 
   if (!var) {
     throw std::runtime_error("CANNOT FIND VALUE " + name);
   }
-  return var;
+  return var->val;
 }
 
 llvm::Value *PointerDeReferenceAssingNode::codegen(CodegenContext &cc) {
-  llvm::Value *arrayVal = cc.lookup(name);
-  if (!arrayVal)
+  const VWT *ptr = cc.lookup(sym);
+  if (!ptr)
     throw std::runtime_error("Unknown pointer array: " + name);
 
-  llvm::Type *ptrType = cc.lookupType(name);
-  llvm::Type *elemType = cc.lookupElementType(name);
+  llvm::Type *elemType = ptr->elementType;
 
   llvm::Value *actualPtr =
-      cc.Builder->CreateLoad(ptrType, arrayVal, name + "_ptr");
+      cc.Builder->CreateLoad(ptr->type, ptr->val, name + "_ptr");
 
-  llvm::Value *idx = index->codegen(cc);
+  llvm::Value *idx = indexValue(*index, cc);
+  checkPointerIndex(actualPtr, idx, elemType, cc);
   llvm::Value *elemPtr =
       cc.Builder->CreateGEP(elemType, actualPtr, {idx}, "ptr_elem");
 
-  llvm::Value *value = val->codegen(cc);
+  llvm::Value *value =
+      convertScalar(val->codegen(cc), val->exprType, sym->type.element(), cc);
   return cc.Builder->CreateStore(value, elemPtr);
 }
 
 llvm::Value *DeReferenceNode::codegen(CodegenContext &cc) {
-  llvm::Value *var = cc.lookup(name);
+  const VWT *var = cc.lookup(sym);
   if (!var) {
     llvm::errs() << "Unknown variable '" << name << "'\n";
     return nullptr;
   }
-  llvm::Type *ptrType = cc.lookupType(name);
-
-  if (nullptr == ptrType) {
-    throw std::runtime_error("NullPointer, Baby");
-  }
-  if (!ptrType || !ptrType->isPointerTy()) {
-    llvm::errs() << "'" << name << "' is not a pointer\n";
-    return nullptr;
-  }
-
-  llvm::Value *ptrVal = cc.Builder->CreateLoad(ptrType, var, name + "_ptr");
-  llvm::Type *elementType = cc.lookupElementType(name);
-
-  llvm::errs() << "DeReferenceNode '" << name << "' elementType: ";
-  elementType->print(llvm::errs());
-  llvm::errs() << "\n";
+  llvm::Value *ptrVal =
+      cc.Builder->CreateLoad(var->type, var->val, name + "_ptr");
+  llvm::Type *elementType = var->elementType;
 
   // If there's an index, apply GEP before loading
   if (index) {
-    llvm::Value *idx = index->codegen(cc);
+    llvm::Value *idx = indexValue(*index, cc);
+    checkPointerIndex(ptrVal, idx, elementType, cc);
     ptrVal = cc.Builder->CreateGEP(elementType, ptrVal, {idx}, "ptr_elem");
   }
 
@@ -1010,24 +2372,24 @@ llvm::Value *castValue(llvm::IRBuilder<> &builder, llvm::Value *val,
     return val;
 
   // ===== Integer ↔ Integer (covers CHAR <-> INT, BOOL, etc) =====
-  if (srcType->isIntegerTy() && targetType->isIntegerTy()) {
+  if (srcType->isIntOrIntVectorTy() && targetType->isIntOrIntVectorTy()) {
     return builder.CreateIntCast(val, targetType, isSigned);
   }
 
   // ===== Integer → Float =====
-  if (srcType->isIntegerTy() && targetType->isFloatingPointTy()) {
+  if (srcType->isIntOrIntVectorTy() && targetType->isFPOrFPVectorTy()) {
     return isSigned ? builder.CreateSIToFP(val, targetType)
                     : builder.CreateUIToFP(val, targetType);
   }
 
   // ===== Float → Integer (covers float -> char too) =====
-  if (srcType->isFloatingPointTy() && targetType->isIntegerTy()) {
+  if (srcType->isFPOrFPVectorTy() && targetType->isIntOrIntVectorTy()) {
     return isSigned ? builder.CreateFPToSI(val, targetType)
                     : builder.CreateFPToUI(val, targetType);
   }
 
   // ===== Float ↔ Float =====
-  if (srcType->isFloatingPointTy() && targetType->isFloatingPointTy()) {
+  if (srcType->isFPOrFPVectorTy() && targetType->isFPOrFPVectorTy()) {
     return builder.CreateFPCast(val, targetType);
   }
 
@@ -1050,31 +2412,80 @@ llvm::Value *castValue(llvm::IRBuilder<> &builder, llvm::Value *val,
 
 llvm::Value *CastNode::codegen(CodegenContext &cc) {
   llvm::Value *v = Value->codegen(cc);
-  return castValue(*cc.Builder, v, targetType, true);
+  if (targetType.isVector())
+    return convertScalar(v, Value->exprType, targetType, cc);
+  return castValue(*cc.Builder, v, lowerType(targetType, cc),
+                   !Value->exprType.isUnsigned());
 }
 
-llvm::Value *StructCreateNode::codegen(CodegenContext &cc) {
-  llvm::StructType *TheStruct = llvm::StructType::create(*cc.TheContext, name);
-  std::vector<llvm::Type *> fieldTypes;
-  fieldTypes.reserve(types.size());
+void StructCreateNode::declare(CodegenContext &cc) {
+  auto *TheStruct =
+      llvm::cast<llvm::StructType>(lowerType(BType::structNamed(name), cc));
+  const llvm::DataLayout &DL = cc.Module->getDataLayout();
+
+  std::vector<std::pair<std::string, llvm::Type *>> layout;
+  layout.reserve(fields.size());
+  for (const auto &field : fields)
+    layout.push_back({field.first, lowerType(field.second, cc)});
+
+  // Most-aligned first: every field then starts aligned without padding,
+  // and only the tail is padded up to the struct's alignment. Stable, so
+  // equally aligned fields keep their declared order.
+  if (reorder)
+    std::stable_sort(layout.begin(), layout.end(), [&](auto &a, auto &b) {
+      return DL.getABITypeAlign(a.second) > DL.getABITypeAlign(b.second);
+    });
 
+  std::vector<llvm::Type *> fieldTypes;
   std::vector<std::pair<std::string, size_t>> indexs;
-  size_t i = 0;
-  for (const auto &p : types) {
-    fieldTypes.push_back(p.second);
-    indexs.push_back({p.first, i});
-    i++;
+  for (size_t i = 0; i < layout.size(); ++i) {
+    fieldTypes.push_back(layout[i].second);
+    indexs.push_back({layout[i].first, i});
   }
 
-  TheStruct->setBody(fieldTypes);
+  TheStruct->setBody(fieldTypes, packed);
+  cc.StructIndexList[name]->index = std::move(indexs);
+}
 
-  auto idx = std::make_unique<StructIndex>(TheStruct, indexs);
+llvm::Value *MemberAccessNode::codegen(CodegenContext &cc) {
+  Place field = placeOf(*this, cc);
+  return cc.Builder->CreateAlignedLoad(field.type, field.ptr, field.align,
+                                       this->field);
+}
 
-  cc.StructIndexList.emplace(name, std::move(idx));
+llvm::Value *MemberAssignNode::codegen(CodegenContext &cc) {
+  Place dst = placeOf(*target, cc);
+  const BType &type = target->exprType;
+  const llvm::DataLayout &DL = cc.Module->getDataLayout();
 
-  return nullptr;
+  if (type.isStruct()) {
+    copyStruct(*val, dst.ptr, dst.align, cc);
+    return nullptr;
+  }
+  if (type.isArray()) {
+    auto *arrayType = llvm::cast<llvm::ArrayType>(dst.type);
+    llvm::Align natural = DL.getABITypeAlign(arrayType);
+    if (dst.align >= natural) {
+      copyArray(*val, dst.ptr, arrayType, type.element(), cc);
+      return nullptr;
+    }
+    // A @packed field: build the array aligned, then copy it bytewise.
+    llvm::AllocaInst *tmp = cc.createEntryAlloca(arrayType, "packed.tmp");
+    copyArray(*val, tmp, arrayType, type.element(), cc);
+    cc.Builder->CreateMemCpy(
+        dst.ptr, dst.align, tmp, tmp->getAlign(),
+        cc.Builder->getInt64(DL.getTypeAllocSize(arrayType)));
+    return nullptr;
+  }
+
+  llvm::Value *v = valueAs(*val, type, cc);
+  cc.Builder->CreateAlignedStore(v, dst.ptr, dst.align);
+  return v;
 }
 
+// The type is fully built by declare().
+llvm::Value *StructCreateNode::codegen(CodegenContext &cc) { return nullptr; }
+
 // int main() {
 //   CodegenContext ctx("myprogram");
 //   ctx.pushScope(); // Start Global Scope
@@ -0,0 +1,326 @@
+#include <algorithm>
+#include <ast.h>
+#include <cstdint>
+#include <fold.h>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// An integer literal together with the bit width codegen gives it. The value
+// is kept sign-extended from that width, the same way LLVM's signed
+// operations read it.
+struct IntConst {
+  int64_t val;
+  unsigned bits;
+};
+
+int64_t wrap(int64_t v, unsigned bits) {
+  if (bits >= 64)
+    return v;
+  uint64_t mask = (uint64_t(1) << bits) - 1;
+  uint64_t u = uint64_t(v) & mask;
+  if (u & (uint64_t(1) << (bits - 1)))
+    u |= ~mask;
+  return int64_t(u);
+}
+
+std::optional<IntConst> asIntConst(ast *node) {
+  if (auto *n = dynamic_cast<IntegerNode *>(node))
+    return IntConst{wrap(n->val, BType::IntegerBits), BType::IntegerBits};
+  if (auto *n = dynamic_cast<CharNode *>(node))
+    return IntConst{wrap(n->val, 8), 8};
+  if (auto *n = dynamic_cast<BooleanNode *>(node))
+    return IntConst{n->val ? -1 : 0, 1};
+  return std::nullopt;
+}
+
+std::unique_ptr<ast> makeConstant(IntConst c) {
+  switch (c.bits) {
+  case 1:
+    return std::make_unique<BooleanNode>(c.val != 0);
+  case 8:
+    return std::make_unique<CharNode>(static_cast<char>(c.val));
+  default:
+    return std::make_unique<IntegerNode>(c.val);
+  }
+}
+
+// Width of a declared scalar type whose lets may be propagated, 0 otherwise.
+// Only the types literals can have are tracked.
+unsigned declaredBits(const BType &type) {
+  switch (type.kind) {
+  case BType::Integer:
+  case BType::Char:
+  case BType::Boolean:
+    return type.bits();
+  default:
+    return 0;
+  }
+}
+
+void collectWrites(ast *node, std::unordered_set<std::string> &out) {
+  if (auto *n = dynamic_cast<AssignmentNode *>(node))
+    out.insert(n->name);
+  else if (auto *n = dynamic_cast<ArrayAssignNode *>(node))
+    out.insert(n->name);
+  else if (auto *n = dynamic_cast<PointerReferenceNode *>(node))
+    out.insert(n->name);
+
+  node->forEachChild(
+      [&](std::unique_ptr<ast> &child) { collectWrites(child.get(), out); });
+}
+
+// Mirrors sema and BinaryOperationNode::codegen: i1 operands of arithmetic
+// are promoted to Integer, both sides are sign-extended to the wider width,
+// and comparisons are signed. Literals are never unsigned.
+unsigned promote(unsigned bits) {
+  return bits == 1 ? BType::IntegerBits : bits;
+}
+
+std::optional<IntConst> evalBinary(TokenType op, IntConst l, IntConst r) {
+  switch (op) {
+  case PLUS:
+  case MINUS:
+  case STAR:
+  case SLASH:
+  case PERCENT: {
+    unsigned bits = std::max(promote(l.bits), promote(r.bits));
+    int64_t a = l.val;
+    int64_t b = r.val;
+    int64_t v = 0;
+    // Unsigned so that 64-bit overflow wraps instead of being UB here.
+    if (op == PLUS)
+      v = int64_t(uint64_t(a) + uint64_t(b));
+    else if (op == MINUS)
+      v = int64_t(uint64_t(a) - uint64_t(b));
+    else if (op == STAR)
+      v = int64_t(uint64_t(a) * uint64_t(b));
+    else {
+      // Division by zero and INT_MIN / -1 trap at runtime; leave them there.
+      if (b == 0 || (b == -1 && a == wrap(int64_t(1) << (bits - 1), bits)))
+        return std::nullopt;
+      v = op == SLASH ? a / b : a % b;
+    }
+    return IntConst{wrap(v, bits), bits};
+  }
+  case ANDPERCENT:
+  case PIPE:
+  case CARET: {
+    // Boolean & Boolean stays Boolean, anything else is integer math.
+    unsigned bits = l.bits == 1 && r.bits == 1
+                        ? 1
+                        : std::max(promote(l.bits), promote(r.bits));
+    int64_t v = op == ANDPERCENT ? l.val & r.val
+                : op == PIPE     ? l.val | r.val
+                                 : l.val ^ r.val;
+    return IntConst{wrap(v, bits), bits};
+  }
+  case SHL:
+  case SHR: {
+    // Out-of-range shift counts are poison in LLVM; leave them unfolded.
+    unsigned bits = promote(l.bits);
+    if (r.val < 0 || r.val >= int64_t(bits))
+      return std::nullopt;
+    int64_t v = op == SHL ? int64_t(uint64_t(l.val) << r.val) : l.val >> r.val;
+    return IntConst{wrap(v, bits), bits};
+  }
+  case EQEQ:
+  case NOTEQ:
+  case LT:
+  case LTE:
+  case GT:
+  case GTE: {
+    int64_t a = l.val;
+    int64_t b = r.val;
+    bool v = false;
+    switch (op) {
+    case EQEQ:
+      v = a == b;
+      break;
+    case NOTEQ:
+      v = a != b;
+      break;
+    case LT:
+      v = a < b;
+      break;
+    case LTE:
+      v = a <= b;
+      break;
+    case GT:
+      v = a > b;
+      break;
+    default:
+      v = a >= b;
+      break;
+    }
+    return IntConst{v ? -1 : 0, 1};
+  }
+  case AND:
+    return IntConst{(l.val != 0 && r.val != 0) ? -1 : 0, 1};
+  case OR:
+    return IntConst{(l.val != 0 || r.val != 0) ? -1 : 0, 1};
+  default:
+    return std::nullopt;
+  }
+}
+
+} // namespace
+
+std::unique_ptr<ast> ast::fold(FoldContext &fc) {
+  forEachChild([&fc](std::unique_ptr<ast> &child) { fc.fold(child); });
+  return nullptr;
+}
+
+std::unique_ptr<ast> BinaryOperationNode::fold(FoldContext &fc) {
+  fc.fold(Left);
+  fc.fold(Right);
+
+  auto l = asIntConst(Left.get());
+  auto r = asIntConst(Right.get());
+  if (!l || !r)
+    return nullptr;
+
+  if (auto v = evalBinary(Type, *l, *r))
+    return makeConstant(*v);
+  return nullptr;
+}
+
+std::unique_ptr<ast> UnaryOperationNode::fold(FoldContext &fc) {
+  fc.fold(Operand);
+
+  auto c = asIntConst(Operand.get());
+  if (!c)
+    return nullptr;
+
+  unsigned bits = promote(c->bits);
+  return makeConstant({wrap(~c->val, bits), bits});
+}
+
+std::unique_ptr<ast> CastNode::fold(FoldContext &fc) {
+  fc.fold(Value);
+
+  auto c = asIntConst(Value.get());
+  if (!c)
+    return nullptr;
+
+  if (unsigned bits = declaredBits(targetType))
+    return makeConstant({wrap(c->val, bits), bits});
+
+  if (targetType.kind == BType::Float)
+    return std::make_unique<FloatNode>(static_cast<float>(c->val));
+
+  return nullptr;
+}
+
+std::unique_ptr<ast> VariableReferenceNode::fold(FoldContext &fc) {
+  ast *known = fc.lookup(Name);
+  if (!known)
+    return nullptr;
+  return makeConstant(*asIntConst(known));
+}
+
+std::unique_ptr<ast> VariableDeclareNode::fold(FoldContext &fc) {
+  fc.fold(val);
+
+  std::unique_ptr<ast> known;
+  unsigned bits = declaredBits(Type);
+  if (bits && !fc.written.count(name)) {
+    if (!val) {
+      known = makeConstant({0, bits});
+    } else if (auto c = asIntConst(val.get()); c && c->bits == bits) {
+      known = makeConstant(*c);
+    }
+  }
+
+  fc.bind(name, std::move(known));
+  return nullptr;
+}
+
+std::unique_ptr<ast> CompoundNode::fold(FoldContext &fc) {
+  fc.pushScope();
+  for (auto &block : blocks)
+    fc.fold(block);
+  fc.popScope();
+  return nullptr;
+}
+
+std::unique_ptr<ast> IfNode::fold(FoldContext &fc) {
+  fc.fold(condition);
+
+  if (auto c = asIntConst(condition.get())) {
+    std::unique_ptr<ast> taken =
+        c->val != 0 ? std::move(thenBlock) : std::move(elseBlock);
+
+    // Keep the branch in its own scope, like IfNode::codegen does.
+    if (!dynamic_cast<CompoundNode *>(taken.get())) {
+      std::vector<std::unique_ptr<ast>> blocks;
+      if (taken)
+        blocks.push_back(std::move(taken));
+      taken = std::make_unique<CompoundNode>(std::move(blocks));
+    }
+    fc.fold(taken);
+    return taken;
+  }
+
+  fc.pushScope();
+  fc.fold(thenBlock);
+  fc.popScope();
+
+  fc.pushScope();
+  fc.fold(elseBlock);
+  fc.popScope();
+  return nullptr;
+}
+
+std::unique_ptr<ast> WhileNode::fold(FoldContext &fc) {
+  fc.fold(condition);
+
+  if (auto c = asIntConst(condition.get()); c && c->val == 0)
+    return std::make_unique<CompoundNode>(std::vector<std::unique_ptr<ast>>{});
+
+  fc.fold(body);
+  return nullptr;
+}
+
+std::unique_ptr<ast> RangeForNode::fold(FoldContext &fc) {
+  fc.fold(start);
+  fc.fold(end);
+  fc.fold(step);
+
+  fc.pushScope();
+  fc.bind(var, nullptr);
+  fc.fold(body);
+  fc.popScope();
+  return nullptr;
+}
+
+std::unique_ptr<ast> FunctionNode::fold(FoldContext &fc) {
+  if (!content)
+    return nullptr;
+
+  auto outerWritten = std::move(fc.written);
+  fc.written.clear();
+  collectWrites(content.get(), fc.written);
+
+  fc.pushScope();
+  for (auto &arg : args)
+    fc.bind(std::get<0>(arg), nullptr);
+  fc.fold(content);
+  fc.popScope();
+
+  fc.written = std::move(outerWritten);
+  return nullptr;
+}
+
+void foldProgram(std::vector<std::unique_ptr<ast>> &program) {
+  FoldContext fc;
+  fc.pushScope();
+  for (auto &node : program)
+    fc.fold(node);
+  fc.popScope();
+}
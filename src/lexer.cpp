@@ -89,6 +89,10 @@ std::vector<Token> Lexer::lexer() {
         type = IMPORT;
       else if (lw == "syscall")
         type = SYSCALL;
+      else {
+        out.push_back(make(ATTRIBUTE, lw));
+        continue;
+      }
       out.push_back(make(type, word));
       continue;
     }
@@ -246,6 +250,10 @@ std::vector<Token> Lexer::lexer() {
         out.push_back(make(SIZEOF, id));
         continue;
       }
+      if (lower == "alignof") {
+        out.push_back(make(ALIGNOF, id));
+        continue;
+      }
       if (lower == "break") {
         out.push_back(make(BREAK, id));
         continue;
@@ -255,14 +263,8 @@ std::vector<Token> Lexer::lexer() {
         continue;
       }
 
-      if (id == "Integer" || id == "Float" || id == "Boolean" ||
-          id == "String" || id == "Void" || id == "Char") {
-        std::string typeName = id;
-        if (Peek() == '*') {
-          Consume();
-          typeName += "POINTER";
-        }
-        out.push_back(make(TYPES, typeName));
+      if (BType::fromName(id).isKnown()) {
+        out.push_back(make(TYPES, id));
         continue;
       }
 
@@ -283,6 +285,18 @@ std::vector<Token> Lexer::lexer() {
       out.push_back(make(NOTEQ, "!="));
       continue;
     }
+    if (c == '<' && PeekNext() == '<') {
+      Consume();
+      Consume();
+      out.push_back(make(SHL, "<<"));
+      continue;
+    }
+    if (c == '>' && PeekNext() == '>') {
+      Consume();
+      Consume();
+      out.push_back(make(SHR, ">>"));
+      continue;
+    }
     if (c == '<' && PeekNext() == '=') {
       Consume();
       Consume();
@@ -345,6 +359,22 @@ std::vector<Token> Lexer::lexer() {
       Consume();
       out.push_back(make(SLASH, "/"));
       break;
+    case '%':
+      Consume();
+      out.push_back(make(PERCENT, "%"));
+      break;
+    case '|':
+      Consume();
+      out.push_back(make(PIPE, "|"));
+      break;
+    case '^':
+      Consume();
+      out.push_back(make(CARET, "^"));
+      break;
+    case '~':
+      Consume();
+      out.push_back(make(TILDE, "~"));
+      break;
     case '=':
       Consume();
       out.push_back(make(EQ, "="));
@@ -389,6 +419,10 @@ std::vector<Token> Lexer::lexer() {
       Consume();
       out.push_back(make(COMMA, ","));
       break;
+    case '.':
+      Consume();
+      out.push_back(make(DOT, "."));
+      break;
     case ';':
       Consume();
       out.push_back(make(SEMICOLON, ";"));
@@ -418,6 +452,8 @@ const char *tokenName(TokenType t) {
     return "IMPORT";
   case SYSCALL:
     return "SYSCALL";
+  case ATTRIBUTE:
+    return "ATTRIBUTE";
   case LET:
     return "LET";
   case FUNC:
@@ -470,6 +506,18 @@ const char *tokenName(TokenType t) {
     return "AND";
   case OR:
     return "OR";
+  case PERCENT:
+    return "PERCENT";
+  case PIPE:
+    return "PIPE";
+  case CARET:
+    return "CARET";
+  case TILDE:
+    return "TILDE";
+  case SHL:
+    return "SHL";
+  case SHR:
+    return "SHR";
   case LPAREN:
     return "LPAREN";
   case RPAREN:
@@ -486,6 +534,8 @@ const char *tokenName(TokenType t) {
     return "DASHGREATER";
   case RANGE:
     return "RANGE";
+  case DOT:
+    return "DOT";
   case EOF_TOKEN:
     return "EOF";
   case TYPES:
@@ -500,6 +550,8 @@ const char *tokenName(TokenType t) {
     return "STRING_LITERAL";
   case SIZEOF:
     return "SIZEOF";
+  case ALIGNOF:
+    return "ALIGNOF";
   case ANDPERCENT:
     return "ANDPERCENT";
   case VARIDIC:
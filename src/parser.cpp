@@ -3,8 +3,10 @@
 #include <Diagnosis.h>
 #include <cctype>
 #include <colors.h>
+#include <fold.h>
 #include <cstdio>
 #include <cstdlib>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <llvm-18/llvm/ADT/STLExtras.h>
@@ -14,11 +16,21 @@
 #include <llvm-18/llvm/IR/Intrinsics.h>
 #include <llvm-18/llvm/IR/PassManager.h>
 #include <llvm-18/llvm/IR/Type.h>
+#include <llvm-18/llvm/IR/Verifier.h>
+#include <llvm-18/llvm/IRReader/IRReader.h>
+#include <llvm-18/llvm/Linker/Linker.h>
+#include <llvm-18/llvm/MC/TargetRegistry.h>
+#include <llvm-18/llvm/Passes/PassBuilder.h>
 #include <llvm-18/llvm/Support/CommandLine.h>
 #include <llvm-18/llvm/Support/Error.h>
 #include <llvm-18/llvm/Support/MathExtras.h>
+#include <llvm-18/llvm/Support/SourceMgr.h>
+#include <llvm-18/llvm/Support/TargetSelect.h>
 #include <llvm-18/llvm/Support/raw_ostream.h>
+#include <llvm-18/llvm/Target/TargetMachine.h>
+#include <llvm-18/llvm/Target/TargetOptions.h>
 #include <llvm-18/llvm/TargetParser/Host.h>
+#include <llvm-18/llvm/Transforms/IPO/Internalize.h>
 #include <llvm/IR/IRPrintingPasses.h>
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/LegacyPassManager.h>
@@ -27,12 +39,19 @@
 #include <llvm/Support/raw_ostream.h>
 #include <memory>
 #include <parser.h>
+#include <sema.h>
+#include <sstream>
 #include <stdexcept>
 #include <string>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
+// Where libbasiq_rt.a lives; CMake points this at its build directory.
+#ifndef BASIQ_RUNTIME_DIR
+#define BASIQ_RUNTIME_DIR "."
+#endif
+
 Token Parser::Peek() {
   if (x < input.size()) {
     return input[x];
@@ -74,16 +93,46 @@ SourceLoc Parser::loc() {
   Token t = Peek();
   return {t.file, t.line, t.col};
 }
+BType Parser::ParseType() {
+  Token tok = Peek();
+  BType type;
+
+  if (tok.type == TYPES) {
+    Consume();
+    type = BType::fromName(tok.value);
+  } else if (tok.type == IDENTIFIER) {
+    Consume();
+    type = BType::structNamed(tok.value);
+  } else {
+    diag.error(loc(), "expected a type, got '" +
+                          std::string(tokenName(tok.type)) + "'");
+    throw Diagnostics::FatalError("parse failure");
+  }
+
+  while (Peek().type == STAR) {
+    Consume();
+    type = BType::pointerTo(type);
+  }
+  // T[] is a slice; T[N] is left to the declarations that allow arrays.
+  if (Peek().type == LBRACKET && PeekNext().type == RBRACKET) {
+    Consume();
+    Consume();
+    type = BType::sliceOf(type);
+  }
+  return type;
+}
+
 std::unique_ptr<ast> Parser::ParseFactor() {
+  Token start = Peek();
   if (Peek().type == TokenType::INT_LITERAL) {
-    int val = std::stoi(Peek().value);
+    int64_t val = std::stoll(Peek().value);
     Consume();
-    return std::make_unique<IntegerNode>(val);
+    return node<IntegerNode>(start, val);
 
   } else if (Peek().type == TokenType::FLOAT_LITERAL) {
     float val = std::stof(Peek().value);
     Consume();
-    return std::make_unique<FloatNode>(val);
+    return node<FloatNode>(start, val);
 
   } else if (Peek().type == TokenType::BOOLEAN_LITERAL) {
 
@@ -95,43 +144,34 @@ std::unique_ptr<ast> Parser::ParseFactor() {
 
     if (tok.value == "TRUE") {
       Consume();
-      return std::make_unique<BooleanNode>(true);
+      return node<BooleanNode>(start, true);
     }
 
     Consume();
-    return std::make_unique<BooleanNode>(false);
+    return node<BooleanNode>(start, false);
 
   } else if (Peek().type == STRING_LITERAL) {
     std::string val = Peek().value;
     Consume();
     if (val.size() == 1) { // treat single-character strings as Char
-      return std::make_unique<CharNode>(val[0]);
+      return node<CharNode>(start, val[0]);
     }
 
-    // multi-character strings become arrays
-    std::vector<std::unique_ptr<ast>> outputs;
-    for (auto &tok : val) {
-      outputs.push_back(std::make_unique<CharNode>(tok));
-    }
-    if (!outputs.empty() &&
-        static_cast<CharNode *>(outputs.back().get())->val != '\0') {
-      outputs.push_back(std::make_unique<CharNode>(0));
-    }
-    return std::make_unique<ArrayLiteralNode>(
-        llvm::Type::getInt32Ty(*cc.TheContext), std::move(outputs));
+    // multi-character strings become read-only Char* constants
+    if (!val.empty() && val.back() == '\0')
+      val.pop_back();
+    return node<StringNode>(start, val);
   }
 
   else if (Peek().type == TokenType::LPAREN) {
     Expect(TokenType::LPAREN);
 
     if (Peek().type == TYPES) {
-      Token type = Peek();
-      Expect(TYPES);
+      BType type = ParseType();
       Expect(RPAREN);
       auto val = ParseExpression();
 
-      return std::make_unique<CastNode>(std::move(val),
-                                        GetTypeNonVoid(type, cc));
+      return node<CastNode>(start, std::move(val), type);
     }
 
     auto val = ParseExpression();
@@ -157,7 +197,7 @@ std::unique_ptr<ast> Parser::ParseFactor() {
     }
 
     Expect(TokenType::RBRACKET);
-    return std::make_unique<ArrayLiteralNode>(nullptr, std::move(elements));
+    return node<ArrayLiteralNode>(start, std::move(elements));
 
   } else if (Peek().type == TokenType::IDENTIFIER) {
 
@@ -173,7 +213,7 @@ std::unique_ptr<ast> Parser::ParseFactor() {
 
       // kxpect(SEMICOLON);
 
-      return std::make_unique<AssignmentNode>(name.value, std::move(val));
+      return node<AssignmentNode>(start, name.value, std::move(val));
 
     } else if (Peek().type == LPAREN) {
 
@@ -197,22 +237,35 @@ std::unique_ptr<ast> Parser::ParseFactor() {
 
       Expect(RPAREN);
 
-      return std::make_unique<CallNode>(name.value, std::move(args));
+      return node<CallNode>(start, name.value, std::move(args));
     } else if (Peek().type == LBRACKET) {
       Consume();
-      auto val = ParseExpression();
+      std::unique_ptr<ast> val;
+      if (Peek().type != RANGE)
+        val = ParseExpression();
+      // name[lo..hi], either bound optional
+      if (Peek().type == RANGE) {
+        Consume();
+        std::unique_ptr<ast> hi;
+        if (Peek().type != RBRACKET)
+          hi = ParseExpression();
+        Expect(RBRACKET);
+        return node<SubSliceNode>(start, name.value, std::move(val),
+                                  std::move(hi));
+      }
       // if (!dynamic_cast<IntegerNode *>(val.get())) {
       //   throw std::runtime_error("Expected a Number, But got Something
       //   Else");
       // }
       Expect(RBRACKET);
 
-      return std::make_unique<ArrayAccessNode>(name.value, std::move(val));
+      return ParseMembers(
+          node<ArrayAccessNode>(start, name.value, std::move(val)));
 
       // return std::make_unique<SizeOfNode>(std::move(val));
 
     } else {
-      return std::make_unique<VariableReferenceNode>(name.value);
+      return ParseMembers(node<VariableReferenceNode>(start, name.value));
     }
   } else if (Peek().type == CHAR_LITERAL) {
     Token val = Consume();
@@ -220,14 +273,28 @@ std::unique_ptr<ast> Parser::ParseFactor() {
       throw std::runtime_error("Expected a single value as a char but got" +
                                std::to_string(val.value.size()));
     }
-    return std::make_unique<CharNode>(val.value[0]);
-  } else if (Peek().type == SIZEOF) {
-    Consume();
+    return node<CharNode>(start, val.value[0]);
+  } else if (Peek().type == SIZEOF || Peek().type == ALIGNOF) {
+    bool align = Consume().type == ALIGNOF;
     Expect(LPAREN);
-    auto val = ParseExpression();
+    std::unique_ptr<SizeOfNode> size;
+    // Built-in type names are unambiguous here; a struct name parses as a
+    // variable reference and sema tells the two apart.
+    if (Peek().type == TYPES) {
+      BType type = ParseType();
+      if (Peek().type == LBRACKET) {
+        Consume();
+        Token count = Expect(INT_LITERAL);
+        Expect(RBRACKET);
+        type = BType::arrayOf(type, std::stoi(count.value));
+      }
+      size = node<SizeOfNode>(start, type);
+    } else {
+      size = node<SizeOfNode>(start, ParseExpression());
+    }
     Expect(RPAREN);
-
-    return std::make_unique<SizeOfNode>(std::move(val));
+    size->align = align;
+    return size;
   } else if (Peek().type == SYSCALL) {
     Consume();
     Expect(LPAREN);
@@ -248,12 +315,17 @@ std::unique_ptr<ast> Parser::ParseFactor() {
 
     Expect(RPAREN);
 
-    return std::make_unique<SyscallNode>(std::stoi(name.value),
-                                         std::move(args));
+    return node<SyscallNode>(start, std::stoi(name.value), std::move(args));
+  } else if (Peek().type == TILDE) {
+    Consume();
+    auto operand = ParseFactor();
+    if (!operand)
+      throw std::runtime_error("Expected expression after ~");
+    return node<UnaryOperationNode>(start, TILDE, std::move(operand));
   } else if (Peek().type == ANDPERCENT) {
     Consume();
     Token name = Expect(IDENTIFIER);
-    return std::make_unique<PointerReferenceNode>(name.value);
+    return node<PointerReferenceNode>(start, name.value);
 
   } else if (Peek().type == STAR) {
 
@@ -269,13 +341,13 @@ std::unique_ptr<ast> Parser::ParseFactor() {
         if (Peek().type == EQ) {
           Consume();
           auto val = ParseExpression();
-          return std::make_unique<PointerDeReferenceAssingNode>(
-              v.value, std::move(val), std::move(idx));
+          return node<PointerDeReferenceAssingNode>(
+              start, v.value, std::move(val), std::move(idx));
         }
-        return std::make_unique<DeReferenceNode>(v.value, std::move(idx));
+        return node<DeReferenceNode>(start, v.value, std::move(idx));
       }
 
-      return std::make_unique<DeReferenceNode>(v.value, nullptr);
+      return node<DeReferenceNode>(start, v.value, nullptr);
     }
     return nullptr;
 
@@ -291,19 +363,37 @@ std::unique_ptr<ast> Parser::ParseFactor() {
   }
 }
 
+// Postfix `.field` chains after a variable or array element, and an
+// assignment to the last field.
+std::unique_ptr<ast> Parser::ParseMembers(std::unique_ptr<ast> base) {
+  if (Peek().type != DOT)
+    return base;
+  while (Peek().type == DOT) {
+    Consume();
+    Token field = Expect(IDENTIFIER);
+    base = node<MemberAccessNode>(field, std::move(base), field.value);
+  }
+  if (Peek().type == EQ) {
+    Token eq = Consume();
+    auto val = ParseExpression();
+    return node<MemberAssignNode>(eq, std::move(base), std::move(val));
+  }
+  return base;
+}
+
 std::unique_ptr<ast> Parser::ParseTerm() {
   std::unique_ptr<ast> left = ParseFactor();
-  while (Peek().type == TokenType::STAR || Peek().type == TokenType::SLASH) {
-    TokenType type = Peek().type;
-    Consume();
+  while (Peek().type == TokenType::STAR || Peek().type == TokenType::SLASH ||
+         Peek().type == TokenType::PERCENT) {
+    Token op = Consume();
 
     std::unique_ptr<ast> right = ParseFactor();
 
     if (!right)
-      throw std::runtime_error("EXPECTED A NUMBER AFTER * OR /");
+      throw std::runtime_error("EXPECTED A NUMBER AFTER * OR / OR %");
 
-    left = std::make_unique<BinaryOperationNode>(type, std::move(left),
-                                                 std::move(right));
+    left = node<BinaryOperationNode>(op, op.type, std::move(left),
+                                     std::move(right));
   }
 
   return left;
@@ -312,68 +402,122 @@ std::unique_ptr<ast> Parser::ParseTerm() {
 std::unique_ptr<ast> Parser::ParseAddSub() {
   std::unique_ptr<ast> left = ParseTerm();
   while (Peek().type == TokenType::PLUS || Peek().type == TokenType::MINUS) {
-    TokenType type = Peek().type;
-    Consume();
+    Token op = Consume();
     std::unique_ptr<ast> right = ParseTerm();
     if (!right)
       throw std::runtime_error("Expected expression after + or -");
-    left = std::make_unique<BinaryOperationNode>(type, std::move(left),
-                                                 std::move(right));
+    left = node<BinaryOperationNode>(op, op.type, std::move(left),
+                                     std::move(right));
   }
   return left;
 }
-std::unique_ptr<ast> Parser::ParseComparison() {
+std::unique_ptr<ast> Parser::ParseShift() {
   std::unique_ptr<ast> left = ParseAddSub();
+  while (Peek().type == TokenType::SHL || Peek().type == TokenType::SHR) {
+    Token op = Consume();
+    std::unique_ptr<ast> right = ParseAddSub();
+    if (!right)
+      throw std::runtime_error("Expected expression after << or >>");
+    left = node<BinaryOperationNode>(op, op.type, std::move(left),
+                                     std::move(right));
+  }
+  return left;
+}
+
+std::unique_ptr<ast> Parser::ParseComparison() {
+  std::unique_ptr<ast> left = ParseShift();
   while (Peek().type == TokenType::GT || Peek().type == TokenType::GTE ||
          Peek().type == TokenType::LT || Peek().type == TokenType::LTE ||
          Peek().type == TokenType::EQEQ || Peek().type == NOTEQ) {
-    TokenType type = Peek().type;
-    Consume();
-    std::unique_ptr<ast> right = ParseAddSub();
+    Token op = Consume();
+    std::unique_ptr<ast> right = ParseShift();
     if (!right)
       throw std::runtime_error("Expected expression after comparison");
-    left = std::make_unique<BinaryOperationNode>(type, std::move(left),
-                                                 std::move(right));
+    left = node<BinaryOperationNode>(op, op.type, std::move(left),
+                                     std::move(right));
   }
   return left;
 }
 
-std::unique_ptr<ast> Parser::ParseExpression() {
+// Binary & shares its token with address-of; here it can only be infix.
+std::unique_ptr<ast> Parser::ParseBitAnd() {
   std::unique_ptr<ast> left = ParseComparison();
-  while (Peek().type == TokenType::AND) {
-    TokenType type = Peek().type;
-    Consume();
+  while (Peek().type == TokenType::ANDPERCENT) {
+    Token op = Consume();
     std::unique_ptr<ast> right = ParseComparison();
+    if (!right)
+      throw std::runtime_error("Expected expression after &");
+    left = node<BinaryOperationNode>(op, op.type, std::move(left),
+                                     std::move(right));
+  }
+  return left;
+}
+
+std::unique_ptr<ast> Parser::ParseBitXor() {
+  std::unique_ptr<ast> left = ParseBitAnd();
+  while (Peek().type == TokenType::CARET) {
+    Token op = Consume();
+    std::unique_ptr<ast> right = ParseBitAnd();
+    if (!right)
+      throw std::runtime_error("Expected expression after ^");
+    left = node<BinaryOperationNode>(op, op.type, std::move(left),
+                                     std::move(right));
+  }
+  return left;
+}
+
+std::unique_ptr<ast> Parser::ParseBitOr() {
+  std::unique_ptr<ast> left = ParseBitXor();
+  while (Peek().type == TokenType::PIPE) {
+    Token op = Consume();
+    std::unique_ptr<ast> right = ParseBitXor();
+    if (!right)
+      throw std::runtime_error("Expected expression after |");
+    left = node<BinaryOperationNode>(op, op.type, std::move(left),
+                                     std::move(right));
+  }
+  return left;
+}
+
+std::unique_ptr<ast> Parser::ParseLogicalAnd() {
+  std::unique_ptr<ast> left = ParseBitOr();
+  while (Peek().type == TokenType::AND) {
+    Token op = Consume();
+    std::unique_ptr<ast> right = ParseBitOr();
     if (!right)
       throw std::runtime_error("Expected expression after &&");
-    left = std::make_unique<BinaryOperationNode>(type, std::move(left),
-                                                 std::move(right));
+    left = node<BinaryOperationNode>(op, op.type, std::move(left),
+                                     std::move(right));
+  }
+  return left;
+}
+
+std::unique_ptr<ast> Parser::ParseExpression() {
+  std::unique_ptr<ast> left = ParseLogicalAnd();
+  while (Peek().type == TokenType::OR) {
+    Token op = Consume();
+    std::unique_ptr<ast> right = ParseLogicalAnd();
+    if (!right)
+      throw std::runtime_error("Expected expression after ||");
+    left = node<BinaryOperationNode>(op, op.type, std::move(left),
+                                     std::move(right));
   }
   return left;
 }
 
 std::unique_ptr<VariableDeclareNode> Parser::ParseVariable() {
+  Token start = Peek();
   Expect(TokenType::LET);
   Token name = Expect(TokenType::IDENTIFIER);
 
   Expect(TokenType::COLON);
-  Token type;
-
-  if (Peek().type == TokenType::TYPES) {
-    type = Expect(TokenType::TYPES);
-  } else if (Peek().type == TokenType::IDENTIFIER) {
-    type = Expect(TokenType::IDENTIFIER);
-  } else {
-    throw std::runtime_error("Expected TYPES or IDENTIFIER");
-  }
-
-  unsigned size = 1;
+  BType type = ParseType();
 
   if (Peek().type == TokenType::LBRACKET) {
     Consume();
-    Token somerandomval = Expect(TokenType::INT_LITERAL);
+    Token size = Expect(TokenType::INT_LITERAL);
     Expect(RBRACKET);
-    size += std::stoi(somerandomval.value) - 1;
+    type = BType::arrayOf(type, std::stoi(size.value));
   }
 
   std::unique_ptr<ast> val = nullptr;
@@ -382,13 +526,14 @@ std::unique_ptr<VariableDeclareNode> Parser::ParseVariable() {
     val = ParseExpression();
 
     if (auto arrNode = dynamic_cast<ArrayLiteralNode *>(val.get())) {
-      if (arrNode->Elements.size() > size) {
+      if (type.isArray() && arrNode->Elements.size() > type.count) {
         diag.error(loc(),
                    "array initializer has " +
                        std::to_string(arrNode->Elements.size()) +
-                       " elements but declared size is " + std::to_string(size),
+                       " elements but declared size is " +
+                       std::to_string(type.count),
                    "reduce initializer or increase declared size: let x:" +
-                       type.value + "[" +
+                       type.element().str() + "[" +
                        std::to_string(arrNode->Elements.size()) + "]");
       }
     }
@@ -396,35 +541,30 @@ std::unique_ptr<VariableDeclareNode> Parser::ParseVariable() {
 
   Expect(TokenType::SEMICOLON);
 
-  return std::make_unique<VariableDeclareNode>(name.value, std::move(val), type,
-                                               size);
+  return node<VariableDeclareNode>(start, name.value, std::move(val), type);
 }
 
 std::unique_ptr<FunctionNode> Parser::ParseFunction() {
+  Token start = Peek();
   Expect(TokenType::FUNC);
   bool varidicType = false;
   Token name = Expect(TokenType::IDENTIFIER);
   Expect(LPAREN);
-  std::vector<std::tuple<std::string, llvm::Type *>> args;
+  std::vector<std::tuple<std::string, BType>> args;
 
   while (Peek().type != RPAREN) {
     Token paramName = Expect(IDENTIFIER);
     Expect(COLON);
-    Token type = Expect(TYPES);
-    llvm::Type *llvmType = GetTypeVoid(type, cc);
+    BType type = ParseType();
 
-    unsigned arraySize = 0;
     if (Peek().type == LBRACKET) {
       Consume();
       Token sizeTok = Expect(INT_LITERAL);
-      arraySize = std::stoi(sizeTok.value);
       Expect(RBRACKET);
-
-      // Create LLVM array type
-      llvmType = llvm::ArrayType::get(llvmType, arraySize);
+      type = BType::arrayOf(type, std::stoi(sizeTok.value));
     }
 
-    args.push_back({paramName.value, llvmType});
+    args.push_back({paramName.value, type});
 
     if (Peek().type == COMMA) {
       Consume();
@@ -440,16 +580,17 @@ std::unique_ptr<FunctionNode> Parser::ParseFunction() {
   }
   Expect(RPAREN);
   Expect(DASHGREATER);
-  auto rettype = Expect(TYPES);
+  BType rettype = ParseType();
   std::unique_ptr<ast> block = ParseStatement();
   if (!block)
     diag.error(loc(), "function '" + name.value + "' has no body");
 
-  return std::make_unique<FunctionNode>(name.value, args, std::move(block),
-                                        rettype, varidicType);
+  return node<FunctionNode>(start, name.value, args, std::move(block),
+                            rettype, varidicType);
 }
 
 std::unique_ptr<CompoundNode> Parser::ParseCompound() {
+  Token start = Peek();
   std::vector<std::unique_ptr<ast>> vals;
 
   Expect(LBRACE);
@@ -470,19 +611,21 @@ std::unique_ptr<CompoundNode> Parser::ParseCompound() {
   // std::cout << tokenName(Peek().type) << std::endl;
   Expect(RBRACE);
 
-  return std::make_unique<CompoundNode>(std::move(vals));
+  return node<CompoundNode>(start, std::move(vals));
 }
 std::unique_ptr<ReturnNode> Parser::ParseReturn() {
+  Token start = Peek();
   Expect(RETURN);
   auto val = ParseExpression();
   // if (!val)
   //   throw std::runtime_error("ERROR: Return statement MIssing Expression");
   // std::cout << tokenName(Peek().type) << std::endl;
   Expect(SEMICOLON);
-  return std::make_unique<ReturnNode>(std::move(val));
+  return node<ReturnNode>(start, std::move(val));
 }
 
 std::unique_ptr<IfNode> Parser::ParseIfElse() {
+  Token start = Peek();
   Expect(IF);
   // Expect(LPAREN);
   auto args = ParseExpression();
@@ -507,22 +650,128 @@ std::unique_ptr<IfNode> Parser::ParseIfElse() {
     }
   }
 
-  return std::make_unique<IfNode>(std::move(args), std::move(TrueBlock),
-                                  std::move(ElseBlock));
+  return node<IfNode>(start, std::move(args), std::move(TrueBlock),
+                      std::move(ElseBlock));
 }
 
 std::unique_ptr<WhileNode> Parser::ParseWhile() {
+  Token start = Peek();
   Expect(WHILE);
   Expect(LPAREN);
   auto args = ParseExpression();
   Expect(RPAREN);
   auto block = ParseStatement();
 
-  return std::make_unique<WhileNode>(std::move(args), std::move(block));
+  return node<WhileNode>(start, std::move(args), std::move(block));
+}
+
+std::unique_ptr<RangeForNode>
+Parser::ParseRangeFor(const Token &start,
+                      std::unique_ptr<ParallelSpec> parallel) {
+  Token var = Expect(IDENTIFIER);
+  Expect(IN);
+  auto from = ParseExpression();
+  Expect(RANGE);
+  auto to = ParseExpression();
+
+  // `step` is only a keyword here, so it stays usable as a name elsewhere.
+  std::unique_ptr<ast> step;
+  if (Peek().type == IDENTIFIER && Peek().value == "step") {
+    Token stepTok = Consume();
+    bool negative = Peek().type == MINUS;
+    if (negative)
+      Consume();
+    step = ParseExpression();
+    if (negative)
+      step = node<BinaryOperationNode>(stepTok, MINUS,
+                                       node<IntegerNode>(stepTok, 0),
+                                       std::move(step));
+  }
+
+  if (parallel && Peek().type == IDENTIFIER && Peek().value == "reduce")
+    ParseReductions(*parallel);
+
+  auto body = ParseStatement();
+  auto loop = node<RangeForNode>(start, var.value, std::move(from),
+                                 std::move(to), std::move(step),
+                                 std::move(body));
+  loop->parallel = std::move(parallel);
+  return loop;
+}
+
+// reduce(+: total, max: peak)
+void Parser::ParseReductions(ParallelSpec &spec) {
+  Consume();
+  Expect(LPAREN);
+  while (true) {
+    Token opTok = Consume();
+    ReduceOp op;
+    switch (opTok.type) {
+    case PLUS:
+      op = ReduceOp::Add;
+      break;
+    case STAR:
+      op = ReduceOp::Mul;
+      break;
+    case ANDPERCENT:
+      op = ReduceOp::And;
+      break;
+    case PIPE:
+      op = ReduceOp::Or;
+      break;
+    case CARET:
+      op = ReduceOp::Xor;
+      break;
+    default:
+      if (opTok.type == IDENTIFIER && opTok.value == "min") {
+        op = ReduceOp::Min;
+        break;
+      }
+      if (opTok.type == IDENTIFIER && opTok.value == "max") {
+        op = ReduceOp::Max;
+        break;
+      }
+      diag.error({opTok.file, opTok.line, opTok.col},
+                 "unknown reduction operator '" + opTok.value + "'",
+                 "use one of + * & | ^ min max");
+      throw Diagnostics::FatalError("parse failure");
+    }
+    Expect(COLON);
+    Token name = Expect(IDENTIFIER);
+    spec.reductions.push_back(
+        {op, name.value, {name.file, name.line, name.col}});
+    if (Peek().type != COMMA)
+      break;
+    Consume();
+  }
+  Expect(RPAREN);
+}
+
+// parallel [static|dynamic] [(chunk)] for i in a..b [step n] [reduce(...)]
+std::unique_ptr<RangeForNode> Parser::ParseParallel() {
+  Token start = Consume();
+  auto spec = std::make_unique<ParallelSpec>();
+
+  if (Peek().type == IDENTIFIER &&
+      (Peek().value == "static" || Peek().value == "dynamic")) {
+    spec->schedule =
+        Consume().value == "dynamic" ? Schedule::Dynamic : Schedule::Static;
+    if (Peek().type == LPAREN) {
+      Consume();
+      spec->chunk = std::stoll(Expect(INT_LITERAL).value);
+      Expect(RPAREN);
+    }
+  }
+
+  Expect(FOR);
+  return ParseRangeFor(start, std::move(spec));
 }
 
-std::unique_ptr<ForNode> Parser::ParseFor() {
+std::unique_ptr<ast> Parser::ParseFor() {
+  Token start = Peek();
   Expect(FOR);
+  if (Peek().type == IDENTIFIER)
+    return ParseRangeFor(start);
   Expect(LPAREN);
 
   auto init = ParseExpression();
@@ -539,11 +788,12 @@ std::unique_ptr<ForNode> Parser::ParseFor() {
 
   auto body = ParseStatement();
 
-  return std::make_unique<ForNode>(std::move(init), std::move(condition),
-                                   std::move(incremnt), std::move(body));
+  return node<ForNode>(start, std::move(init), std::move(condition),
+                       std::move(incremnt), std::move(body));
 }
 
 std::unique_ptr<ast> Parser::ParseAssignment() {
+  Token start = Peek();
   Token name;
   if (Peek().type == IDENTIFIER &&
       (PeekNext().type == EQ || PeekNext().type == LBRACKET)) {
@@ -555,34 +805,46 @@ std::unique_ptr<ast> Parser::ParseAssignment() {
 
     Expect(SEMICOLON);
 
-    return std::make_unique<AssignmentNode>(name.value, std::move(val));
+    return node<AssignmentNode>(start, name.value, std::move(val));
   } else if (Peek().type == LBRACKET) {
     Consume();
     auto locaiton = ParseExpression();
     Expect(RBRACKET);
 
+    // a[i].field = value
+    if (Peek().type == DOT)
+      return ParseMembers(
+          node<ArrayAccessNode>(start, name.value, std::move(locaiton)));
+
     Expect(EQ);
     auto val = ParseExpression();
     // Expect(SEMICOLON);
 
-    return std::make_unique<ArrayAssignNode>(name.value, std::move(locaiton),
-                                             std::move(val));
+    return node<ArrayAssignNode>(start, name.value, std::move(locaiton),
+                                 std::move(val));
   }
   return nullptr;
 }
 
 std::unique_ptr<StructCreateNode> Parser::ParseStruct() {
+  Token start = Peek();
   Expect(STRUCT);
   Token name = Expect(IDENTIFIER);
   Expect(LBRACKET);
 
-  std::unordered_map<std::string, llvm::Type *> types;
+  std::vector<std::pair<std::string, BType>> fields;
   while (Peek().type != RBRACKET) {
     Token identifier = Expect(IDENTIFIER);
     Expect(COLON);
-    Token type = Expect(TYPES);
+    BType type = ParseType();
+    if (Peek().type == LBRACKET) {
+      Consume();
+      Token size = Expect(INT_LITERAL);
+      Expect(RBRACKET);
+      type = BType::arrayOf(type, std::stoi(size.value));
+    }
 
-    types.emplace(identifier.value, GetTypeNonVoid(type, cc));
+    fields.emplace_back(identifier.value, type);
 
     if (Peek().type == COMMA) {
       Expect(COMMA);
@@ -592,14 +854,17 @@ std::unique_ptr<StructCreateNode> Parser::ParseStruct() {
   }
   Expect(RBRACKET);
   Expect(SEMICOLON);
-  return std::make_unique<StructCreateNode>(name.value, types);
+  return node<StructCreateNode>(start, name.value, std::move(fields));
 }
 
 std::unique_ptr<ast> Parser::ParseStatement() {
+  Token start = Peek();
   if (Peek().type == TokenType::LET) {
     return ParseVariable();
   } else if (Peek().type == FUNC) {
     return ParseFunction();
+  } else if (Peek().type == ATTRIBUTE) {
+    return ParseAttributed();
   } else if (Peek().type == RETURN) {
     return ParseReturn();
   } else if (Peek().type == LBRACE) {
@@ -610,14 +875,17 @@ std::unique_ptr<ast> Parser::ParseStatement() {
     return ParseWhile();
   } else if (Peek().type == FOR) {
     return ParseFor();
+  } else if (Peek().type == IDENTIFIER && Peek().value == "parallel" &&
+             (PeekNext().type == FOR || PeekNext().type == IDENTIFIER)) {
+    return ParseParallel();
   } else if (Peek().type == STRUCT) {
     return ParseStruct();
   } else if (Peek().type == BREAK) {
     Consume();
-    return std::make_unique<BreakNode>();
+    return node<BreakNode>(start);
   } else if (Peek().type == CONTINUE) {
-    return std::make_unique<ContinueNode>();
     Consume();
+    return node<ContinueNode>(start);
   } else if (Peek().type == IDENTIFIER) {
     if (auto v = ParseAssignment()) {
       return v;
@@ -640,6 +908,57 @@ std::unique_ptr<ast> Parser::ParseStatement() {
   }
 }
 
+// One or more @attributes followed by the declaration they apply to.
+std::unique_ptr<ast> Parser::ParseAttributed() {
+  std::vector<Token> attrs;
+  while (Peek().type == ATTRIBUTE)
+    attrs.push_back(Consume());
+
+  if (Peek().type == LET) {
+    auto var = ParseVariable();
+    for (const Token &attr : attrs) {
+      if (attr.value == "soa")
+        var->soa = true;
+      else
+        diag.error({attr.file, attr.line, attr.col},
+                   "unknown variable attribute '@" + attr.value + "'");
+    }
+    return var;
+  }
+
+  if (Peek().type == STRUCT) {
+    auto st = ParseStruct();
+    for (const Token &attr : attrs) {
+      if (attr.value == "packed")
+        st->packed = true;
+      else if (attr.value == "reorder")
+        st->reorder = true;
+      else
+        diag.error({attr.file, attr.line, attr.col},
+                   "unknown struct attribute '@" + attr.value + "'");
+    }
+    return st;
+  }
+
+  if (Peek().type != FUNC) {
+    diag.error(loc(), "expected a function, struct or let after '@" +
+                          attrs.back().value + "'");
+    throw Diagnostics::FatalError("parse failure");
+  }
+
+  auto fn = ParseFunction();
+  for (const Token &attr : attrs) {
+    if (attr.value == "fastmath")
+      fn->fastMath = true;
+    else if (attr.value == "unchecked")
+      fn->unchecked = true;
+    else
+      diag.error({attr.file, attr.line, attr.col},
+                 "unknown function attribute '@" + attr.value + "'");
+  }
+  return fn;
+}
+
 std::vector<std::unique_ptr<ast>> Parser::Parse() {
   std::vector<std::unique_ptr<ast>> output;
 
@@ -681,8 +1000,112 @@ void printIRWithLineNumbers(llvm::Module *module) {
   }
 }
 
-// Save IR to file, compile to object, and link to executable
-void saveIRAndCompile(llvm::Module *module, const std::string &filename) {
+// Gives the module the host's triple and data layout before any code is
+// generated, so struct layouts, sizeof and the optimizer agree with what
+// llc emits. Without one, LLVM's default layout under-aligns 64-bit
+// integers. The machine targets the host CPU and every feature it has, as
+// -march=native would, and is returned for the optimizer's cost models and
+// llc, or null if the host target is unknown.
+std::unique_ptr<llvm::TargetMachine> setHostTarget(llvm::Module *module) {
+  llvm::InitializeNativeTarget();
+  std::string triple = llvm::sys::getDefaultTargetTriple();
+  std::string error;
+  const llvm::Target *target =
+      llvm::TargetRegistry::lookupTarget(triple, error);
+  if (!target) {
+    std::cerr << "Unknown host target, using the default data layout: "
+              << error << std::endl;
+    return nullptr;
+  }
+  std::string features;
+  llvm::StringMap<bool> hostFeatures;
+  if (llvm::sys::getHostCPUFeatures(hostFeatures))
+    for (const auto &feature : hostFeatures)
+      features += (features.empty() ? "" : ",") +
+                  std::string(feature.second ? "+" : "-") +
+                  feature.first().str();
+  std::unique_ptr<llvm::TargetMachine> machine(target->createTargetMachine(
+      triple, llvm::sys::getHostCPUName(), features, llvm::TargetOptions(),
+      llvm::Reloc::PIC_));
+  module->setTargetTriple(triple);
+  module->setDataLayout(machine->createDataLayout());
+  return machine;
+}
+
+// Links the standard library functions the program calls in from
+// libbasiq.bc, so the optimizer can inline them like any other function.
+// Only called definitions are pulled in, and they are made internal: they
+// drop out once inlined, and never clash with libc's printf.
+void linkStdlib(llvm::Module *module, const std::string &path) {
+  bool needed = false;
+  for (const llvm::Function &f : *module)
+    if (f.isDeclaration() && f.getName().starts_with("basiq_"))
+      needed = true;
+  if (!needed)
+    return;
+
+  llvm::SMDiagnostic err;
+  std::unique_ptr<llvm::Module> lib =
+      llvm::parseIRFile(path, err, module->getContext());
+  if (!lib) {
+    std::cerr << "Could not load the standard library " << path << ": "
+              << err.getMessage().str() << std::endl;
+    return;
+  }
+  lib->setTargetTriple(module->getTargetTriple());
+  lib->setDataLayout(module->getDataLayout());
+  // clang tags each function with the CPU and features it was built for;
+  // generated functions have none, and the inliner never inlines across a
+  // mismatch. Untagged, both use the host target machine's defaults.
+  for (llvm::Function &f : *lib) {
+    f.removeFnAttr("target-cpu");
+    f.removeFnAttr("target-features");
+    f.removeFnAttr("tune-cpu");
+  }
+
+  auto internalize = [](llvm::Module &m, const llvm::StringSet<> &linked) {
+    llvm::internalizeModule(m, [&](const llvm::GlobalValue &gv) {
+      return !linked.count(gv.getName());
+    });
+  };
+  if (llvm::Linker::linkModules(*module, std::move(lib),
+                                llvm::Linker::Flags::LinkOnlyNeeded,
+                                internalize))
+    std::cerr << "Could not link the standard library " << path << std::endl;
+}
+
+// Run the standard -O2 module pipeline. All functions are declared before
+// any body is generated, so the inliner and IPO passes see the whole call
+// graph. The target machine gives the inliner and vectorizers real costs
+// and vector widths; without one they assume no vector registers.
+void optimizeModule(llvm::Module *module, llvm::TargetMachine *machine) {
+  if (llvm::verifyModule(*module, &llvm::errs())) {
+    std::cerr << "Module is invalid, skipping optimization" << std::endl;
+    return;
+  }
+
+  llvm::LoopAnalysisManager LAM;
+  llvm::FunctionAnalysisManager FAM;
+  llvm::CGSCCAnalysisManager CGAM;
+  llvm::ModuleAnalysisManager MAM;
+
+  llvm::PassBuilder PB(machine);
+  PB.registerModuleAnalyses(MAM);
+  PB.registerCGSCCAnalyses(CGAM);
+  PB.registerFunctionAnalyses(FAM);
+  PB.registerLoopAnalyses(LAM);
+  PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+  llvm::ModulePassManager MPM =
+      PB.buildPerModuleDefaultPipeline(llvm::OptimizationLevel::O2);
+  MPM.run(*module, MAM);
+}
+
+// Save IR to file, compile to object, and link to executable. A
+// freestanding executable is static, with the runtime's own _start and no
+// libc, so it starts without the dynamic loader or libc initialization.
+void saveIRAndCompile(llvm::Module *module, const std::string &filename,
+                      const llvm::TargetMachine *machine, bool freestanding) {
   // --- Save LLVM IR to a file ---
   std::error_code EC;
   llvm::raw_fd_ostream dest(filename + ".ll", EC, llvm::sys::fs::OF_None);
@@ -696,6 +1119,11 @@ void saveIRAndCompile(llvm::Module *module, const std::string &filename) {
   // --- Compile IR to object file using llc ---
   std::string objFile = filename + ".o";
   std::string llcCmd = "llc " + filename + ".ll -filetype=obj -o " + objFile;
+  if (machine) {
+    llcCmd += " -mcpu=" + machine->getTargetCPU().str();
+    if (!machine->getTargetFeatureString().empty())
+      llcCmd += " -mattr=" + machine->getTargetFeatureString().str();
+  }
   if (system(llcCmd.c_str()) != 0) {
     std::cerr << "Error running llc" << std::endl;
     return;
@@ -703,7 +1131,11 @@ void saveIRAndCompile(llvm::Module *module, const std::string &filename) {
 
   // --- Link object file to create executable using clang ---
   std::string exeFile = filename + "_exec";
-  std::string clangCmd = "clang " + objFile + " -o " + exeFile;
+  std::string clangCmd =
+      freestanding ? "clang -static -nostdlib " + objFile + " -o " + exeFile +
+                         " -L" BASIQ_RUNTIME_DIR " -lbasiq_rt_freestanding"
+                   : "clang " + objFile + " -o " + exeFile +
+                         " -L" BASIQ_RUNTIME_DIR " -lbasiq_rt -lpthread";
   if (system(clangCmd.c_str()) != 0) {
     std::cerr << "Error running clang" << std::endl;
     return;
@@ -716,119 +1148,42 @@ void saveIRAndCompile(llvm::Module *module, const std::string &filename) {
 // Main Function
 // ===============================
 
-int main() {
-  // --- Source Code to Compile ---
-  std::string src = R"(
+static llvm::cl::opt<std::string>
+    InputFile(llvm::cl::Positional, llvm::cl::desc("[input file]"),
+              llvm::cl::init(""));
 
-func to_lower(c:Char*) -> Void {
-    let i:Integer = 0;
-    while (*c[i] != '\0') {
-        if *c[i] >= 'A' && *c[i] <= 'Z' {
-            *c[i] = (Char)(*c[i] + ('a' - 'A'));
-        }
-        i = i + 1;
-    }
-}
-
-func string_concat(a:Char*, b:Char*) -> Void {
-    let i:Integer = 0;
-    while (*a[i] != 0) { i = i + 1; }  // find end of a
-    let j:Integer = 0;
-    while (*b[j] != 0) {               // walk b
-        *a[i + j] = *b[j];            // append b onto end of a
-        j = j + 1;
-    }
-    *a[i + j] = 0;
-}
-
-func itoa(n:Integer, str:Char*) -> Integer  {
-    let i:Integer = 0;
-    let isNegetive:Boolean = false;
-
-    if n == 0 {
-        *str[i] = '0';        ///////////////////////
-        i = i + 1;
-        *str[i] = '\0';       ///////////////////////
-        return i;
-    }
+static llvm::cl::opt<bool>
+    Int64("int64", llvm::cl::desc("Make Integer 64 bits wide instead of 32"));
 
-    if n < 0 {
-        isNegetive = true;
-        n = n - n * 2;
-    }
-
-    while (n != 0) {
-        *str[i] = (Char)(n - (n / 10) * 10 + 48);   ///////////////////////
-        i = i + 1;
-        n = n / 10;
-    }
-
-    if isNegetive {
-        *str[i] = '-';        ///////////////////////
-        i = i + 1;
-    }
-
-    *str[i] = '\0';           ///////////////////////
-
-    let j:Integer = 0;
-    let k:Integer = i - 1;
-
-    while (j < k) {
-        let tmp:Char = *str[j] ;   ///////////////////////
-        *str[j] = *str[k];     ///////////////////////
-        *str[k] = tmp;            ///////////////////////
-
-        j = j + 1;
-        k = k - 1;
-    }
-
-  return i;
-}
+static llvm::cl::opt<bool>
+    FastMath("fast-math",
+             llvm::cl::desc("Allow fast-math float optimizations (reassociation, "
+                            "no NaN/Inf) in every function, like @fastmath"));
 
+static llvm::cl::opt<std::string>
+    Stdlib("stdlib", llvm::cl::desc("Standard library bitcode to link in"),
+           llvm::cl::value_desc("file"),
+           llvm::cl::init(BASIQ_RUNTIME_DIR "/libbasiq.bc"));
 
-func printf(str: Char*, vals: Char*) -> Void {
-	let i:Integer = 0;
-	let j:Integer = 0;
-	while (*str[i] != '\0') {
-		if *str[i] == '%' {
-			i = i + 1;
+static llvm::cl::opt<bool> Freestanding(
+    "freestanding",
+    llvm::cl::desc("Link a static executable with no libc, entered through "
+                   "the runtime's own _start (x86-64 Linux)"));
 
-			if *str[i] == 's' {
-				let cptr:Char = *vals[j];
-				@Syscall(1, 1, &cptr, 1, 0, 0);
-				j = j + 1;
-				i = i + 1;
-			} else if *str[i] =='d' {
-				let val:Integer = (Integer)*vals[j];
-				let cptr:Char[32];
+static llvm::cl::opt<bool> BoundsCheck(
+    "bounds-check",
+    llvm::cl::desc("Trap on out-of-bounds array, vector and pointer indexing "
+                   "(slices are always checked)"));
 
-				let len:Integer = itoa(val, &cptr);
+int main(int argc, char **argv) {
+  llvm::cl::ParseCommandLineOptions(argc, argv, "BASIQ compiler\n");
+  if (Int64)
+    BType::IntegerBits = 64;
 
-				@Syscall(1, 1, &cptr, len, 0, 0);
-				j = j + 1;
-				i = i + 1;
-			}
-		}
-		let val:Char = *str[i];
-		@Syscall(1, 1, &val , 1, 0, 0);
-
-		i = i + 1;
-	}
-}
-
-func to_upper(c:Char*) -> Void {
-    let i:Integer = 0;
-    while (*c[i] != '\0') {
-        if *c[i] >= 'a' && *c[i] <= 'z' {
-            *c[i] = (Char)(*c[i] - ('a' - 'A'));
-        }
-		if *c[i] == '0' {
-			break;
-		}
-        i = i + 1;
-    }
-
-}
+  // --- Source Code to Compile ---
+  // Without an input file, the built-in demo program below is compiled.
+  std::string srcName = "<input>";
+  std::string src = R"(
 
 struct name [
 	b:Char, 
@@ -841,20 +1196,30 @@ func main() -> Integer {
     let name:Char[25];
 	let num:Integer = 42;
 
-	let something:name = ['a'];
+	let something:name;
+	something.b = 'a';
     
-    let args:Char[2] = [(Char)(num)];
-    
-
-    // printf("Hello %s,  ", (Char*)&args);
+    // printf("Hello %s,  ", &name);
 	// itoa(588, &name)
-	printf("Hello %d", &args);  
+	printf("Hello %d\n", num);  
 		// @Syscall(1, 1, &name , sizeof(name), 0, 0);
 	
     return 0;
 }
 )";
 
+  if (!InputFile.empty()) {
+    std::ifstream in(InputFile);
+    if (!in) {
+      std::cerr << "Could not open file: " << InputFile << std::endl;
+      return 1;
+    }
+    std::stringstream buf;
+    buf << in.rdbuf();
+    src = buf.str();
+    srcName = InputFile;
+  }
+
   std::vector<std::string> sourceLines;
   {
     std::istringstream ss(src);
@@ -866,7 +1231,7 @@ func main() -> Integer {
   Diagnostics diag(sourceLines);
 
   // --- Lexical Analysis ---
-  Lexer lexer(src);
+  Lexer lexer(src, srcName);
   auto program = lexer.lexer();
 
   std::cout << "Tokens:\n";
@@ -889,13 +1254,36 @@ func main() -> Integer {
   Parser parser(program, "MYMODULE", diag);
   auto astNodes = parser.Parse();
 
+  // --- Constant Folding ---
+  foldProgram(astNodes);
+
+  // --- Semantic Analysis ---
+  analyzeProgram(astNodes, diag, Freestanding);
+  if (diag.hasErrors()) {
+    std::cerr << diag.getErrorCount() << " error(s), stopping before codegen"
+              << std::endl;
+    return 1;
+  }
+
   // std::cout << "AST Nodes:\n";
   // for (auto &v : astNodes) {
   //   std::cout << v->repr() << std::endl;
   // }
 
   // --- Code Generation ---
+  // Declare every struct and function first so bodies can refer to anything
+  // in the module, regardless of order.
   auto &cc = parser.getCodegenContext();
+  cc.FastMath = FastMath;
+  cc.CheckArrays = BoundsCheck;
+  std::unique_ptr<llvm::TargetMachine> machine = setHostTarget(cc.Module.get());
+  for (auto &v : astNodes) {
+    try {
+      v->declare(cc);
+    } catch (const std::exception &e) {
+      std::cerr << "Codegen error: " << e.what() << std::endl;
+    }
+  }
   for (auto &v : astNodes) {
     try {
       v->codegen(cc);
@@ -904,6 +1292,9 @@ func main() -> Integer {
     }
   }
 
+  linkStdlib(cc.Module.get(), Stdlib);
+  optimizeModule(cc.Module.get(), machine.get());
+
   std::cout << Colors::BOLD << Colors::RED
             << "\n-------------------------------LLVM_IR-----------------------"
                "---------------\n"
@@ -915,7 +1306,7 @@ func main() -> Integer {
                "-----------------------\n"
             << Colors::RESET << std::endl;
 
-  saveIRAndCompile(cc.Module.get(), "output");
+  saveIRAndCompile(cc.Module.get(), "output", machine.get(), Freestanding);
 
   return 0;
 }
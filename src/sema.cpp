@@ -0,0 +1,1263 @@
+#include <algorithm>
+#include <ast.h>
+#include <lexer.h>
+#include <memory>
+#include <sema.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+Symbol *SemaContext::declare(const ast &at, const std::string &name,
+                             const BType &type) {
+  if (!currentFunction) {
+    error(at, "variable '" + name + "' declared outside of a function");
+    return nullptr;
+  }
+  if (scopes.back().count(name))
+    error(at, "redeclaration of '" + name + "' in the same scope");
+
+  auto sym = std::make_unique<Symbol>();
+  sym->name = name;
+  sym->type = type;
+  sym->slot = currentFunction->locals.size();
+
+  Symbol *raw = sym.get();
+  currentFunction->locals.push_back(std::move(sym));
+  scopes.back()[name] = raw;
+  return raw;
+}
+
+static void addCapture(ParallelSpec &spec, Symbol *sym) {
+  if (std::find(spec.captures.begin(), spec.captures.end(), sym) ==
+      spec.captures.end())
+    spec.captures.push_back(sym);
+}
+
+Symbol *SemaContext::resolve(const ast &at, const std::string &name) {
+  return resolve(at.loc, name);
+}
+
+Symbol *SemaContext::resolve(const SourceLoc &loc, const std::string &name) {
+  for (size_t i = scopes.size(); i-- > 0;) {
+    auto found = scopes[i].find(name);
+    if (found == scopes[i].end())
+      continue;
+    for (auto &region : parallelRegions)
+      if (i < region.scopeDepth)
+        addCapture(*region.spec, found->second);
+    return found->second;
+  }
+  diag.error(loc, "use of undeclared variable '" + name + "'");
+  return nullptr;
+}
+
+bool SemaContext::checkType(const ast &at, const BType &type) {
+  if (type.isPointer() || type.isArray() || type.isSlice())
+    return checkType(at, type.element());
+  if (type.isStruct() && !structs.count(type.name)) {
+    error(at, "unknown type '" + type.name + "'");
+    return false;
+  }
+  return true;
+}
+
+void ast::analyze(SemaContext &sc) {
+  forEachChild([&sc](std::unique_ptr<ast> &child) { sc.analyze(child); });
+}
+
+// Arrays are copied as a whole: from an array literal or string literal
+// that fits, or from another array of exactly the same type.
+static void checkArrayCopy(SemaContext &sc, const ast &at, const BType &to,
+                           const ast &from) {
+  const BType &src = from.exprType;
+  if (!src.isKnown())
+    return;
+  if (auto *str = dynamic_cast<const StringNode *>(&from)) {
+    if (to.element().kind != BType::Char || str->val.size() + 1 > to.count)
+      sc.error(at, "string of length " + std::to_string(str->val.size()) +
+                       " does not fit in '" + to.str() + "'");
+    return;
+  }
+  bool ok = dynamic_cast<const ArrayLiteralNode *>(&from)
+                ? src.isArray() && src.count <= to.count
+                : src == to;
+  if (!ok)
+    sc.error(at, "cannot copy '" + src.str() + "' into '" + to.str() + "'");
+}
+
+// Scalars convert implicitly, and a scalar splats into a vector; anything
+// else needs matching vector types.
+static void checkVectorValue(SemaContext &sc, const ast &at, const BType &to,
+                             const BType &from) {
+  if (!from.isKnown() || from == to)
+    return;
+  if (to.isVector() ? !from.isNumeric() || (from.isFloat() &&
+                                            !to.scalar().isFloat())
+                    : from.isVector())
+    sc.error(at, "cannot convert '" + from.str() + "' to '" + to.str() + "'");
+}
+
+// Whether a struct-typed expression names memory a copy can be made from;
+// these are the cases codegen's placeOf handles.
+static bool hasStorage(const ast &e) {
+  if (auto *cast = dynamic_cast<const CastNode *>(&e))
+    return hasStorage(*cast->Value);
+  return dynamic_cast<const VariableReferenceNode *>(&e) ||
+         dynamic_cast<const MemberAccessNode *>(&e) ||
+         dynamic_cast<const ArrayAccessNode *>(&e) ||
+         dynamic_cast<const DeReferenceNode *>(&e);
+}
+
+// Structs are copied whole, and only from a struct of the same type.
+static void checkStructCopy(SemaContext &sc, const ast &at, const BType &to,
+                            const ast &from) {
+  if (!from.exprType.isKnown())
+    return;
+  if (from.exprType == to) {
+    if (!hasStorage(from))
+      sc.error(at, "cannot copy struct '" + to.str() + "' from this expression",
+               "copy it from a variable, field, element or *pointer");
+    return;
+  }
+  if (dynamic_cast<const ArrayLiteralNode *>(&from))
+    sc.error(at, "cannot initialize struct '" + to.str() +
+                     "' from an array literal",
+             "declare it without a value and set its fields with x.field = "
+             "...");
+  else
+    sc.error(at, "cannot convert '" + from.exprType.str() + "' to '" +
+                     to.str() + "'");
+}
+
+// A slice comes from a slice of the same type, or views a named array or a
+// string literal in place. Slices never convert to anything else.
+static void checkSliceValue(SemaContext &sc, const ast &at, const BType &to,
+                            const ast &from) {
+  const BType &src = from.exprType;
+  if (!src.isKnown() || !to.isKnown() || src == to)
+    return;
+  if (to.isSlice()) {
+    if (dynamic_cast<const StringNode *>(&from) &&
+        to.element().kind == BType::Char)
+      return;
+    bool named = dynamic_cast<const VariableReferenceNode *>(&from) ||
+                 dynamic_cast<const MemberAccessNode *>(&from);
+    if (src.isArray() && named && src.element() == to.element())
+      return;
+  }
+  sc.error(at, "cannot convert '" + src.str() + "' to '" + to.str() + "'",
+           to.isSlice() && src.isPointer()
+               ? "give the pointer a length with slice(p, n)"
+               : "");
+}
+
+// Analyzes a value that will be stored as `type`.
+static void analyzeValue(SemaContext &sc, std::unique_ptr<ast> &val,
+                         const BType &type) {
+  BType outer = std::move(sc.expectedType);
+  sc.expectedType = type;
+  sc.analyze(val);
+  sc.expectedType = std::move(outer);
+}
+
+// An @soa array has no storage for whole elements in a row, so it can only
+// be indexed, and its elements copied field by field.
+static void rejectSoa(SemaContext &sc, const ast &at, const Symbol *sym) {
+  if (sym && sym->soa)
+    sc.error(at, "@soa array '" + sym->name + "' can only be indexed",
+             "use " + sym->name + "[i] or " + sym->name + "[i].field");
+}
+
+void VariableDeclareNode::analyze(SemaContext &sc) {
+  sc.checkType(*this, Type);
+  if (soa && (!Type.isArray() || !Type.element().isStruct()))
+    sc.error(*this, "@soa needs an array of structs, got '" + Type.str() + "'");
+  else if (soa && val)
+    sc.error(*this, "an @soa array cannot have an initializer",
+             "it starts zeroed; set fields with " + name + "[i].field = ...");
+  analyzeValue(sc, val, Type);
+  if (val && Type.isArray())
+    checkArrayCopy(sc, *this, Type, *val);
+  if (val && (Type.isVector() || val->exprType.isVector()))
+    checkVectorValue(sc, *this, Type, val->exprType);
+  if (val && (Type.isStruct() || val->exprType.isStruct()))
+    checkStructCopy(sc, *this, Type, *val);
+  if (val && (Type.isSlice() || val->exprType.isSlice()))
+    checkSliceValue(sc, *this, Type, *val);
+  sym = sc.declare(*this, name, Type);
+  if (sym)
+    sym->soa = soa;
+}
+
+void AssignmentNode::analyze(SemaContext &sc) {
+  sym = sc.resolve(*this, name);
+  rejectSoa(sc, *this, sym);
+  analyzeValue(sc, val, sym ? sym->type : BType());
+  if (sym && (sym->type.isVector() || val->exprType.isVector()))
+    checkVectorValue(sc, *this, sym->type, val->exprType);
+  if (sym && sym->readOnly)
+    sc.error(*this, "cannot assign to loop variable '" + name + "'");
+  if (sym && sym->type.isArray())
+    checkArrayCopy(sc, *this, sym->type, *val);
+  if (sym && (sym->type.isStruct() || val->exprType.isStruct()))
+    checkStructCopy(sc, *this, sym->type, *val);
+  if (sym && (sym->type.isSlice() || val->exprType.isSlice()))
+    checkSliceValue(sc, *this, sym->type, *val);
+  exprType = BType::Void;
+}
+
+void ReturnNode::analyze(SemaContext &sc) {
+  if (!sc.currentFunction)
+    sc.error(*this, "'return' outside of a function");
+  else if (!sc.parallelRegions.empty())
+    sc.error(*this, "'return' inside a parallel for");
+  else
+    retType = sc.currentFunction->ReturnType;
+  analyzeValue(sc, expr, retType);
+  if (expr && (retType.isSlice() || expr->exprType.isSlice()))
+    checkSliceValue(sc, *this, retType, *expr);
+}
+
+void CompoundNode::analyze(SemaContext &sc) {
+  sc.pushScope();
+  for (auto &block : blocks)
+    sc.analyze(block);
+  sc.popScope();
+}
+
+void FunctionNode::declare(SemaContext &sc) {
+  FunctionSig sig;
+  sig.ret = ReturnType;
+  sig.variadic = isVaridic;
+  for (auto &arg : args)
+    sig.params.push_back(std::get<1>(arg));
+
+  if (sc.functions.count(name))
+    sc.error(*this, "redefinition of function '" + name + "'");
+  sc.functions[name] = sig;
+}
+
+void FunctionNode::analyze(SemaContext &sc) {
+  sc.checkType(*this, ReturnType);
+  for (auto &arg : args)
+    sc.checkType(*this, std::get<1>(arg));
+
+  // Structs cross calls by pointer only, so there is no ABI to match for
+  // aggregates and callees work on the caller's copy.
+  if (ReturnType.isStruct())
+    sc.error(*this, "function '" + name + "' cannot return struct '" +
+                        ReturnType.str() + "' by value",
+             "return a '" + ReturnType.str() + "*' or fill one passed in");
+  for (auto &arg : args)
+    if (std::get<1>(arg).isStruct())
+      sc.error(*this, "parameter '" + std::get<0>(arg) + "' of struct type '" +
+                          std::get<1>(arg).str() + "' must be a pointer",
+               "declare it as '" + std::get<1>(arg).str() +
+                   "*' and pass &value");
+
+  FunctionNode *outer = sc.currentFunction;
+  sc.currentFunction = this;
+  locals.clear();
+
+  sc.pushScope();
+  for (auto &arg : args)
+    sc.declare(*this, std::get<0>(arg), std::get<1>(arg));
+  sc.analyze(content);
+  sc.popScope();
+
+  sc.currentFunction = outer;
+}
+
+void VariableReferenceNode::analyze(SemaContext &sc) {
+  sym = sc.resolve(*this, Name);
+  rejectSoa(sc, *this, sym);
+  if (sym)
+    exprType = sym->type;
+}
+
+void WhileNode::analyze(SemaContext &sc) {
+  sc.analyze(condition);
+  sc.loopDepth++;
+  sc.analyze(body);
+  sc.loopDepth--;
+}
+
+void IfNode::analyze(SemaContext &sc) {
+  sc.analyze(condition);
+
+  sc.pushScope();
+  sc.analyze(thenBlock);
+  sc.popScope();
+
+  sc.pushScope();
+  sc.analyze(elseBlock);
+  sc.popScope();
+}
+
+void ForNode::analyze(SemaContext &sc) {
+  sc.analyze(init);
+  sc.analyze(condition);
+  sc.analyze(increment);
+  sc.loopDepth++;
+  sc.analyze(body);
+  sc.loopDepth--;
+}
+
+// The type integer operands are brought to: the wider of the two, and
+// unsigned if either is unsigned at equal width.
+static BType commonInteger(const BType &l, const BType &r) {
+  if (l.bits() != r.bits())
+    return l.bits() > r.bits() ? l : r;
+  return r.isUnsigned() ? r : l;
+}
+
+static BType promoteBoolean(const BType &t) {
+  return t.kind == BType::Boolean ? BType(BType::Integer) : t;
+}
+
+// Lane-wise arithmetic and bitwise ops. A scalar operand is splatted.
+static void analyzeVectorOp(BinaryOperationNode &op, SemaContext &sc) {
+  const BType &l = op.Left->exprType;
+  const BType &r = op.Right->exprType;
+  const BType &v = l.isVector() ? l : r;
+  const BType &other = l.isVector() ? r : l;
+
+  bool ok = other == v || (other.isNumeric() && (!other.isFloat() ||
+                                                 v.element().isFloat()));
+  switch (op.Type) {
+  case PLUS:
+  case MINUS:
+  case STAR:
+  case SLASH:
+  case PERCENT:
+    break;
+  case ANDPERCENT:
+  case PIPE:
+  case CARET:
+  case SHL:
+  case SHR:
+    ok = ok && v.element().isInteger();
+    break;
+  default:
+    sc.error(op, "cannot compare '" + l.str() + "' and '" + r.str() + "'",
+             "vectors support lane-wise arithmetic and bitwise operators");
+    return;
+  }
+  if (!ok) {
+    sc.error(op, "cannot combine '" + l.str() + "' and '" + r.str() + "'");
+    return;
+  }
+  op.operandType = v;
+  op.exprType = v;
+}
+
+void BinaryOperationNode::analyze(SemaContext &sc) {
+  sc.analyze(Left);
+  sc.analyze(Right);
+
+  const BType &l = Left->exprType;
+  const BType &r = Right->exprType;
+  if (!l.isKnown() || !r.isKnown())
+    return; // already reported
+
+  if (l.isVector() || r.isVector()) {
+    analyzeVectorOp(*this, sc);
+    return;
+  }
+
+  switch (Type) {
+  case PLUS:
+  case MINUS:
+  case STAR:
+  case SLASH:
+  case PERCENT:
+    if (!l.isNumeric() || !r.isNumeric()) {
+      sc.error(*this, "cannot perform arithmetic on '" + l.str() + "' and '" +
+                          r.str() + "'");
+      return;
+    }
+    // Mixed integer/Float arithmetic is done in Float. Otherwise Booleans
+    // are promoted to Integer and both sides go to the common type.
+    if (l.isFloat() || r.isFloat())
+      operandType = BType::Float;
+    else
+      operandType = commonInteger(promoteBoolean(l), promoteBoolean(r));
+    exprType = operandType;
+    return;
+
+  case ANDPERCENT:
+  case PIPE:
+  case CARET:
+    if (!l.isInteger() || !r.isInteger()) {
+      sc.error(*this, "bitwise operands must be integers, got '" + l.str() +
+                          "' and '" + r.str() + "'");
+      return;
+    }
+    // Two Booleans stay Boolean (a non-short-circuit logical op).
+    if (l.kind == BType::Boolean && r.kind == BType::Boolean)
+      operandType = BType::Boolean;
+    else
+      operandType = commonInteger(promoteBoolean(l), promoteBoolean(r));
+    exprType = operandType;
+    return;
+
+  case SHL:
+  case SHR:
+    if (!l.isInteger() || !r.isInteger()) {
+      sc.error(*this, "shift operands must be integers, got '" + l.str() +
+                          "' and '" + r.str() + "'");
+      return;
+    }
+    // The result has the (promoted) type of the value being shifted; >> is
+    // arithmetic for signed types and logical for unsigned ones.
+    operandType = promoteBoolean(l);
+    exprType = operandType;
+    return;
+
+  case EQEQ:
+  case NOTEQ:
+  case LT:
+  case LTE:
+  case GT:
+  case GTE:
+    if (l.isFloat() || r.isFloat()) {
+      if (!l.isNumeric() || !r.isNumeric()) {
+        sc.error(*this, "cannot compare '" + l.str() + "' and '" + r.str() +
+                            "'");
+        return;
+      }
+      operandType = BType::Float;
+    } else if (l.isInteger() && r.isInteger()) {
+      operandType = commonInteger(l, r);
+    } else if (l.isPointer() && l == r) {
+      operandType = l;
+    } else {
+      sc.error(*this, "cannot compare '" + l.str() + "' and '" + r.str() + "'");
+      return;
+    }
+    exprType = BType::Boolean;
+    return;
+
+  case AND:
+  case OR:
+    if (!l.isInteger() || !r.isInteger()) {
+      sc.error(*this, std::string("operands of '") +
+                          (Type == AND ? "&&" : "||") +
+                          "' must be Integer, Char or Boolean");
+      return;
+    }
+    exprType = BType::Boolean;
+    return;
+
+  default:
+    sc.error(*this, "unknown binary operator " + std::string(tokenName(Type)));
+  }
+}
+
+static void analyzeReductions(ParallelSpec &spec, SemaContext &sc) {
+  for (auto &r : spec.reductions) {
+    r.sym = sc.resolve(r.loc, r.name);
+    if (!r.sym)
+      continue;
+
+    const BType &t = r.sym->type;
+    bool bitwise =
+        r.op == ReduceOp::And || r.op == ReduceOp::Or || r.op == ReduceOp::Xor;
+    if (t.kind == BType::Boolean || !(bitwise ? t.isInteger() : t.isNumeric()))
+      sc.diag.error(r.loc, "cannot reduce '" + r.name + "' of type '" +
+                               t.str() + "' with this operator");
+
+    // Reduced even if the body never names it, so it needs the shared slot.
+    addCapture(spec, r.sym);
+  }
+}
+
+void RangeForNode::analyze(SemaContext &sc) {
+  sc.analyze(start);
+  sc.analyze(end);
+  sc.analyze(step);
+
+  BType l = start->exprType;
+  BType r = end->exprType;
+  BType varType = BType::Integer;
+  if (!l.isInteger() || !r.isInteger())
+    sc.error(*this, "range bounds must be integers, got '" + l.str() +
+                        "' and '" + r.str() + "'");
+  else
+    varType = commonInteger(promoteBoolean(l), promoteBoolean(r));
+
+  // The step picks the loop direction, so it has to be known here.
+  if (step) {
+    if (auto *lit = dynamic_cast<IntegerNode *>(step.get()); lit && lit->val)
+      stepValue = lit->val;
+    else
+      sc.error(*step, "range step must be a non-zero integer constant");
+  }
+
+  if (parallel && sc.freestanding)
+    sc.error(*this, "parallel for needs threads, which --freestanding "
+                    "programs do not have",
+             "drop 'parallel' to run the loop serially");
+  if (parallel)
+    analyzeReductions(*parallel, sc);
+
+  sc.pushScope();
+  sym = sc.declare(*this, var, varType);
+  if (sym)
+    sym->readOnly = true;
+  sc.loopDepth++;
+  if (parallel)
+    sc.parallelRegions.push_back(
+        {sc.scopes.size() - 1, sc.loopDepth, parallel.get()});
+  sc.analyze(body);
+  if (parallel)
+    sc.parallelRegions.pop_back();
+  sc.loopDepth--;
+  sc.popScope();
+  exprType = BType::Void;
+}
+
+void UnaryOperationNode::analyze(SemaContext &sc) {
+  sc.analyze(Operand);
+  const BType &t = Operand->exprType;
+  if (!t.isKnown())
+    return;
+  if (!t.scalar().isInteger()) {
+    sc.error(*this, "operand of '~' must be an integer, got '" + t.str() + "'");
+    return;
+  }
+  exprType = promoteBoolean(t);
+}
+
+void BreakNode::analyze(SemaContext &sc) {
+  if (!sc.loopDepth)
+    sc.error(*this, "'break' outside of a loop");
+  else if (!sc.parallelRegions.empty() &&
+           sc.parallelRegions.back().loopDepth == sc.loopDepth)
+    sc.error(*this, "'break' cannot leave a parallel for",
+             "every iteration of a parallel for runs");
+}
+
+void ContinueNode::analyze(SemaContext &sc) {
+  if (!sc.loopDepth)
+    sc.error(*this, "'continue' outside of a loop");
+}
+
+// popcount/clz/ctz/bswap(x) and rotl/rotr(x, n). The result has x's type.
+static bool expectArity(CallNode &call, SemaContext &sc, size_t n) {
+  if (call.args.size() == n)
+    return true;
+  sc.error(call, "'" + call.name + "' expects " + std::to_string(n) +
+                     " arguments, got " + std::to_string(call.args.size()));
+  return false;
+}
+
+// Reports argument i of a builtin unless it is an integer; what names it in
+// the message.
+static void expectInteger(CallNode &call, SemaContext &sc, size_t i,
+                          const char *what) {
+  const BType &t = call.args[i]->exprType;
+  if (t.isKnown() && !t.isInteger())
+    sc.error(call, "'" + call.name + "' needs an integer " + what + ", got '" +
+                       t.str() + "'");
+}
+
+// Checks the array-or-pointer and index arguments of load/store and
+// returns the element type, Unknown on error.
+static BType vectorMemoryBase(CallNode &call, SemaContext &sc) {
+  const BType &base = call.args[0]->exprType;
+  const BType &index = call.args[1]->exprType;
+  if (!base.isKnown() || !index.isKnown())
+    return BType();
+  if (base.isArray() && !dynamic_cast<VariableReferenceNode *>(
+                            call.args[0].get())) {
+    sc.error(call, "'" + call.name + "' needs an array variable or a pointer");
+    return BType();
+  }
+  if ((!base.isArray() && !base.isPointer()) ||
+      !base.element().isNumeric()) {
+    sc.error(call, "'" + call.name +
+                       "' needs an array or pointer of numbers, got '" +
+                       base.str() + "'");
+    return BType();
+  }
+  if (!index.isInteger()) {
+    sc.error(call, "'" + call.name + "' index must be an integer");
+    return BType();
+  }
+  return base.element();
+}
+
+static void analyzeVectorBuiltin(CallNode &call, SemaContext &sc) {
+  switch (call.builtin) {
+  case Builtin::Load:
+  case Builtin::AlignedLoad: {
+    if (!expectArity(call, sc, 2))
+      return;
+    BType lane = vectorMemoryBase(call, sc);
+    if (!lane.isKnown())
+      return;
+    const BType &want = sc.expectedType;
+    if (!want.isVector()) {
+      sc.error(call, "cannot tell how many lanes '" + call.name + "' loads",
+               "assign it to a variable of vector type");
+      return;
+    }
+    if (want.element() != lane) {
+      sc.error(call, "cannot load '" + want.str() + "' from '" +
+                         call.args[0]->exprType.str() + "'");
+      return;
+    }
+    call.exprType = want;
+    return;
+  }
+
+  case Builtin::Store:
+  case Builtin::AlignedStore: {
+    if (!expectArity(call, sc, 3))
+      return;
+    BType lane = vectorMemoryBase(call, sc);
+    const BType &v = call.args[2]->exprType;
+    if (lane.isKnown() && v.isKnown() &&
+        (!v.isVector() || v.element() != lane))
+      sc.error(call, "cannot store '" + v.str() + "' into '" +
+                         call.args[0]->exprType.str() + "'");
+    call.exprType = BType::Void;
+    return;
+  }
+
+  case Builtin::Shuffle: {
+    if (call.args.size() < 2)
+      return (void)expectArity(call, sc, 2);
+    const BType &v = call.args[0]->exprType;
+    if (!v.isVector()) {
+      sc.error(call, "'shuffle' needs a vector, got '" + v.str() + "'");
+      return;
+    }
+    // shuffle(v, i...) permutes v; shuffle(a, b, i...) picks from both,
+    // with b's lanes numbered after a's.
+    bool two = call.args[1]->exprType == v;
+    size_t first = two ? 2 : 1;
+    int64_t limit = two ? 2 * v.count : v.count;
+    if (!expectArity(call, sc, first + v.count))
+      return;
+    for (size_t i = first; i < call.args.size(); ++i) {
+      auto *lit = dynamic_cast<IntegerNode *>(call.args[i].get());
+      if (!lit || lit->val < 0 || lit->val >= limit) {
+        sc.error(*call.args[i], "shuffle index must be a constant from 0 to " +
+                                    std::to_string(limit - 1));
+        return;
+      }
+    }
+    call.exprType = v;
+    return;
+  }
+
+  default: { // horizontal reductions
+    if (!expectArity(call, sc, 1))
+      return;
+    const BType &v = call.args[0]->exprType;
+    bool bitwise = call.builtin == Builtin::ReduceAnd ||
+                   call.builtin == Builtin::ReduceOr ||
+                   call.builtin == Builtin::ReduceXor;
+    if (!v.isVector() || (bitwise && !v.element().isInteger())) {
+      sc.error(call, "'" + call.name + "' needs " +
+                         (bitwise ? "an integer vector" : "a vector") +
+                         ", got '" + v.str() + "'");
+      return;
+    }
+    call.exprType = v.element();
+    return;
+  }
+  }
+}
+
+// len(x) of a slice or array, and slice(p, n) to give a pointer a length.
+static void analyzeSliceBuiltin(CallNode &call, SemaContext &sc) {
+  if (!expectArity(call, sc, call.builtin == Builtin::Len ? 1 : 2))
+    return;
+  const BType &x = call.args[0]->exprType;
+  if (!x.isKnown())
+    return;
+
+  if (call.builtin == Builtin::Len) {
+    if (!x.isSlice() && !x.isArray())
+      sc.error(call, "'len' needs an array or slice, got '" + x.str() + "'");
+    call.exprType = BType::Int64;
+    return;
+  }
+
+  const BType &n = call.args[1]->exprType;
+  if (!x.isPointer() || x.element().isVoid()) {
+    sc.error(call, "'slice' needs a typed pointer, got '" + x.str() + "'",
+             "cast it first, e.g. slice((Char*)p, n)");
+    return;
+  }
+  if (n.isKnown() && !n.isInteger())
+    sc.error(call, "'slice' needs an integer length, got '" + n.str() + "'");
+  call.exprType = BType::sliceOf(x.element());
+}
+
+// The text of write and append_file after their fd or file: a Char, a
+// Char[] (or Char array or string literal), or a pointer and a byte count.
+static void analyzeTextArgs(CallNode &call, SemaContext &sc) {
+  const BType &data = call.args[1]->exprType;
+  if (call.args.size() == 2) {
+    if (data.kind != BType::Char)
+      checkSliceValue(sc, *call.args[1], BType::sliceOf(BType::Char),
+                      *call.args[1]);
+    return;
+  }
+  if (data.isKnown() && !data.isPointer())
+    sc.error(call, "'" + call.name +
+                       "' of a byte count needs a pointer, got '" +
+                       data.str() + "'");
+  expectInteger(call, sc, 2, "length");
+}
+
+// write(fd, text) of a Char, a Char[], or a Char array or string literal
+// viewed as one; write(fd, p, n) of n bytes at p; flush(fd); setbuf(fd,
+// mode).
+static void analyzeOutputBuiltin(CallNode &call, SemaContext &sc) {
+  size_t arity = call.builtin == Builtin::Flush          ? 1
+                 : call.builtin == Builtin::SetBuffering ? 2
+                 : call.args.size() == 3                 ? 3
+                                                         : 2;
+  if (!expectArity(call, sc, arity))
+    return;
+  call.exprType = BType::Void;
+  expectInteger(call, sc, 0, "fd");
+  if (call.builtin == Builtin::SetBuffering)
+    expectInteger(call, sc, 1, "mode");
+  if (call.builtin != Builtin::Write)
+    return;
+
+  analyzeTextArgs(call, sc);
+}
+
+// The bytes a path argument names: a string literal, a Char* or a pointer
+// to a Char array, NUL-terminated.
+static void checkPath(CallNode &call, SemaContext &sc, const ast &arg) {
+  const BType &t = arg.exprType;
+  if (!t.isKnown())
+    return;
+  if (t.isPointer() && (t.element().kind == BType::Char ||
+                        (t.element().isArray() &&
+                         t.element().element().kind == BType::Char)))
+    return;
+  sc.error(arg, "'" + call.name + "' needs a Char* path, got '" + t.str() +
+                    "'");
+}
+
+// map_file(path) -> Char[], unmap_file(s), advise(s, hint),
+// create_file(path) -> Int32, append_file(f, text), close_file(f) -> Int64.
+static void analyzeFileBuiltin(CallNode &call, SemaContext &sc) {
+  Builtin b = call.builtin;
+  size_t arity = b == Builtin::Advise ? 2
+                 : b == Builtin::AppendFile && call.args.size() == 3 ? 3
+                 : b == Builtin::AppendFile ? 2
+                                            : 1;
+  if (!expectArity(call, sc, arity))
+    return;
+
+  const BType bytes = BType::sliceOf(BType::Char);
+  switch (b) {
+  case Builtin::MapFile:
+    checkPath(call, sc, *call.args[0]);
+    call.exprType = bytes;
+    return;
+  case Builtin::CreateFile:
+    checkPath(call, sc, *call.args[0]);
+    call.exprType = BType::Int32;
+    return;
+  case Builtin::Advise:
+    expectInteger(call, sc, 1, "hint");
+    [[fallthrough]];
+  case Builtin::UnmapFile:
+    checkSliceValue(sc, *call.args[0], bytes, *call.args[0]);
+    call.exprType = BType::Void;
+    return;
+  case Builtin::AppendFile:
+    expectInteger(call, sc, 0, "file");
+    analyzeTextArgs(call, sc);
+    call.exprType = BType::Void;
+    return;
+  default:
+    expectInteger(call, sc, 0, "file");
+    call.exprType = BType::Int64;
+    return;
+  }
+}
+
+// aio_read(fd, p, n, offset), aio_write(fd, p, n, offset), aio_open(path,
+// writable) and aio_close(fd) queue a request and give its Int32 ticket;
+// aio_submit() and aio_poll() -> Int32; aio_wait(ticket) -> Int64.
+static void analyzeAsyncBuiltin(CallNode &call, SemaContext &sc) {
+  Builtin b = call.builtin;
+  size_t arity = b == Builtin::AioRead || b == Builtin::AioWrite ? 4
+                 : b == Builtin::AioOpen                         ? 2
+                 : b == Builtin::AioSubmit || b == Builtin::AioPoll ? 0
+                                                                    : 1;
+  if (!expectArity(call, sc, arity))
+    return;
+  call.exprType = b == Builtin::AioWait ? BType::Int64 : BType::Int32;
+
+  switch (b) {
+  case Builtin::AioRead:
+  case Builtin::AioWrite: {
+    expectInteger(call, sc, 0, "fd");
+    const BType &data = call.args[1]->exprType;
+    if (data.isKnown() && !data.isPointer())
+      sc.error(call, "'" + call.name + "' needs a pointer, got '" +
+                         data.str() + "'");
+    expectInteger(call, sc, 2, "length");
+    expectInteger(call, sc, 3, "offset");
+    return;
+  }
+  case Builtin::AioOpen:
+    checkPath(call, sc, *call.args[0]);
+    expectInteger(call, sc, 1, "mode");
+    return;
+  case Builtin::AioClose:
+    expectInteger(call, sc, 0, "fd");
+    return;
+  case Builtin::AioWait:
+    expectInteger(call, sc, 0, "ticket");
+    return;
+  default:
+    return;
+  }
+}
+
+static void analyzeBuiltin(CallNode &call, SemaContext &sc) {
+  static const std::pair<const char *, Builtin> builtins[] = {
+      {"popcount", Builtin::Popcount}, {"clz", Builtin::Clz},
+      {"ctz", Builtin::Ctz},           {"bswap", Builtin::Bswap},
+      {"rotl", Builtin::Rotl},         {"rotr", Builtin::Rotr},
+      {"shuffle", Builtin::Shuffle},   {"reduce_add", Builtin::ReduceAdd},
+      {"reduce_mul", Builtin::ReduceMul}, {"reduce_min", Builtin::ReduceMin},
+      {"reduce_max", Builtin::ReduceMax}, {"reduce_and", Builtin::ReduceAnd},
+      {"reduce_or", Builtin::ReduceOr},   {"reduce_xor", Builtin::ReduceXor},
+      {"load", Builtin::Load},         {"store", Builtin::Store},
+      {"aload", Builtin::AlignedLoad}, {"astore", Builtin::AlignedStore},
+      {"len", Builtin::Len},           {"slice", Builtin::MakeSlice},
+      {"write", Builtin::Write},       {"flush", Builtin::Flush},
+      {"setbuf", Builtin::SetBuffering},
+      {"map_file", Builtin::MapFile},  {"unmap_file", Builtin::UnmapFile},
+      {"advise", Builtin::Advise},     {"create_file", Builtin::CreateFile},
+      {"append_file", Builtin::AppendFile},
+      {"close_file", Builtin::CloseFile},
+      {"aio_read", Builtin::AioRead},  {"aio_write", Builtin::AioWrite},
+      {"aio_open", Builtin::AioOpen},  {"aio_close", Builtin::AioClose},
+      {"aio_submit", Builtin::AioSubmit}, {"aio_poll", Builtin::AioPoll},
+      {"aio_wait", Builtin::AioWait},
+  };
+  for (const auto &entry : builtins)
+    if (call.name == entry.first)
+      call.builtin = entry.second;
+
+  if (call.builtin == Builtin::None) {
+    sc.error(call, "call to undeclared function '" + call.name + "'");
+    return;
+  }
+  if (call.builtin >= Builtin::AioRead) {
+    analyzeAsyncBuiltin(call, sc);
+    return;
+  }
+  if (call.builtin >= Builtin::MapFile) {
+    analyzeFileBuiltin(call, sc);
+    return;
+  }
+  if (call.builtin >= Builtin::Write) {
+    analyzeOutputBuiltin(call, sc);
+    return;
+  }
+  if (call.builtin >= Builtin::Len) {
+    analyzeSliceBuiltin(call, sc);
+    return;
+  }
+  if (call.builtin >= Builtin::Shuffle) {
+    analyzeVectorBuiltin(call, sc);
+    return;
+  }
+
+  size_t arity =
+      call.builtin == Builtin::Rotl || call.builtin == Builtin::Rotr ? 2 : 1;
+  if (call.args.size() != arity) {
+    sc.error(call, "'" + call.name + "' expects " + std::to_string(arity) +
+                       " arguments, got " + std::to_string(call.args.size()));
+    return;
+  }
+  for (auto &arg : call.args) {
+    const BType &t = arg->exprType;
+    if (t.isKnown() && (!t.isInteger() || t.kind == BType::Boolean)) {
+      sc.error(call, "'" + call.name + "' needs an integer argument, got '" +
+                         t.str() + "'");
+      return;
+    }
+  }
+
+  const BType &x = call.args[0]->exprType;
+  if (call.builtin == Builtin::Bswap && x.bits() % 16 != 0) {
+    sc.error(call, "'bswap' needs a type of 16, 32 or 64 bits, got '" +
+                       x.str() + "'");
+    return;
+  }
+  call.exprType = x;
+}
+
+// Functions of the standard library, defined as basiq_<name> in libbasiq.bc
+// (runtime/stdlib.c) or the runtime archive (runtime/string.c). The
+// signatures must match the C ones. A program's own function of the same
+// name takes precedence.
+static const FunctionSig *libraryFunction(const std::string &name) {
+  static const std::unordered_map<std::string, FunctionSig> library = [] {
+    BType chars = BType::pointerTo(BType::Char);
+    return std::unordered_map<std::string, FunctionSig>{
+        {"itoa", {BType::Int64, {BType::Int64, chars}}},
+        {"ftoa", {BType::Int64, {BType::Float, chars}}},
+        {"printf", {BType::Void, {chars}, true}},
+        {"strlen", {BType::Int64, {chars}}},
+        {"strcmp", {BType::Int32, {chars, chars}}},
+        {"memchr", {BType::Int64, {chars, BType::Int32, BType::Int64}}},
+        {"strstr", {BType::Int64, {chars, chars}}},
+        {"strcpy", {BType::Int64, {chars, chars}}},
+        {"string_concat", {BType::Void, {chars, chars}}},
+        {"to_upper", {BType::Void, {chars}}},
+        {"to_lower", {BType::Void, {chars}}},
+    };
+  }();
+  auto it = library.find(name);
+  return it == library.end() ? nullptr : &it->second;
+}
+
+// C varargs can only carry scalars and pointers. When the format is a
+// literal, each argument must also be what its % spec reads.
+static void analyzeFormatArgs(CallNode &call, SemaContext &sc) {
+  size_t fixed = call.paramTypes.size();
+  for (size_t i = fixed; i < call.args.size(); ++i) {
+    const BType &t = call.args[i]->exprType;
+    if (t.isKnown() && !t.isNumeric() && !t.isPointer())
+      sc.error(*call.args[i],
+               "'" + call.name + "' cannot print a '" + t.str() + "'",
+               t.isArray() ? "pass &x to print a Char array with %s" : "");
+  }
+
+  auto *fmt = dynamic_cast<StringNode *>(call.args[0].get());
+  if (!fmt)
+    return;
+  size_t next = fixed;
+  for (size_t i = 0; i + 1 < fmt->val.size(); ++i) {
+    if (fmt->val[i] != '%')
+      continue;
+    char spec = fmt->val[++i];
+    std::string wanted = spec == 'f'   ? "a Float"
+                         : spec == 's' ? "a Char*"
+                         : spec == 'd' || spec == 'u' || spec == 'x' ||
+                                 spec == 'c'
+                             ? "an integer"
+                             : "";
+    if (wanted.empty())
+      continue;
+    if (next == call.args.size()) {
+      sc.error(call, "'%" + std::string(1, spec) + "' has no argument to print");
+      return;
+    }
+    const ast &arg = *call.args[next++];
+    const BType &t = arg.exprType;
+    bool fits = spec == 'f'   ? t.isFloat()
+                : spec == 's' ? t.isPointer()
+                              : t.isInteger();
+    if ((t.isNumeric() || t.isPointer()) && !fits)
+      sc.error(arg, "'%" + std::string(1, spec) + "' needs " + wanted +
+                        ", got '" + t.str() + "'");
+  }
+  if (next < call.args.size())
+    sc.error(*call.args[next], "argument has no % spec in the format");
+}
+
+void CallNode::analyze(SemaContext &sc) {
+  BType expected = std::move(sc.expectedType);
+  sc.expectedType = BType();
+  for (auto &arg : args)
+    sc.analyze(arg);
+  sc.expectedType = std::move(expected);
+
+  const FunctionSig *found = nullptr;
+  auto it = sc.functions.find(name);
+  if (it != sc.functions.end())
+    found = &it->second;
+  else if ((found = libraryFunction(name))) {
+    symbol = "basiq_" + name;
+    variadic = found->variadic;
+  }
+  if (!found) {
+    analyzeBuiltin(*this, sc);
+    return;
+  }
+
+  const FunctionSig &sig = *found;
+  if (args.size() < sig.params.size() ||
+      (!sig.variadic && args.size() > sig.params.size())) {
+    sc.error(*this, "'" + name + "' expects " +
+                        std::to_string(sig.params.size()) +
+                        " arguments, got " + std::to_string(args.size()));
+  }
+
+  paramTypes = sig.params;
+  exprType = sig.ret;
+  for (size_t i = 0; i < args.size() && i < paramTypes.size(); ++i)
+    if (paramTypes[i].isSlice() || args[i]->exprType.isSlice())
+      checkSliceValue(sc, *args[i], paramTypes[i], *args[i]);
+  if (variadic)
+    analyzeFormatArgs(*this, sc);
+}
+
+void ArrayLiteralNode::analyze(SemaContext &sc) {
+  for (auto &elem : Elements)
+    sc.analyze(elem);
+
+  if (Elements.empty()) {
+    sc.error(*this, "empty array literal");
+    return;
+  }
+  exprType = BType::arrayOf(Elements[0]->exprType, Elements.size());
+}
+
+// Shared by the nodes that index a named array.
+static void analyzeArrayUse(SemaContext &sc, const ast &at,
+                            const std::string &name, Symbol *&sym,
+                            std::unique_ptr<ast> &index) {
+  sc.analyze(index);
+  sym = sc.resolve(at, name);
+  if (!sym)
+    return;
+  // Indexing a vector reads or writes one lane.
+  if (!sym->type.isArray() && !sym->type.isVector() && !sym->type.isSlice()) {
+    sc.error(at, "'" + name + "' is not an array");
+    sym = nullptr;
+    return;
+  }
+  if (index && index->exprType.isKnown() && !index->exprType.isInteger())
+    sc.error(at, "array index must be an integer");
+}
+
+void ArrayAccessNode::analyze(SemaContext &sc) {
+  analyzeArrayUse(sc, *this, arrayName, sym, indexExpr);
+  if (sym)
+    exprType = sym->type.element();
+}
+
+void ArrayAssignNode::analyze(SemaContext &sc) {
+  analyzeArrayUse(sc, *this, name, sym, index);
+  sc.analyze(value);
+  if (sym && (sym->type.element().isStruct() || value->exprType.isStruct()))
+    checkStructCopy(sc, *this, sym->type.element(), *value);
+  if (sym && (sym->type.element().isSlice() || value->exprType.isSlice()))
+    checkSliceValue(sc, *this, sym->type.element(), *value);
+  exprType = BType::Void;
+}
+
+void SubSliceNode::analyze(SemaContext &sc) {
+  sc.analyze(lo);
+  sc.analyze(hi);
+  sym = sc.resolve(*this, name);
+  rejectSoa(sc, *this, sym);
+  if (!sym)
+    return;
+  if (!sym->type.isArray() && !sym->type.isSlice()) {
+    sc.error(*this, "cannot slice '" + name + "' of type '" +
+                        sym->type.str() + "'");
+    sym = nullptr;
+    return;
+  }
+  for (auto *bound : {lo.get(), hi.get()})
+    if (bound && bound->exprType.isKnown() && !bound->exprType.isInteger())
+      sc.error(*this, "slice bounds must be integers");
+  exprType = BType::sliceOf(sym->type.element());
+}
+
+void SizeOfNode::analyze(SemaContext &sc) {
+  exprType = BType::Integer;
+  // sizeof(Name) is the struct unless a variable shadows it.
+  if (auto *ref = dynamic_cast<VariableReferenceNode *>(val.get());
+      ref && sc.structs.count(ref->Name) &&
+      std::none_of(sc.scopes.begin(), sc.scopes.end(),
+                   [&](auto &scope) { return scope.count(ref->Name) != 0; })) {
+    type = BType::structNamed(ref->Name);
+    val.reset();
+  }
+  if (val) {
+    sc.analyze(val);
+    type = val->exprType;
+  } else {
+    sc.checkType(*this, type);
+  }
+  if (type.isVoid())
+    sc.error(*this, std::string("cannot take ") +
+                        (align ? "alignof" : "sizeof") + " of Void");
+}
+
+void SyscallNode::analyze(SemaContext &sc) {
+  for (auto &arg : args)
+    sc.analyze(arg);
+  if (args.size() > 6)
+    sc.error(*this, "a syscall takes at most 6 arguments");
+  exprType = BType::Integer;
+}
+
+void PointerReferenceNode::analyze(SemaContext &sc) {
+  sym = sc.resolve(*this, name);
+  if (!sym)
+    return;
+  if (sym->readOnly)
+    sc.error(*this, "cannot take the address of loop variable '" + name + "'");
+  rejectSoa(sc, *this, sym);
+  sym->addressTaken = true;
+  // &arr points at the first element, like a C array decaying.
+  exprType = sym->type.isArray() ? BType::pointerTo(sym->type.element())
+                                 : BType::pointerTo(sym->type);
+}
+
+// Shared by the nodes that go through a named pointer.
+static void analyzePointerUse(SemaContext &sc, const ast &at,
+                              const std::string &name, Symbol *&sym) {
+  sym = sc.resolve(at, name);
+  if (!sym)
+    return;
+  if (!sym->type.isPointer()) {
+    sc.error(at, "'" + name + "' is not a pointer");
+    sym = nullptr;
+  } else if (sym->type.element().isVoid()) {
+    sc.error(at, "cannot dereference '" + name + "' of type Void*");
+    sym = nullptr;
+  }
+}
+
+static void checkIndex(SemaContext &sc, const ast &at,
+                       const std::unique_ptr<ast> &index) {
+  if (index && index->exprType.isKnown() && !index->exprType.isInteger())
+    sc.error(at, "pointer index must be an integer");
+}
+
+void PointerDeReferenceAssingNode::analyze(SemaContext &sc) {
+  sc.analyze(index);
+  checkIndex(sc, *this, index);
+  sc.analyze(val);
+  analyzePointerUse(sc, *this, name, sym);
+  exprType = BType::Void;
+}
+
+void DeReferenceNode::analyze(SemaContext &sc) {
+  sc.analyze(index);
+  checkIndex(sc, *this, index);
+  analyzePointerUse(sc, *this, name, sym);
+  if (sym)
+    exprType = sym->type.element();
+}
+
+void CastNode::analyze(SemaContext &sc) {
+  sc.analyze(Value);
+  if (!sc.checkType(*this, targetType))
+    return;
+  // To a vector: splat a scalar, or convert lane by lane.
+  const BType &from = Value->exprType;
+  // A struct converts to nothing else, and is only "cast" to its own type.
+  bool ok = targetType.isStruct() || from.isStruct() ? from == targetType
+            : targetType.isVector()
+                ? from.isNumeric() ||
+                      (from.isVector() && from.count == targetType.count)
+                : !from.isVector();
+  if (from.isKnown() && !ok)
+    sc.error(*this, "cannot cast '" + from.str() + "' to '" + targetType.str() +
+                        "'");
+  exprType = targetType;
+}
+
+void StructCreateNode::declare(SemaContext &sc) {
+  if (sc.structs.count(name))
+    sc.error(*this, "redefinition of struct '" + name + "'");
+
+  for (size_t i = 0; i < fields.size(); ++i) {
+    const auto &[field, type] = fields[i];
+    for (size_t j = 0; j < i; ++j)
+      if (fields[j].first == field)
+        sc.error(*this, "duplicate field '" + field + "' in struct '" + name +
+                            "'");
+    // A struct held by value must be complete; this also rules out a
+    // struct containing itself. Pointers may refer to anything.
+    const BType *inner = &type;
+    while (inner->isArray())
+      inner = &inner->element();
+    if (inner->isStruct() && !sc.structs.count(inner->name))
+      sc.error(*this, "field '" + field + "' uses struct '" + inner->name +
+                          "' before its declaration",
+               "declare '" + inner->name + "' first, or hold it by pointer");
+    if (type.isVoid())
+      sc.error(*this, "field '" + field + "' cannot be Void");
+  }
+  sc.structs[name] = fields;
+}
+
+void StructCreateNode::analyze(SemaContext &sc) {
+  for (auto &field : fields)
+    sc.checkType(*this, field.second);
+}
+
+void MemberAccessNode::analyze(SemaContext &sc) {
+  sc.analyze(base);
+  BType t = base->exprType;
+  if (!t.isKnown())
+    return;
+  if (t.isPointer() && t.element().isStruct()) {
+    t = t.element();
+  } else if (!t.isStruct()) {
+    sc.error(*this, "cannot access field '" + field + "' of '" + t.str() + "'");
+    return;
+  } else if (!dynamic_cast<VariableReferenceNode *>(base.get()) &&
+             !dynamic_cast<ArrayAccessNode *>(base.get()) &&
+             !dynamic_cast<MemberAccessNode *>(base.get())) {
+    sc.error(*this, "cannot access a field of a temporary struct");
+    return;
+  }
+
+  auto found = sc.structs.find(t.name);
+  if (found == sc.structs.end())
+    return; // reported where the type was declared
+  for (const auto &f : found->second)
+    if (f.first == field) {
+      exprType = f.second;
+      return;
+    }
+  sc.error(*this, "struct '" + t.name + "' has no field '" + field + "'");
+}
+
+void MemberAssignNode::analyze(SemaContext &sc) {
+  sc.analyze(target);
+  const BType &type = target->exprType;
+  analyzeValue(sc, val, type);
+  exprType = BType::Void;
+  if (!type.isKnown())
+    return;
+  if (type.isArray())
+    checkArrayCopy(sc, *this, type, *val);
+  if (type.isStruct() || val->exprType.isStruct())
+    checkStructCopy(sc, *this, type, *val);
+  if (type.isVector() || val->exprType.isVector())
+    checkVectorValue(sc, *this, type, val->exprType);
+  if (type.isSlice() || val->exprType.isSlice())
+    checkSliceValue(sc, *this, type, *val);
+}
+
+void analyzeProgram(std::vector<std::unique_ptr<ast>> &program,
+                    Diagnostics &diag, bool freestanding) {
+  SemaContext sc(diag);
+  sc.freestanding = freestanding;
+  for (auto &node : program)
+    node->declare(sc);
+
+  sc.pushScope();
+  for (auto &node : program)
+    sc.analyze(node);
+  sc.popScope();
+}
@@ -0,0 +1,21 @@
+# Compiles SOURCE with BASIQ in WORKDIR and checks the optimized IR it
+# leaves in output.ll: the standard library call must be inlined away, and
+# the loop vectorized for the host CPU.
+file(MAKE_DIRECTORY ${WORKDIR})
+execute_process(
+    COMMAND ${BASIQ} ${SOURCE}
+    WORKING_DIRECTORY ${WORKDIR}
+    RESULT_VARIABLE result
+    OUTPUT_QUIET
+)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "BASIQ failed on ${SOURCE}")
+endif()
+
+file(READ "${WORKDIR}/output.ll" ir)
+if(ir MATCHES "@basiq_itoa")
+    message(FATAL_ERROR "itoa from libbasiq.bc was not inlined")
+endif()
+if(NOT ir MATCHES "<[0-9]+ x i32>")
+    message(FATAL_ERROR "the loop in sumsq was not vectorized")
+endif()
@@ -0,0 +1,165 @@
+// Checks the number formatting in runtime/stdlib.c against known strings,
+// and that a wide sample of floats reads back through strtof unchanged.
+// stdlib.c is included whole so its static formatters can be called.
+#include "../runtime/stdlib.c"
+
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int failures;
+
+static void expect(const char *what, const char *got, const char *want) {
+  if (strcmp(got, want) != 0) {
+    printf("%s: got \"%s\", want \"%s\"\n", what, got, want);
+    ++failures;
+  }
+}
+
+static float from_bits(uint32_t bits) {
+  union {
+    uint32_t bits;
+    float f;
+  } u = {bits};
+  return u.f;
+}
+
+static void expect_float(float f, const char *want) {
+  char out[NUMBER_MAX + 1];
+  out[format_float(out, f)] = '\0';
+  char what[32];
+  snprintf(what, sizeof what, "float %.9g", f);
+  expect(what, out, want);
+}
+
+static void expect_signed(int64_t v, const char *want) {
+  char out[NUMBER_MAX + 1];
+  out[format_signed(out, v)] = '\0';
+  char what[32];
+  snprintf(what, sizeof what, "signed %lld", (long long)v);
+  expect(what, out, want);
+}
+
+static void expect_hex(uint64_t v, const char *want) {
+  char out[NUMBER_MAX + 1];
+  out[format_hex(out, v)] = '\0';
+  char what[32];
+  snprintf(what, sizeof what, "hex %llx", (unsigned long long)v);
+  expect(what, out, want);
+}
+
+static void check_integers(void) {
+  expect_signed(0, "0");
+  expect_signed(9, "9");
+  expect_signed(10, "10");
+  expect_signed(99, "99");
+  expect_signed(100, "100");
+  expect_signed(9999, "9999");
+  expect_signed(10000, "10000");
+  expect_signed(-1, "-1");
+  expect_signed(-10000, "-10000");
+  expect_signed(INT64_MAX, "9223372036854775807");
+  expect_signed(INT64_MIN, "-9223372036854775808");
+
+  char out[NUMBER_MAX + 1];
+  out[format_unsigned(out, UINT64_MAX)] = '\0';
+  expect("unsigned max", out, "18446744073709551615");
+
+  expect_hex(0, "0");
+  expect_hex(0xf, "f");
+  expect_hex(0x10, "10");
+  expect_hex(0xdeadbeef, "deadbeef");
+  expect_hex(UINT64_MAX, "ffffffffffffffff");
+}
+
+// Every power of ten in range is one digit, in fixed notation from 1e-6 to
+// 1e20 and exponent notation outside.
+static void check_powers_of_ten(void) {
+  for (int k = -45; k <= 38; ++k) {
+    char text[16], want[32];
+    snprintf(text, sizeof text, "1e%d", k);
+    if (k >= 0 && k <= 20) {
+      want[0] = '1';
+      memset(want + 1, '0', (size_t)k);
+      want[k + 1] = '\0';
+    } else if (k < 0 && k >= -6) {
+      memcpy(want, "0.", 2);
+      memset(want + 2, '0', (size_t)(-k - 1));
+      memcpy(want + 1 - k, "1", 2);
+    } else {
+      snprintf(want, sizeof want, "1e%c%d", k < 0 ? '-' : '+', k < 0 ? -k : k);
+    }
+    expect_float(strtof(text, NULL), want);
+  }
+}
+
+static void check_floats(void) {
+  expect_float(0.0f, "0");
+  expect_float(-0.0f, "-0");
+  expect_float(1.0f, "1");
+  expect_float(-1.5f, "-1.5");
+  expect_float(0.25f, "0.25");
+  expect_float(150.0f, "150");
+  expect_float(0.1f, "0.1");
+  expect_float(1.0f / 3, "0.33333334");
+  expect_float(123456.79f, "123456.79");
+  expect_float(16777216.0f, "16777216");
+  expect_float(from_bits(0x7f800000), "inf");
+  expect_float(from_bits(0xff800000), "-inf");
+  expect_float(from_bits(0x7fc00000), "nan");
+
+  // The ends of the range, and the subnormals.
+  expect_float(FLT_MAX, "3.4028235e+38");
+  expect_float(-FLT_MAX, "-3.4028235e+38");
+  expect_float(FLT_MIN, "1.1754944e-38");
+  expect_float(from_bits(0x007fffff), "1.1754942e-38");
+  expect_float(from_bits(0x00000001), "1e-45");
+  expect_float(from_bits(0x00000002), "3e-45");
+  expect_float(from_bits(0x00000007), "1e-44");
+
+  // Either side of the switches between notations.
+  expect_float(1e21f, "1e+21");
+  expect_float(1.5e21f, "1.5e+21");
+  expect_float(1e20f, "100000000000000000000");
+  expect_float(1e-7f, "1e-7");
+  expect_float(1.5e-7f, "1.5e-7");
+  expect_float(1e-6f, "0.000001");
+  expect_float(1.5e-6f, "0.0000015");
+
+  // Ties: a decimal exactly halfway between two floats reads back as the one
+  // with the even mantissa, so only that one may be printed as it.
+  // 33554450 lies between 33554448 (even) and 33554452 (odd).
+  expect_float(from_bits(0x4c000004), "33554450");
+  expect_float(from_bits(0x4c000005), "33554452");
+  // 33554470 lies between 33554468 (odd) and 33554472 (even).
+  expect_float(from_bits(0x4c000009), "33554468");
+  expect_float(from_bits(0x4c00000a), "33554470");
+}
+
+// Every 997th bit pattern, through all exponents and both signs.
+static void check_round_trip(void) {
+  int wrong = 0;
+  for (uint64_t bits = 0; bits <= UINT32_MAX; bits += 997) {
+    float f = from_bits((uint32_t)bits);
+    if (f != f)
+      continue;
+    char out[NUMBER_MAX + 1];
+    out[format_float(out, f)] = '\0';
+    float back = strtof(out, NULL);
+    if (memcmp(&back, &f, sizeof f) != 0 && wrong++ < 10)
+      printf("float %08x: \"%s\" reads back as %.9g\n", (uint32_t)bits, out,
+             back);
+  }
+  failures += wrong;
+}
+
+int main(void) {
+  check_integers();
+  check_powers_of_ten();
+  check_floats();
+  check_round_trip();
+  if (failures)
+    printf("%d failure(s)\n", failures);
+  return failures != 0;
+}
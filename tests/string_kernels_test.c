@@ -0,0 +1,139 @@
+// Runs the SSE2 and AVX2 string kernels on strings that end just before an
+// unmapped page, and checks their results against plain byte loops. A load
+// past the terminator into that page faults and fails the test.
+// string.c is included whole so both kernel sets can be called.
+#include "../runtime/string.c"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define MAX_GAP 64 // bytes between the terminator and the guard page
+#define MAX_LEN 96
+
+static int failures;
+
+static int64_t length_ref(const char *s) {
+  int64_t n = 0;
+  while (s[n])
+    ++n;
+  return n;
+}
+
+static int32_t compare_ref(const char *a, const char *b) {
+  while (*a && *a == *b)
+    ++a, ++b;
+  return (unsigned char)*a - (unsigned char)*b;
+}
+
+static int64_t find_ref(const char *h, const char *needle) {
+  int64_t k = length_ref(needle), n = length_ref(h);
+  for (int64_t i = 0; i + k <= n; ++i)
+    if (bytes_equal(h + i, needle, k))
+      return i;
+  return -1;
+}
+
+// The end of a readable page followed by one that is not mapped.
+static char *guarded_page(void) {
+  long page = sysconf(_SC_PAGESIZE);
+  char *p = mmap(NULL, 2 * page, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED || mprotect(p + page, page, PROT_NONE) != 0) {
+    perror("guarded_page");
+    return NULL;
+  }
+  return p + page;
+}
+
+// Copies len bytes of text to end gap bytes before guard, terminator
+// included, and returns where the copy starts.
+static char *place(char *guard, int64_t gap, const char *text, int64_t len) {
+  char *s = guard - gap - len;
+  memcpy(s, text, len);
+  s[len] = '\0';
+  return s;
+}
+
+static void fail(const char *set, const char *kernel, int64_t gap,
+                 int64_t len, int64_t got, int64_t want) {
+  if (failures++ < 20)
+    printf("%s %s, %lld bytes ending %lld before the guard: got %lld, "
+           "want %lld\n",
+           set, kernel, (long long)len, (long long)gap, (long long)got,
+           (long long)want);
+}
+
+static void check(const char *set, const string_kernels *k, char *guard_a,
+                  char *guard_b) {
+  char text[MAX_LEN + 1], other[MAX_LEN + 1];
+  // A two-letter alphabet gives find many partial matches to reject.
+  for (int64_t i = 0; i < MAX_LEN; ++i)
+    text[i] = "ab"[(i * i + i / 3) % 5 < 2];
+
+  for (int64_t gap = 1; gap <= MAX_GAP; ++gap) {
+    // b ends at a different distance from its guard than a.
+    int64_t gap_b = (gap * 7) % MAX_GAP + 1;
+    for (int64_t len = 0; len <= MAX_LEN - gap; ++len) {
+      char *a = place(guard_a, gap, text, len);
+      int64_t got = k->length(a);
+      if (got != len)
+        fail(set, "strlen", gap, len, got, len);
+
+      got = k->find_byte(a, '\0', len + 1);
+      if (got != len)
+        fail(set, "memchr", gap, len, got, len);
+
+      // Equal, differing at each position, and b a prefix of a.
+      for (int64_t at = 0; at <= len; ++at) {
+        memcpy(other, text, len);
+        other[at] = other[at] == 'a' ? 'b' : 'a';
+        char *b = place(guard_b, gap_b, other, len);
+        got = k->compare(a, b);
+        if (got != compare_ref(a, b))
+          fail(set, "strcmp", gap, len, got, compare_ref(a, b));
+        b = place(guard_b, gap_b, text, at);
+        got = k->compare(a, b);
+        if (got != compare_ref(a, b))
+          fail(set, "strcmp", gap, len, got, compare_ref(a, b));
+        got = k->compare(b, a);
+        if (got != compare_ref(b, a))
+          fail(set, "strcmp", gap, len, got, compare_ref(b, a));
+      }
+
+      // Needles taken from the end of a, so matches sit against the guard,
+      // and the same with the last byte changed.
+      for (int64_t n = 0; n <= len && n <= 40; ++n) {
+        memcpy(other, text + len - n, n);
+        for (int miss = 0; miss < 2 && (n > 0 || !miss); ++miss) {
+          if (miss)
+            other[n - 1] = 'c';
+          char *needle = place(guard_b, gap_b, other, n);
+          got = k->find(a, needle);
+          if (got != find_ref(a, needle))
+            fail(set, "strstr", gap, len, got, find_ref(a, needle));
+        }
+      }
+    }
+  }
+}
+
+int main(void) {
+  char *guard_a = guarded_page(), *guard_b = guarded_page();
+  if (!guard_a || !guard_b)
+    return 1;
+  string_kernels sse2 = {length_sse2, compare_sse2, find_byte_sse2,
+                         find_sse2,   copy_sse2,    flip_case_sse2};
+  check("sse2", &sse2, guard_a, guard_b);
+  if (have_avx2()) {
+    string_kernels avx2 = {length_avx2, compare_avx2, find_byte_avx2,
+                           find_avx2,   copy_avx2,    flip_case_avx2};
+    check("avx2", &avx2, guard_a, guard_b);
+  } else {
+    printf("no AVX2 here; checked the SSE2 kernels only\n");
+  }
+  if (failures)
+    printf("%d failure(s)\n", failures);
+  return failures != 0;
+}